@@ -0,0 +1,113 @@
+#ifndef MP_ACCESS_POINT_INDEX_HPP
+#define MP_ACCESS_POINT_INDEX_HPP
+
+#include <algorithm>
+
+#include "defs.hpp"
+#include "feature_computation.hpp"
+#include "tools/array_view.hpp"
+
+namespace mp {
+
+struct tracing_data;
+
+/**
+ * An inverted index from access points to the devices that received
+ * a signal from them.
+ *
+ * The time range of the tracing data is divided into blocks
+ * of `block_size` seconds and the index is computed separately for every block.
+ * A device is listed for an access point in a block iff its `has_data`
+ * flag for that access point is set at least once within the block.
+ */
+struct access_point_index
+{
+    /**
+     * The index for a single block of time.
+     */
+    struct block_data
+    {
+        /**
+         * The devices of access point `ap` are stored in
+         * `devices[offsets[ap] ... offsets[ap + 1])`, in ascending order.
+         * Has `access_points + 1` entries.
+         */
+        vector<i32> offsets;
+
+        /// Device indices for all access points.
+        vector<i32> devices;
+
+        /// The number of distinct access points seen by every device in this block.
+        vector<i32> access_point_counts;
+    };
+
+    /**
+     * Returns the list of devices that have seen the access point `ap`
+     * in the given block.
+     */
+    array_view<const i32> devices_at(const block_data &block, i32 ap) const
+    {
+        assert(ap >= 0 && ap < access_points && "Access point in range");
+        const i32 *devices = block.devices.data();
+        return array_view<const i32>(devices + block.offsets[ap],
+                                     devices + block.offsets[ap + 1]);
+    }
+
+    /**
+     * Returns the first and the last timestamp (inclusive)
+     * covered by the block with the given index.
+     */
+    tuple<i64, i64> block_range(size_t block) const
+    {
+        assert(block < blocks.size() && "Block index in range");
+        i64 begin = begin_timestamp + i64(block) * block_size;
+        i64 end = std::min(begin + block_size - 1, end_timestamp);
+        return make_tuple(begin, end);
+    }
+
+    i64 begin_timestamp = 0;    ///< First timestamp of the first block.
+    i64 end_timestamp = 0;      ///< Last timestamp of the last block (inclusive).
+    i64 block_size = 0;         ///< Number of seconds per block.
+    i32 access_points = 0;      ///< Number of access points (== tracing_data::data_dimension).
+    i32 num_devices = 0;        ///< Number of devices (== size of tracing_data::devices).
+
+    vector<block_data> blocks;
+};
+
+/**
+ * Builds the access point index for the given tracing data,
+ * which must have been created from signal data.
+ *
+ * \param block_size
+ *      The number of seconds per block. Must be greater than zero.
+ *
+ * \relates access_point_index
+ */
+access_point_index make_access_point_index(const tracing_data &td, i64 block_size);
+
+/**
+ * Filters the list of device pairs by using the access point index.
+ *
+ * A pair is considered active within a block if the two devices
+ * share at least `min_shared_access_points` access points in that block and
+ * if the Jaccard index of their sets of access points is at least `min_jaccard`.
+ * Devices that never hear a common access point cannot be co-located,
+ * thus there is no need to compute any feature vectors for them.
+ *
+ * Returns one candidate for every input pair that is active in at least one block.
+ * The ranges of a candidate are the (merged) time ranges of its active blocks.
+ * The candidates are returned in the same order as their input pairs.
+ *
+ * \param min_shared_access_points  Must be greater than zero.
+ * \param min_jaccard               Must be in [0, 1].
+ *
+ * \relates access_point_index
+ */
+vector<candidate_pair> candidate_pairs(const access_point_index &index,
+                                       const vector<tuple<i32, i32>> &pairs,
+                                       i32 min_shared_access_points,
+                                       double min_jaccard = 0.0);
+
+} // namespace mp
+
+#endif // MP_ACCESS_POINT_INDEX_HPP
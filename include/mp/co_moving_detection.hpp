@@ -4,15 +4,101 @@
 #include <memory>
 
 #include "defs.hpp"
+#include "feature_computation.hpp"
 #include "serialization.hpp"
+#include "tools/array_2d.hpp"
 #include "tools/array_view.hpp"
 
 namespace mp {
 
 struct ground_truth;
-struct similarity_data;
+struct interval_ground_truth;
 struct tracing_data;
 
+/**
+ * Controls the selection of training samples in co_moving_classifier::learn().
+ *
+ * Co-moving samples are usually a small minority of the learning data.
+ * All of them are used for training, while the number of
+ * non-co-moving samples can be bounded.
+ */
+struct co_moving_training_options
+{
+    /**
+     * The regularization parameter of the svm. Must be greater than zero.
+     * See co_moving_classifier::cross_validate() for a way to choose this value.
+     */
+    double C = 1.0;
+
+    /**
+     * The maximum number of non-co-moving samples.
+     * If there are more, a uniform random subset (reservoir sampling) is used.
+     * 0 means no limit.
+     */
+    i64 max_negatives = 0;
+
+    /**
+     * The seed for the random selection of non-co-moving samples.
+     * The same data and the same seed always result in the same selection.
+     */
+    u32 seed = 42;
+
+    /**
+     * Feature vectors of a pair are dropped if they differ by at most
+     * this value from the last feature vector of the same pair that has been kept
+     * and have the same label. This removes long runs of
+     * (nearly) identical samples, e.g. while devices are stationary.
+     * The difference is the maximum absolute difference of all features
+     * in units of their standard deviations.
+     * Negative values disable the filter.
+     * Note that the filter changes the relative weight of the remaining samples,
+     * e.g. a long stationary co-moving period is reduced to a single sample.
+     */
+    double duplicate_tolerance = -1;
+};
+
+/**
+ * The cross validation result for a single value of C.
+ * The counts are summed over all folds.
+ */
+struct cross_validation_result
+{
+    double C = 0;
+
+    i64 positives = 0;          ///< Number of co-moving test samples.
+    i64 correct_positives = 0;  ///< Number of co-moving test samples classified as co-moving.
+    i64 negatives = 0;          ///< Number of non-co-moving test samples.
+    i64 correct_negatives = 0;  ///< Number of non-co-moving test samples classified as non-co-moving.
+
+    /// The fraction of correctly classified co-moving samples.
+    double positive_accuracy() const
+    {
+        return positives ? double(correct_positives) / double(positives) : 0.0;
+    }
+
+    /// The fraction of correctly classified non-co-moving samples.
+    double negative_accuracy() const
+    {
+        return negatives ? double(correct_negatives) / double(negatives) : 0.0;
+    }
+
+    /// The mean of positive_accuracy() and negative_accuracy().
+    /// Unlike the plain accuracy, this is not dominated by the (much larger) negative class.
+    double balanced_accuracy() const
+    {
+        return (positive_accuracy() + negative_accuracy()) / 2;
+    }
+};
+
+/**
+ * Returns the result with the highest balanced accuracy.
+ * Ties are resolved in favor of the smaller C (the simpler model).
+ * The list of results must not be empty.
+ *
+ * \relates cross_validation_result
+ */
+const cross_validation_result& best_result(const vector<cross_validation_result> &results);
+
 /**
  * Classifies feature vectors as either co-moving or not co-moving.
  *
@@ -26,6 +112,28 @@ class co_moving_classifier
 {
 public:
     static void print_cross_validation(const similarity_data &data, const ground_truth &gt, std::ostream &o);
+    static void print_cross_validation(const similarity_data &data, const interval_ground_truth &gt, std::ostream &o);
+
+    /**
+     * The values of C tested by print_cross_validation().
+     */
+    static vector<double> default_C_values();
+
+    /**
+     * Performs k-fold cross validation for every value in `C_values`.
+     * The training samples are selected according to `options` (its `C` is ignored)
+     * and normalized once; all (C, fold) combinations are then evaluated in parallel
+     * using up to `threads` threads.
+     *
+     * Returns one result for every value of C, in the same order.
+     * The results do not depend on the number of threads.
+     *
+     * \param folds    The number of folds. Must be at least 2.
+     */
+    static vector<cross_validation_result> cross_validate(
+            const similarity_data &data, const interval_ground_truth &gt,
+            const vector<double> &C_values, i32 folds = 3, i32 threads = 1,
+            const co_moving_training_options &options = co_moving_training_options());
 
 public:
     /**
@@ -34,18 +142,59 @@ public:
      * It should have been computed with the same method as the machine's learning data
      * (i.e. time lag, window size and algorithm).
      *
-     * Please note that this function is not thread-safe,
-     * since it uses an internal, mutable buffer.
+     * This function does not modify the classifier and can be called
+     * from multiple threads concurrently.
      */
-    bool co_moving(array_view<const double> a);
+    bool co_moving(array_view<const double> a) const;
+
+    /**
+     * Classifies every row of `features` as a separate feature vector.
+     * `out` will be resized to the number of rows; `out[i]` is nonzero
+     * iff row `i` is classified as "co-moving".
+     *
+     * The normalization and the linear decision function are folded
+     * into a single weight vector when the classifier is learned or loaded,
+     * thus every row only needs a single dot product.
+     * Like co_moving(), this function can be called from multiple threads.
+     */
+    void co_moving_batch(const array_2d<double> &features, vector<char> &out) const;
 
     /**
      * Learn from the data set and ground truth.
      * Replaces the state of this classifier.
      * Future classifications in co_moving() will be based
      * on this learning data.
+     * The training samples are selected according to `options`;
+     * by default, all samples are used.
+     */
+    void learn(const similarity_data &data, const ground_truth &gt,
+               const co_moving_training_options &options = co_moving_training_options());
+
+    /**
+     * Same as above, but uses the interval representation of the ground truth.
+     */
+    void learn(const similarity_data &data, const interval_ground_truth &gt,
+               const co_moving_training_options &options = co_moving_training_options());
+
+    /**
+     * Continues training with additional data (warm start).
+     *
+     * The normalization statistics of the classifier are combined with the statistics
+     * of the new samples and the current model is expressed in terms of the new normalization.
+     * The svm is then optimized on the new samples only, starting from the current model;
+     * the regularization pulls the result towards the current model instead of zero.
+     * Updating an empty classifier is equivalent to learn().
+     *
+     * The feature dimension of `data` must match the classifier.
      */
-    void learn(const similarity_data &data, const ground_truth &gt);
+    void update(const similarity_data &data, const ground_truth &gt,
+                const co_moving_training_options &options = co_moving_training_options());
+
+    /**
+     * Same as above, but uses the interval representation of the ground truth.
+     */
+    void update(const similarity_data &data, const interval_ground_truth &gt,
+                const co_moving_training_options &options = co_moving_training_options());
 
     /**
      * Load the classifier from the given stream,
@@ -64,12 +213,124 @@ public:
 
     co_moving_classifier& operator =(co_moving_classifier &&);
 private:
+    friend class co_moving_online_trainer;
+
     struct impl;
 
 private:
     std::unique_ptr<impl> m_impl;
 };
 
+/**
+ * Trains a co_moving_classifier from data sets that do not fit into memory.
+ *
+ * Training happens in two phases, both of which visit the feature vectors
+ * one pair at a time:
+ *  1. Every pair is passed to `observe()` once to compute the statistics
+ *     used for normalization.
+ *  2. Every pair is passed to `train()` any number of times (epochs),
+ *     followed by a call to `flush()` after every epoch.
+ *     The svm is optimized using stochastic subgradient descent (Pegasos).
+ *
+ * The objective is the same as in co_moving_classifier::learn().
+ */
+class co_moving_online_trainer
+{
+public:
+    /**
+     * Creates a trainer for feature vectors of the given dimension.
+     *
+     * \param C            The regularization parameter of the svm.
+     * \param seed         Seed for the random order of samples.
+     * \param buffer_size  The number of feature vectors in the shuffle buffer.
+     *                     Samples from different pairs are only mixed within the buffer,
+     *                     so it should be large compared to the number of samples per pair.
+     */
+    co_moving_online_trainer(i32 dimension, double C = 1.0, u32 seed = 42,
+                             size_t buffer_size = 1 << 16);
+
+    /**
+     * Creates a trainer that continues training the given classifier (warm start).
+     * The normalization statistics start with the statistics of the classifier
+     * and optimization starts with its model (see co_moving_classifier::update()).
+     * The classifier must not be empty.
+     */
+    explicit co_moving_online_trainer(const co_moving_classifier &initial, double C = 1.0, u32 seed = 42,
+                                      size_t buffer_size = 1 << 16);
+
+    /**
+     * Updates the normalization statistics with all rows of the pair's feature matrix.
+     * Must not be called after `train()`.
+     */
+    void observe(const similarity_data::pair_data &pair);
+
+    /**
+     * Passes every feature vector of the pair through the shuffle buffer.
+     * An optimization step is performed for every sample that leaves the buffer.
+     * `data` provides the device names and the time range of the pair,
+     * its `pairs` member is not used.
+     */
+    void train(const similarity_data &data,
+               const similarity_data::pair_data &pair,
+               const interval_ground_truth &gt);
+
+    /**
+     * Performs an optimization step for all samples remaining in the shuffle buffer.
+     * Should be called at the end of every epoch.
+     */
+    void flush();
+
+    /**
+     * Returns the number of feature vectors passed to `observe()`,
+     * including the training samples of the initial classifier (if any).
+     */
+    i64 observed() const;
+
+    /**
+     * Returns the classifier trained so far.
+     * Samples in the shuffle buffer are not included, see `flush()`.
+     */
+    co_moving_classifier classifier() const;
+
+    co_moving_online_trainer(co_moving_online_trainer &&);
+    ~co_moving_online_trainer();
+
+    co_moving_online_trainer& operator =(co_moving_online_trainer &&);
+
+private:
+    struct state;
+
+private:
+    std::unique_ptr<state> m_state;
+};
+
+/**
+ * The confusion matrix of a classifier on a data set.
+ * Every (device pair, timestamp) combination is counted once.
+ */
+struct classification_counts
+{
+    i64 true_positive = 0;
+    i64 false_positive = 0;
+    i64 false_negative = 0;
+    i64 true_negative = 0;
+};
+
+/**
+ * Classifies every feature vector of `data` and compares the result
+ * with the ground truth.
+ *
+ * Every unique pair of `data.devices` is evaluated for every timestamp
+ * in [data.begin_timestamp, data.end_timestamp]. Pairs and timestamps without
+ * a feature vector (i.e. pruned during feature computation) are classified
+ * as not co-moving, so pruning cannot hide co-moving pairs from the result.
+ *
+ * \relates classification_counts
+ */
+classification_counts count_classifications(const co_moving_classifier &c,
+                                            const similarity_data &data,
+                                            const interval_ground_truth &gt);
+
 /**
  * Save the classifier to the archive.
  *
@@ -0,0 +1,293 @@
+#ifndef MP_DEVICE_GRAPH_HPP
+#define MP_DEVICE_GRAPH_HPP
+
+#include "defs.hpp"
+#include "following_detection.hpp"
+#include "tools/array_view.hpp"
+
+namespace mp {
+
+/**
+ * A lightweight directed graph of devices, stored in compressed sparse row format.
+ *
+ * Vertices are device indices in [0, num_vertices()), there are no vertex names.
+ * The graph is meant to be rebuilt for every timestamp with `assign()`:
+ * all buffers are reused, thus no memory is allocated once the buffers
+ * are large enough.
+ *
+ * Use following_graph if the graph should be exported or modified.
+ */
+class device_graph
+{
+public:
+    /**
+     * Replaces the graph with the following graph of a single timestamp.
+     * There is one vertex for every device, the edges are the same as in following_graph_at():
+     * An edge (a, b) is added if a follows b; "co-leading" creates both (a, b) and (b, a).
+     * The weight of an edge is the absolute value of the estimated time lag.
+     *
+     * Edges keep their order, i.e. the out- and in-edges of every vertex
+     * are in the order in which they appear in `pairs`.
+     */
+    void assign(i32 num_vertices, array_view<const following_data::pair_data> pairs);
+
+    i32 num_vertices() const { return m_num_vertices; }
+
+    size_t num_edges() const { return m_targets.size(); }
+
+    /// The targets of all outgoing edges of `v`.
+    array_view<const i32> out_targets(i32 v) const
+    {
+        return range(m_targets, m_out_offsets, v);
+    }
+
+    /// The weights of all outgoing edges of `v` (same order as out_targets()).
+    array_view<const double> out_weights(i32 v) const
+    {
+        return range(m_out_weights, m_out_offsets, v);
+    }
+
+    /// The sources of all incoming edges of `v`.
+    array_view<const i32> in_sources(i32 v) const
+    {
+        return range(m_sources, m_in_offsets, v);
+    }
+
+    /// The weights of all incoming edges of `v` (same order as in_sources()).
+    array_view<const double> in_weights(i32 v) const
+    {
+        return range(m_in_weights, m_in_offsets, v);
+    }
+
+    i32 out_degree(i32 v) const
+    {
+        return static_cast<i32>(out_targets(v).size());
+    }
+
+private:
+    template<typename T>
+    array_view<const T> range(const vector<T> &values, const vector<size_t> &offsets, i32 v) const
+    {
+        assert(v >= 0 && v < m_num_vertices && "Vertex in range");
+        const T *data = values.data();
+        return array_view<const T>(data + offsets[v], data + offsets[v + 1]);
+    }
+
+private:
+    struct edge
+    {
+        i32 source;
+        i32 target;
+        double weight;
+    };
+
+    i32 m_num_vertices = 0;
+
+    // Out-edges of v: [m_out_offsets[v], m_out_offsets[v + 1]).
+    vector<size_t> m_out_offsets;
+    vector<i32>    m_targets;
+    vector<double> m_out_weights;
+
+    // In-edges of v: [m_in_offsets[v], m_in_offsets[v + 1]).
+    vector<size_t> m_in_offsets;
+    vector<i32>    m_sources;
+    vector<double> m_in_weights;
+
+    // Scratch space for assign().
+    vector<edge>   m_edges;
+};
+
+/**
+ * Iteration schemes for PageRank. All of them compute the same ranks
+ * (up to the configured error), but differ in the number of iterations.
+ */
+enum class page_rank_method
+{
+    /// Jacobi-style power iteration, i.e. the algorithm of `page_rank()` in page_rank.hpp.
+    power,
+
+    /// Gauss-Seidel iteration: the ranks are updated in place and every vertex
+    /// already uses the new ranks of the vertices before it.
+    gauss_seidel,
+
+    /// Power iteration with periodic quadratic extrapolation, which removes
+    /// the components of the second and third eigenvector from the error.
+    extrapolation,
+};
+
+/**
+ * Computes PageRank on device graphs.
+ *
+ * `assign()` stores the transposed adjacency of a graph (the incoming edges of every vertex)
+ * together with the normalized weight of every edge, i.e. its weight divided by the
+ * total weight of its source's outgoing edges, and the list of sinks.
+ * Every iteration is then a single sparse matrix-vector product over contiguous arrays;
+ * the rank of all sinks is summed once per iteration and distributed to all vertices.
+ *
+ * The buffers of an instance are reused, thus no memory is allocated once they
+ * are large enough.
+ */
+class page_rank_engine
+{
+public:
+    /**
+     * Prepares the computation for the given graph.
+     *
+     * \param use_weights
+     *      Whether to use the edge weights or to treat all edges equally.
+     */
+    void assign(const device_graph &g, bool use_weights);
+
+    i32 num_vertices() const { return m_num_vertices; }
+
+    /**
+     * Computes the PageRank of every vertex of the graph.
+     * This is the same algorithm as `page_rank()` in page_rank.hpp
+     * with the stop condition used for leader detection: iteration stops once the euclidean
+     * distance between two consecutive rank vectors is at most `error`
+     * or after `max_iterations`. The distance is computed while updating the ranks.
+     *
+     * \param[in,out] ranks
+     *      Will contain the rank of every vertex.
+     *      If `warm_start` is true, the current content is used as the start vector
+     *      instead of the uniform distribution, e.g. the ranks of a similar graph.
+     * \param warm_start
+     *      Whether to start from the ranks passed in. The start vector is rescaled
+     *      to a sum of 1; the uniform distribution is used instead if `ranks`
+     *      does not have one finite, non-negative entry for every vertex.
+     * \param method
+     *      The iteration scheme.
+     *
+     * Returns the number of iterations that have been performed.
+     */
+    i32 run(double damping, double error, i32 max_iterations,
+            vector<double> &ranks, bool warm_start = false,
+            page_rank_method method = page_rank_method::power);
+
+private:
+    // Computes the next ranks and returns the squared euclidean distance
+    // between the old and the new ranks.
+    double power_step(double damping, const double *rank, double *next) const;
+
+    i32 run_power(double damping, double error, i32 max_steps, vector<double> &ranks);
+    i32 run_gauss_seidel(double damping, double error, i32 max_steps, vector<double> &ranks);
+    i32 run_extrapolation(double damping, double error, i32 max_steps, vector<double> &ranks);
+
+    // Replaces x3 with the extrapolation of the four iterates x0, ..., x3.
+    static void extrapolate(const double *x0, const double *x1, const double *x2, double *x3, size_t size);
+
+    // Number of power iterations between two extrapolations.
+    // Must be at least 3, the extrapolation uses four consecutive iterates.
+    static constexpr i32 extrapolation_interval = 5;
+
+private:
+    i32 m_num_vertices = 0;
+
+    // Incoming edges of v: [m_offsets[v], m_offsets[v + 1]).
+    vector<size_t> m_offsets;
+    vector<i32>    m_sources;
+    vector<double> m_coefficients;  // Normalized weight of every incoming edge.
+    vector<i32>    m_sinks;         // Vertices without outgoing edges.
+    vector<char>   m_is_sink;
+
+    vector<double> m_next;
+    vector<double> m_last;
+    vector<double> m_oldest;
+};
+
+/**
+ * Computes the PageRank of every vertex of the graph using a temporary page_rank_engine.
+ * Use a page_rank_engine directly to avoid allocations when computing
+ * the ranks of many graphs.
+ *
+ * \relates device_graph
+ */
+i32 page_rank(const device_graph &g, bool use_weights,
+              double damping, double error, i32 max_iterations,
+              vector<double> &ranks, bool warm_start = false,
+              page_rank_method method = page_rank_method::power);
+
+/**
+ * Computes the weakly connected components of the graph (edge directions are ignored).
+ * Components are numbered in the order of their smallest vertex,
+ * e.g. vertex 0 always belongs to component 0.
+ *
+ * \param[out] components
+ *      Will contain the component of every vertex.
+ * \param stack
+ *      Temporary storage, can be reused between calls to avoid allocations.
+ *
+ * Returns the number of components.
+ *
+ * \relates device_graph
+ */
+i32 connected_components(const device_graph &g, vector<i32> &components, vector<i32> &stack);
+
+/**
+ * Finds the leader of every weakly connected component of a device graph,
+ * i.e. the vertex with the highest PageRank within its component.
+ *
+ * Components are computed with union-find over the edge list.
+ * PageRank is run separately for every component with at least three vertices:
+ * the ranks of a component in a PageRank over the entire graph are proportional
+ * to the ranks of the component on its own, so the leaders are the same.
+ * Components with one or two vertices are solved in closed form.
+ *
+ * The buffers of an instance are reused between calls to `find()`.
+ */
+class component_leaders
+{
+public:
+    /**
+     * Computes the leaders of all components of `g`.
+     *
+     * If the edges of a vertex have a total weight of zero, they are treated
+     * as if they had equal weights (instead of producing NaN ranks).
+     * Ties are resolved in favor of the vertex with the highest index.
+     *
+     * \param use_weights
+     *      Whether to use the edge weights or to treat all edges equally.
+     * \param[in,out] ranks
+     *      Will contain the rank of every vertex, normalized to a sum of 1
+     *      within its component. If `warm_start` is true, the current content
+     *      is used as the start vector of PageRank (see `page_rank_engine::run()`).
+     * \param[out] leaders
+     *      Will contain one vertex for every component.
+     *      Components are ordered by their smallest vertex (see `connected_components()`).
+     *
+     * \param method
+     *      The iteration scheme used for PageRank.
+     *
+     * Returns the total number of PageRank iterations.
+     */
+    i32 find(const device_graph &g, bool use_weights,
+             double damping, double error, i32 max_iterations,
+             vector<double> &ranks, vector<i32> &leaders,
+             bool warm_start = false,
+             page_rank_method method = page_rank_method::power);
+
+private:
+    i32 find_root(i32 v);
+
+    i32 solve_component(const device_graph &g, bool use_weights,
+                        double damping, double error, i32 max_iterations,
+                        array_view<const i32> vertices, vector<double> &ranks,
+                        bool warm_start, page_rank_method method);
+
+private:
+    vector<i32> m_parent;       // Union-find forest.
+    vector<i32> m_component;    // Component of every vertex.
+    vector<i32> m_local;        // Index of every vertex within its component.
+    vector<size_t> m_offsets;   // Vertices of component c: [m_offsets[c], m_offsets[c + 1]).
+    vector<i32> m_vertices;
+
+    // PageRank on a single component (local vertex indices).
+    vector<following_data::pair_data> m_pairs;
+    device_graph m_graph;
+    page_rank_engine m_engine;
+    vector<double> m_ranks;
+};
+
+} // namespace mp
+
+#endif // MP_DEVICE_GRAPH_HPP
@@ -1,6 +1,9 @@
 #ifndef MP_FOLLOWING_FEATURE_HPP
 #define MP_FOLLOWING_FEATURE_HPP
 
+#include <algorithm>
+#include <stdexcept>
+
 #include "defs.hpp"
 #include "tools/array_view.hpp"
 #include "tools/array_2d.hpp"
@@ -16,6 +19,18 @@ class tracing_data;
  */
 struct similarity_data
 {
+    /**
+     * A range of timestamps [begin, end] (inclusive) for which a pair
+     * has feature vectors. The feature vector at `begin` is stored
+     * at index `row` in pair_data::features.
+     */
+    struct segment
+    {
+        i64 begin;
+        i64 end;
+        i64 row;
+    };
+
     /**
      * Stores feature vectors for a single pair.
      */
@@ -31,26 +46,63 @@ struct similarity_data
          * (a and b are the devices of the current pair).
          */
         array_2d<double> features;
+        /**
+         * The timestamp ranges covered by the rows in \p features, sorted by time.
+         * An empty vector means that the pair is dense, i.e. there is a row
+         * for every timestamp between begin_timestamp and end_timestamp.
+         */
+        vector<segment> segments;
     };
 
     /**
-     * Returns the feature vector for the given pair at the given timestamp.
+     * Returns the row index of the feature vector for the given pair at the given timestamp,
+     * or -1 if no feature vector was computed for that timestamp.
      */
-    array_view<double> feature_at(pair_data &pair, i64 timestamp) const
+    i64 row_at(const pair_data &pair, i64 timestamp) const
     {
         assert(timestamp >= begin_timestamp && timestamp <= end_timestamp
                && "Timestamp in range");
-        return pair.features.row(timestamp - begin_timestamp);
+        if (pair.segments.empty()) {
+            return timestamp - begin_timestamp;
+        }
+
+        auto iter = std::upper_bound(pair.segments.begin(), pair.segments.end(), timestamp,
+                                     [](i64 ts, const segment &s) { return ts < s.begin; });
+        if (iter == pair.segments.begin()) {
+            return -1;
+        }
+        --iter;
+        return timestamp <= iter->end ? iter->row + (timestamp - iter->begin) : -1;
+    }
+
+    /**
+     * Returns true iff the given pair has a feature vector at the given timestamp.
+     */
+    bool has_feature_at(const pair_data &pair, i64 timestamp) const
+    {
+        return row_at(pair, timestamp) != -1;
+    }
+
+    /**
+     * Returns the feature vector for the given pair at the given timestamp.
+     * The pair must have a feature vector at that timestamp.
+     */
+    array_view<double> feature_at(pair_data &pair, i64 timestamp) const
+    {
+        i64 row = row_at(pair, timestamp);
+        assert(row != -1 && "Pair has a feature vector at timestamp");
+        return pair.features.row(row);
     }
 
     /**
      * Returns the feature vector for the given pair at the given timestamp.
+     * The pair must have a feature vector at that timestamp.
      */
     array_view<const double> feature_at(const pair_data &pair, i64 timestamp) const
     {
-        assert(timestamp >= begin_timestamp && timestamp <= end_timestamp
-               && "Timestamp in range");
-        return pair.features.row(timestamp - begin_timestamp);
+        i64 row = row_at(pair, timestamp);
+        assert(row != -1 && "Pair has a feature vector at timestamp");
+        return pair.features.row(row);
     }
 
     i64 begin_timestamp;        ///< The first timestamp of the data.
@@ -61,6 +113,22 @@ struct similarity_data
     vector<pair_data> pairs;    ///< One entry for every pair.
 };
 
+/**
+ * A device pair whose feature vectors should only be computed
+ * in some time ranges, e.g. because the devices could not have been
+ * close to each other at any other time.
+ */
+struct candidate_pair
+{
+    i32 left;   ///< Index into tracing_data::devices.
+    i32 right;  ///< Same.
+    /**
+     * Timestamp ranges [begin, end] (both inclusive).
+     * Must be sorted and must not overlap.
+     */
+    vector<tuple<i64, i64>> ranges;
+};
+
 /**
  * This class produces similarity_data.
  *
@@ -123,35 +191,170 @@ struct feature_computation
      * Uses the dtw algorithm. \sa feature_computation::compute_euclid.
      */
     similarity_data compute_dtw(const tracing_data &td, const vector<tuple<i32, i32>> &pairs);
+
+    /**
+     * Same as the functions above, but feature vectors are only computed
+     * for the time ranges of every candidate pair.
+     * Pairs whose time ranges do not intersect `[begin_timestamp, end_timestamp]`
+     * are omitted from the result, all others store their features sparsely
+     * (see similarity_data::pair_data::segments).
+     */
+    similarity_data compute_euclid(const tracing_data &td, const vector<candidate_pair> &pairs);
+
+    /**
+     * \sa feature_computation::compute_euclid(const tracing_data &, const vector<candidate_pair> &).
+     */
+    similarity_data compute_multi_dtw(const tracing_data &td, const vector<candidate_pair> &pairs);
+
+    /**
+     * \sa feature_computation::compute_euclid(const tracing_data &, const vector<candidate_pair> &).
+     */
+    similarity_data compute_dtw(const tracing_data &td, const vector<candidate_pair> &pairs);
 };
 
 /**
- * Serialize a pair using the given archive.
+ * Serialize a segment using the given archive.
  *
- * \relates similarity_data::pair_data
+ * \relates similarity_data::segment
  */
 template<typename Archive>
-void serialize(Archive &ar, similarity_data::pair_data &p)
+void serialize(Archive &ar, similarity_data::segment &s)
 {
-    ar(cereal::make_nvp("left", p.left),
-       cereal::make_nvp("right", p.right),
-       cereal::make_nvp("features", p.features));
+    ar(cereal::make_nvp("begin", s.begin),
+       cereal::make_nvp("end", s.end),
+       cereal::make_nvp("row", s.row));
 }
 
 /**
- * Serialize similarity data using the given archive.
+ * The version of the serialization format of similarity data.
  *
- * \relates similarity_data
+ * - Version 0 (data written before the format had a version)
+ *   stored a dense feature matrix for every pair, i.e. pairs had no segments.
+ * - Version 1 stores the segments of every pair.
+ *
+ * The version itself is not part of the serialized similarity data,
+ * it must be stored by the surrounding file format.
  */
+constexpr u32 similarity_data_version = 1;
+
+namespace detail {
+
+// Serializes everything but the pairs.
+// Binary archives store the pairs right after the header (their count,
+// followed by every pair), which allows readers to load one pair at a time.
 template<typename Archive>
-void serialize(Archive &ar, similarity_data &sim)
+void serialize_header(Archive &ar, similarity_data &sim)
 {
     ar(cereal::make_nvp("begin_timestamp", sim.begin_timestamp),
        cereal::make_nvp("end_timestamp", sim.end_timestamp),
        cereal::make_nvp("duration", sim.duration),
        cereal::make_nvp("feature_dimension", sim.feature_dimension),
-       cereal::make_nvp("devices", sim.devices),
-       cereal::make_nvp("pairs", sim.pairs));
+       cereal::make_nvp("devices", sim.devices));
+}
+
+// Serializes a pair in the layout of the given format version.
+struct versioned_pair
+{
+    similarity_data::pair_data &pair;
+    u32 version;
+
+    template<typename Archive>
+    void serialize(Archive &ar)
+    {
+        ar(cereal::make_nvp("left", pair.left),
+           cereal::make_nvp("right", pair.right),
+           cereal::make_nvp("features", pair.features));
+        if (version >= 1) {
+            ar(cereal::make_nvp("segments", pair.segments));
+        } else {
+            pair.segments.clear();
+        }
+    }
+};
+
+// Serializes a list of pairs in the layout of the given format version.
+struct versioned_pairs
+{
+    vector<similarity_data::pair_data> &pairs;
+    u32 version;
+
+    template<typename Archive>
+    void save(Archive &ar) const
+    {
+        if (version != similarity_data_version) {
+            throw std::logic_error("only the current version of similarity data can be saved");
+        }
+        ar(cereal::make_size_tag(static_cast<cereal::size_type>(pairs.size())));
+        for (auto &pair : pairs) {
+            ar(versioned_pair{pair, version});
+        }
+    }
+
+    template<typename Archive>
+    void load(Archive &ar)
+    {
+        cereal::size_type size;
+        ar(cereal::make_size_tag(size));
+
+        pairs.resize(static_cast<size_t>(size));
+        for (auto &pair : pairs) {
+            ar(versioned_pair{pair, version});
+        }
+    }
+};
+
+// Serializes similarity data in the layout of the given format version.
+struct versioned_similarity_data
+{
+    similarity_data &sim;
+    u32 version;
+
+    template<typename Archive>
+    void serialize(Archive &ar)
+    {
+        serialize_header(ar, sim);
+        ar(cereal::make_nvp("pairs", versioned_pairs{sim.pairs, version}));
+    }
+};
+
+} // namespace detail
+
+/**
+ * Returns an object that serializes the similarity data in the layout of
+ * the given format version (see similarity_data_version), e.g.
+ * `ar(make_nvp("feature_data", versioned(sim, version)))`.
+ * Only the current version can be saved.
+ *
+ * \relates similarity_data
+ */
+inline detail::versioned_similarity_data versioned(similarity_data &sim, u32 version)
+{
+    if (version > similarity_data_version) {
+        throw std::runtime_error("unsupported similarity data version: " + std::to_string(version));
+    }
+    return detail::versioned_similarity_data{sim, version};
+}
+
+/**
+ * Serialize a pair using the given archive (current format version).
+ *
+ * \relates similarity_data::pair_data
+ */
+template<typename Archive>
+void serialize(Archive &ar, similarity_data::pair_data &p)
+{
+    detail::versioned_pair{p, similarity_data_version}.serialize(ar);
+}
+
+/**
+ * Serialize similarity data using the given archive (current format version).
+ *
+ * \relates similarity_data
+ */
+template<typename Archive>
+void serialize(Archive &ar, similarity_data &sim)
+{
+    versioned(sim, similarity_data_version).serialize(ar);
 }
 
 } // namespace mp
@@ -47,6 +47,9 @@ private:
 
 /**
  * Following data stores every detected following-relation for every timestamp.
+ *
+ * The relations of all timestamps are stored in a single array
+ * (compressed sparse row layout), i.e. there is no allocation per timestamp.
  */
 struct following_data
 {
@@ -66,42 +69,39 @@ struct following_data
 
     /**
      * Data for a single timestamp.
-     * Stores a list of co-moving device pairs.
+     * A view of the co-moving device pairs at that timestamp;
+     * only valid as long as the following data is not modified.
      */
     struct timestamp_data
     {
         i64 timestamp = 0;
-        // List of co-moving devices.
-        // Using a vector because the list of pairs
-        // is expected to be quite small.
-        // Could also use a table or hash map approach.
-        vector<pair_data> co_moving;
-
-        timestamp_data() {}
-        timestamp_data(i64 ts, vector<pair_data> cm)
-            : timestamp(ts)
-            , co_moving(std::move(cm))
-        {}
+        array_view<const pair_data> co_moving;
     };
 
     /**
      * Returns the data for the given timestamp.
      */
-    timestamp_data& data_at(i64 timestamp)
+    timestamp_data data_at(i64 timestamp) const
     {
         assert(timestamp >= begin_timestamp && timestamp <= end_timestamp);
         size_t index = static_cast<size_t>(timestamp - begin_timestamp);
-        return timestamps[index];
+        assert(index + 1 < offsets.size() && "Offsets in range");
+
+        timestamp_data data;
+        data.timestamp = timestamp;
+        data.co_moving = array_view<const pair_data>(pairs.data() + offsets[index],
+                                                     pairs.data() + offsets[index + 1]);
+        return data;
     }
 
     /**
-     * Returns the data for the given timestamp.
+     * Removes all pairs and prepares the offsets for `duration` empty timestamps.
+     * The time range and the duration must have been set.
      */
-    const timestamp_data& data_at(i64 timestamp) const
+    void clear()
     {
-        assert(timestamp >= begin_timestamp && timestamp <= end_timestamp);
-        size_t index = static_cast<size_t>(timestamp - begin_timestamp);
-        return timestamps[index];
+        pairs.clear();
+        offsets.assign(static_cast<size_t>(duration) + 1, 0);
     }
 
     i64 begin_timestamp;
@@ -109,10 +109,15 @@ struct following_data
     i64 duration;
     vector<string> devices;
 
-    // For every timestamp,
-    // we store a list of pairs that are
-    // classified as co-moving.
-    vector<timestamp_data> timestamps;
+    /**
+     * The co-moving pairs at timestamp `begin_timestamp + i` are stored in
+     * `pairs[offsets[i] ... offsets[i + 1])`.
+     * Has `duration + 1` entries.
+     */
+    vector<size_t> offsets;
+
+    /// The co-moving pairs of all timestamps.
+    vector<pair_data> pairs;
 };
 
 /**
@@ -120,10 +125,14 @@ struct following_data
  *
  * Returns the detected following and leadership patterns for every timestamp and every
  * device pair.
+ * The co-moving entries of every timestamp are ordered by pair index,
+ * regardless of the number of threads.
+ *
+ * \param threads  The number of threads to use.
  *
  * \relates following_data
  */
-following_data classify(co_moving_classifier &c, const similarity_data &data);
+following_data classify(const co_moving_classifier &c, const similarity_data &data, i32 threads = 1);
 
 /**
  * Save a following_type using the given archive.
@@ -177,20 +186,83 @@ void serialize(Archive &ar, following_data::pair_data &p)
        cereal::make_nvp("type", p.type));
 }
 
-/**
- * Serialize timestamp data using the given archive.
- *
- * \relates following_data::timestamp_data
- */
-template<typename Archive>
-void serialize(Archive &ar, following_data::timestamp_data &t)
+namespace detail {
+
+// The file format stores a list of timestamp objects,
+// each with its own list of co-moving pairs.
+struct following_timestamp
 {
-    ar(cereal::make_nvp("timestamp", t.timestamp),
-       cereal::make_nvp("co_moving", t.co_moving));
-}
+    i64 timestamp = 0;
+    vector<following_data::pair_data> co_moving;
+
+    template<typename Archive>
+    void serialize(Archive &ar)
+    {
+        ar(cereal::make_nvp("timestamp", timestamp),
+           cereal::make_nvp("co_moving", co_moving));
+    }
+};
+
+// Converts between the list of timestamp objects and the flat
+// layout of following_data. A single buffer is reused for all timestamps.
+// Data without offsets (i.e. clear() has never been called) is saved
+// as `duration` empty timestamps.
+struct following_timestamps
+{
+    following_data &data;
+
+    template<typename Archive>
+    void save(Archive &ar) const
+    {
+        const size_t size = static_cast<size_t>(data.duration);
+        assert((data.offsets.empty() || data.offsets.size() == size + 1) && "Offsets match the duration");
+        ar(cereal::make_size_tag(static_cast<cereal::size_type>(size)));
+
+        following_timestamp buffer;
+        for (size_t i = 0; i < size; ++i) {
+            buffer.timestamp = data.begin_timestamp + static_cast<i64>(i);
+            if (data.offsets.empty()) {
+                buffer.co_moving.clear();
+            } else {
+                buffer.co_moving.assign(data.pairs.begin() + data.offsets[i],
+                                        data.pairs.begin() + data.offsets[i + 1]);
+            }
+            ar(buffer);
+        }
+    }
+
+    template<typename Archive>
+    void load(Archive &ar)
+    {
+        cereal::size_type size;
+        ar(cereal::make_size_tag(size));
+        if (size != static_cast<cereal::size_type>(data.duration)) {
+            throw std::runtime_error("number of timestamps does not match the duration");
+        }
+
+        data.pairs.clear();
+        data.offsets.clear();
+        data.offsets.reserve(static_cast<size_t>(size) + 1);
+        data.offsets.push_back(0);
+
+        following_timestamp buffer;
+        for (cereal::size_type i = 0; i < size; ++i) {
+            ar(buffer);
+            if (buffer.timestamp != data.begin_timestamp + static_cast<i64>(i)) {
+                throw std::runtime_error("unexpected timestamp: " + std::to_string(buffer.timestamp));
+            }
+
+            data.pairs.insert(data.pairs.end(), buffer.co_moving.begin(), buffer.co_moving.end());
+            data.offsets.push_back(data.pairs.size());
+        }
+    }
+};
+
+} // namespace detail
 
 /**
  * Serialize following data using the given archive.
+ * The pairs are stored as a list of timestamps.
  *
  * \relates following_data
  */
@@ -201,10 +273,12 @@ void serialize(Archive &ar, following_data &f)
        cereal::make_nvp("end_timestamp", f.end_timestamp),
        cereal::make_nvp("duration", f.duration),
        cereal::make_nvp("devices", f.devices),
-       cereal::make_nvp("timestamps", f.timestamps));
+       cereal::make_nvp("timestamps", detail::following_timestamps{f}));
 
     assert(f.begin_timestamp <= f.end_timestamp);
     assert(f.duration == f.end_timestamp - f.begin_timestamp + 1);
+    assert((f.offsets.empty() || f.offsets.size() == static_cast<size_t>(f.duration) + 1)
+           && "Offsets match the duration");
 }
 
 } // namespace mp
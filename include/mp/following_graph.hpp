@@ -4,6 +4,8 @@
 #include <unordered_map>
 
 #include "defs.hpp"
+#include "device_graph.hpp"
+#include "following_window.hpp"
 #include "serialization.hpp"
 
 #include <boost/graph/adjacency_list.hpp>
@@ -47,6 +49,15 @@ using following_graph = boost::adjacency_list<
  */
 following_graph following_graph_at(const following_data &f, i64 timestamp);
 
+/**
+ * Returns the aggregated following graph of the given window.
+ *
+ * The graph has a vertex for every device and an edge for every
+ * aggregated edge of the window, see following_window.
+ * The result can be used with `detect_leaders()` and `detect_groups()`.
+ */
+following_graph following_graph_at(const following_window &w);
+
 /**
  * Stores the list of leaders for every timestamp.
  */
@@ -93,13 +104,15 @@ struct leader_data
  * Detect leaders in the given graph using the PageRank algorithm.
  *
  * The computation works as follows:
- * - Run the PageRank algorithm over the entire graph
  * - Find the set of connected components in the given graph.
  *   Every such component is considered a group.
  * - For every connected component, find the node with the hightest PageRank value.
  *   This node is classified as a leader of its group.
+ *   PageRank is computed for every component separately, which yields
+ *   the same order as a PageRank over the entire graph (see component_leaders).
  *
- * This function will return the list of these leaders.
+ * This function will return the list of these leaders,
+ * ordered by the smallest vertex of their component.
  */
 vector<string> detect_leaders(const following_graph &g, bool use_weights);
 
@@ -112,11 +125,155 @@ vector<string> detect_leaders(const following_graph &g, bool use_weights);
  */
 vector<vector<string>> detect_groups(const following_graph &g);
 
+/**
+ * Options for `detect_leaders(const following_data &, ...)`.
+ */
+struct leader_detection_options
+{
+    /// Whether to use edge weights in PageRank or not.
+    bool use_weights = true;
+
+    /**
+     * If true, PageRank starts from the ranks of the previous timestamp
+     * instead of the uniform distribution. The graph usually changes very little
+     * from one second to the next, thus only a few iterations are needed.
+     *
+     * The ranks are only computed up to the configured error, therefore
+     * leaders of components whose top ranks are (almost) equal
+     * may differ from the results without warm start.
+     */
+    bool warm_start = false;
+
+    /// The iteration scheme used for PageRank.
+    page_rank_method method = page_rank_method::power;
+
+    /**
+     * The number of threads. The timestamps are split into one contiguous
+     * block per thread. Without warm start, the results do not depend
+     * on the number of threads.
+     */
+    i32 threads = 1;
+
+    /**
+     * The maximum number of edge sets (per thread) whose leaders are remembered.
+     * Timestamps whose edges have been seen before reuse the remembered leaders
+     * without building a graph or running PageRank. 0 disables the cache.
+     */
+    i64 cache_size = 10000;
+};
+
+/**
+ * Statistics collected by `detect_leaders(const following_data &, ...)`.
+ */
+struct leader_detection_stats
+{
+    /// The number of timestamps.
+    i64 timestamps = 0;
+
+    /// The number of timestamps with the same edges as their predecessor.
+    /// The leaders of the predecessor are reused for them.
+    /// The first timestamp of every thread's block is never counted.
+    i64 unchanged = 0;
+
+    /// The total number of PageRank iterations.
+    i64 page_rank_iterations = 0;
+
+    /// The number of (changed) timestamps whose leaders were taken from the cache.
+    /// The cache is looked up `timestamps - unchanged` times.
+    i64 cache_hits = 0;
+};
+
 /**
  * Same as `detect_leaders(following_graph)`, but for all timestamps in `fd`.
+ *
+ * The graphs are not built as following_graph instances; a device_graph
+ * (whose buffers are reused for every timestamp) is used instead.
+ * If the edges at a timestamp are the same as the edges at the previous timestamp,
+ * the previous leaders are reused without running PageRank again.
+ * Otherwise, the edges are looked up in a cache of earlier edge sets (see
+ * `leader_detection_options::cache_size`). The order of the pairs does not matter
+ * for the lookup and lags are only compared if they are used as edge weights.
+ *
+ * \param[out] stats
+ *      Receives statistics about the computation if it is not null.
+ */
+leader_data detect_leaders(const following_data &fd,
+                           const leader_detection_options &options,
+                           leader_detection_stats *stats = nullptr);
+
+/**
+ * Detects leaders in the aggregated following graphs of a sliding window (see following_window).
+ *
+ * The first window ends at `fd.begin_timestamp`, every following window ends
+ * `window.step` seconds after its predecessor. The leaders of a window are reported
+ * for its last timestamp and the following `window.step - 1` timestamps,
+ * thus the result contains an entry for every timestamp in `fd`.
+ * The statistics count windows instead of timestamps.
+ */
+leader_data detect_leaders(const following_data &fd,
+                           const window_options &window,
+                           const leader_detection_options &options,
+                           leader_detection_stats *stats = nullptr);
+
+/**
+ * Same as `detect_leaders(fd, options)` with default options,
+ * except for `use_weights`.
  */
 leader_data detect_leaders(const following_data &fd, bool use_weights);
 
+/**
+ * Stores the groups of devices over a whole recording.
+ *
+ * A group is a connected component of at least two devices in the following graph
+ * of a timestamp (see `detect_groups(const following_graph &)`).
+ * Groups keep their ID over time as long as they exist (see `detect_groups(const following_data &)`).
+ */
+struct group_data
+{
+    /**
+     * A device is a member of a group from `begin` to `end` (inclusive).
+     */
+    struct membership
+    {
+        i32 device = 0;     ///< Index into devices vector.
+        i64 begin = 0;
+        i64 end = 0;
+    };
+
+    struct group
+    {
+        i64 id = 0;
+        i64 begin = 0;      ///< The first timestamp at which the group exists.
+        i64 end = 0;        ///< The last timestamp at which the group exists (inclusive).
+
+        /// Membership intervals, ordered by begin and device.
+        /// A device may join and leave a group multiple times.
+        vector<membership> members;
+    };
+
+    i64 begin_timestamp = 0;
+    i64 end_timestamp = 0;
+    i64 duration = 0;
+    vector<string> devices; // All devices
+    vector<group> groups;   // Ordered by id, groups[i].id == i
+};
+
+/**
+ * Detects the groups at every timestamp in `fd` and tracks them over time.
+ *
+ * The connected components are maintained incrementally from one timestamp to the next:
+ * new edges are merged into the existing components (union-find), the components are
+ * only recomputed if an edge disappears. Timestamps with the same edges
+ * as their predecessor require no work at all.
+ *
+ * Every group of a timestamp inherits the ID of the group of the previous timestamp
+ * with which it shares most members (if that group has not already been
+ * claimed by a group with a larger overlap). Thus, when groups merge, the merged group
+ * keeps the ID of the largest contributor; when a group splits, the largest part keeps the ID.
+ * All other groups receive new IDs.
+ */
+group_data detect_groups(const following_data &fd);
+
 /**
  *  Writes the graph to the given output stream, using the GraphML format.
  */
@@ -234,6 +391,48 @@ void serialize(Archive &ar, leader_data &ld)
        cereal::make_nvp("timestamps", ld.timestamps));
 }
 
+/**
+ * Serialize the membership interval using the given archive.
+ *
+ * \relates group_data::membership
+ */
+template<typename Archive>
+void serialize(Archive &ar, group_data::membership &m)
+{
+    ar(cereal::make_nvp("device", m.device),
+       cereal::make_nvp("begin", m.begin),
+       cereal::make_nvp("end", m.end));
+}
+
+/**
+ * Serialize the group using the given archive.
+ *
+ * \relates group_data::group
+ */
+template<typename Archive>
+void serialize(Archive &ar, group_data::group &g)
+{
+    ar(cereal::make_nvp("id", g.id),
+       cereal::make_nvp("begin", g.begin),
+       cereal::make_nvp("end", g.end),
+       cereal::make_nvp("members", g.members));
+}
+
+/**
+ * Serialize the group data using the given archive.
+ *
+ * \relates group_data
+ */
+template<typename Archive>
+void serialize(Archive &ar, group_data &gd)
+{
+    ar(cereal::make_nvp("begin_timestamp", gd.begin_timestamp),
+       cereal::make_nvp("end_timestamp", gd.end_timestamp),
+       cereal::make_nvp("duration", gd.duration),
+       cereal::make_nvp("devices", gd.devices),
+       cereal::make_nvp("groups", gd.groups));
+}
+
 } // namespace mp
 
 #endif // MP_FOLLOWING_GRAPH_HPP
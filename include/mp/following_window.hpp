@@ -0,0 +1,111 @@
+#ifndef MP_FOLLOWING_WINDOW_HPP
+#define MP_FOLLOWING_WINDOW_HPP
+
+#include <unordered_map>
+
+#include "defs.hpp"
+#include "following_detection.hpp"
+#include "tools/array_view.hpp"
+
+namespace mp {
+
+/**
+ * Parameters of a sliding window over following data.
+ */
+struct window_options
+{
+    /// The number of seconds in a window. Must be greater than zero.
+    i64 size = 60;
+
+    /// The number of seconds between the ends of two consecutive windows.
+    /// Must be greater than zero.
+    i64 step = 10;
+
+    /**
+     * The weight of an edge is multiplied with this factor for every second of its age,
+     * i.e. a relation observed `k` seconds before the end of the window contributes
+     * `decay^k` times its weight. Must be in (0, 1]; 1 means that weights are summed.
+     */
+    double decay = 1.0;
+};
+
+/**
+ * Aggregates the following graphs of all timestamps within a window of time.
+ *
+ * The aggregated graph has the same edges as the graphs returned by following_graph_at()
+ * (see there), but every directed edge appears only once: its weight is the
+ * (decayed) sum of the weights of that edge at all timestamps within the window.
+ * An edge is part of the aggregated graph as long as it appeared at least
+ * once within the window.
+ *
+ * Moving the window forward only adds the edges of the entering timestamps
+ * and subtracts the edges of the leaving timestamps.
+ */
+class following_window
+{
+public:
+    /**
+     * Creates an empty window over the given data.
+     * The following data must outlive the window and must not be modified.
+     *
+     * \param size   The number of seconds in the window. Must be greater than zero.
+     * \param decay  The decay factor per second, see window_options::decay.
+     */
+    following_window(const following_data &fd, i64 size, double decay = 1.0);
+
+    /**
+     * Moves the window so that it covers the timestamps `[timestamp - size + 1, timestamp]`
+     * (clamped to the time range of the following data).
+     *
+     * Moving forward is incremental; moving backwards rebuilds the window.
+     *
+     * \param timestamp must be in range.
+     */
+    void move_to(i64 timestamp);
+
+    /// The first timestamp in the window.
+    i64 begin_timestamp() const { return m_begin; }
+
+    /// The last timestamp in the window (inclusive).
+    /// The window is empty if this is smaller than begin_timestamp().
+    i64 end_timestamp() const { return m_end; }
+
+    /**
+     * The aggregated edges. Every entry is an edge from `left` to `right`
+     * with type `following_type::following`, `lag` is the aggregated weight.
+     * The order of the edges is unspecified.
+     */
+    array_view<const following_data::pair_data> edges() const
+    {
+        return m_edges;
+    }
+
+    const following_data &data() const { return *m_data; }
+
+private:
+    void clear();
+
+    // Adds the edges at `timestamp`, multiplied by `factor` and `sign` (+1 or -1).
+    void add(i64 timestamp, double factor, int sign);
+
+    void add_edge(i32 source, i32 target, double weight, int sign);
+
+private:
+    const following_data *m_data;
+    i64 m_size;
+    double m_decay;
+
+    i64 m_begin = 0;
+    i64 m_end = -1;
+
+    // The aggregated edges and the number of timestamps at which they appeared.
+    vector<following_data::pair_data> m_edges;
+    vector<i64> m_counts;
+
+    // Maps (source, target) to the index of the edge.
+    std::unordered_map<u64, size_t> m_index;
+};
+
+} // namespace mp
+
+#endif // MP_FOLLOWING_WINDOW_HPP
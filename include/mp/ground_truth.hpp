@@ -1,6 +1,9 @@
 #ifndef MP_GROUND_TRUTH_HPP
 #define MP_GROUND_TRUTH_HPP
 
+#include <stdexcept>
+#include <unordered_map>
+
 #include "defs.hpp"
 #include "serialization.hpp"
 
@@ -56,6 +59,129 @@ struct ground_truth
     std::map<i64, vector<device>> timestamps;
 };
 
+/**
+ * A compact representation of the ground truth.
+ *
+ * Instead of storing a list of devices for every single second,
+ * the group memberships of every device are stored as a sorted list
+ * of non-overlapping time intervals.
+ * Device names are interned, i.e. they are only stored once.
+ */
+struct interval_ground_truth
+{
+    /**
+     * A device is a member of the given group (at the given position)
+     * for every timestamp in [begin, end].
+     */
+    struct membership
+    {
+        i64 begin;  ///< First timestamp (inclusive).
+        i64 end;    ///< Last timestamp (inclusive).
+        i32 group;  ///< Same as ground_truth::device::group.
+        i32 order;  ///< Same as ground_truth::device::order.
+    };
+
+    /**
+     * Returns the index of the device with the given name
+     * or -1 if the device is unknown.
+     */
+    i32 device_index(const string &name) const;
+
+    /**
+     * Returns the membership of the device at the given timestamp
+     * or null if the device is not part of any group.
+     * Uses a binary search over the device's intervals.
+     */
+    const membership *membership_at(i32 device, i64 timestamp) const;
+
+    /**
+     * Returns the relation between the two devices at the given timestamp.
+     * \sa ground_truth::relation_at
+     */
+    ground_truth_relation relation_at(i64 timestamp, i32 device_a, i32 device_b) const;
+
+    /**
+     * Same as above, but looks up the devices by name.
+     */
+    ground_truth_relation relation_at(i64 timestamp,
+                                      const string &device_a,
+                                      const string &device_b) const;
+
+    /**
+     * Returns true iff devices a and b are co-moving at the given timestamp.
+     */
+    bool co_moving_at(i64 timestamp, i32 device_a, i32 device_b) const;
+
+    /**
+     * Same as above, but looks up the devices by name.
+     */
+    bool co_moving_at(i64 timestamp, const string &device_a, const string &device_b) const;
+
+    /**
+     * Rebuilds the lookup table for device names.
+     * Must be called after `devices` has been modified.
+     */
+    void update_index();
+
+    i64 begin_timestamp = 0;    ///< First timestamp of any membership.
+    i64 end_timestamp = -1;     ///< Last timestamp of any membership (inclusive).
+
+    vector<string> devices;                     ///< Interned device names.
+    vector<vector<membership>> memberships;     ///< One sorted list for every device.
+
+    std::unordered_map<string, i32> device_ids; ///< Device name => index.
+};
+
+/**
+ * Collects group memberships of devices as time intervals
+ * and produces either representation of the ground truth.
+ *
+ * Memberships of a device may overlap. Just like in ground_truth::relation_at,
+ * the membership with the highest group index wins,
+ * ties are won by the membership that was added last.
+ */
+class ground_truth_builder
+{
+public:
+    /**
+     * The given device is a member of `group` at position `order`
+     * during the time interval [begin, end].
+     */
+    void add(const string &device, i64 begin, i64 end, i32 group, i32 order);
+
+    /**
+     * Expands the memberships into one list of devices per timestamp.
+     * Lists contain the devices in the order in which they were added.
+     */
+    ground_truth to_ground_truth() const;
+
+    /**
+     * Returns the interval representation.
+     */
+    interval_ground_truth to_intervals() const;
+
+private:
+    struct entry
+    {
+        i32 device;
+        i64 begin;
+        i64 end;
+        i32 group;
+        i32 order;
+    };
+
+    vector<string> m_devices;
+    std::unordered_map<string, i32> m_device_ids;
+    vector<entry> m_entries;
+};
+
+/**
+ * Converts the ground truth into its interval representation.
+ *
+ * \relates interval_ground_truth
+ */
+interval_ground_truth make_interval_ground_truth(const ground_truth &gt);
+
 /**
  * Serialize a device using the given archive.
  *
@@ -80,6 +206,71 @@ void serialize(Archive &ar, ground_truth &gt)
     ar(cereal::make_nvp("timestamps", gt.timestamps));
 }
 
+/**
+ * Saves the interval ground truth using the given archive.
+ * The intervals of every device are stored as a flat list of integers
+ * (begin, end, group, order) to keep the output small.
+ *
+ * \relates interval_ground_truth
+ */
+template<typename Archive>
+void save(Archive &ar, const interval_ground_truth &gt)
+{
+    vector<vector<i64>> intervals;
+    intervals.reserve(gt.memberships.size());
+    for (auto &list : gt.memberships) {
+        vector<i64> flat;
+        flat.reserve(list.size() * 4);
+        for (auto &m : list) {
+            flat.push_back(m.begin);
+            flat.push_back(m.end);
+            flat.push_back(m.group);
+            flat.push_back(m.order);
+        }
+        intervals.push_back(std::move(flat));
+    }
+
+    ar(cereal::make_nvp("begin", gt.begin_timestamp),
+       cereal::make_nvp("end", gt.end_timestamp),
+       cereal::make_nvp("devices", gt.devices),
+       cereal::make_nvp("intervals", intervals));
+}
+
+/**
+ * Loads the interval ground truth using the given archive.
+ *
+ * \relates interval_ground_truth
+ */
+template<typename Archive>
+void load(Archive &ar, interval_ground_truth &gt)
+{
+    vector<vector<i64>> intervals;
+    ar(cereal::make_nvp("begin", gt.begin_timestamp),
+       cereal::make_nvp("end", gt.end_timestamp),
+       cereal::make_nvp("devices", gt.devices),
+       cereal::make_nvp("intervals", intervals));
+
+    if (intervals.size() != gt.devices.size()) {
+        throw std::runtime_error("invalid interval ground truth (expected one interval list per device)");
+    }
+
+    gt.memberships.clear();
+    gt.memberships.reserve(intervals.size());
+    for (auto &flat : intervals) {
+        if (flat.size() % 4 != 0) {
+            throw std::runtime_error("invalid interval ground truth (incomplete interval)");
+        }
+
+        vector<interval_ground_truth::membership> list;
+        list.reserve(flat.size() / 4);
+        for (size_t i = 0; i < flat.size(); i += 4) {
+            list.push_back({flat[i], flat[i + 1], i32(flat[i + 2]), i32(flat[i + 3])});
+        }
+        gt.memberships.push_back(std::move(list));
+    }
+    gt.update_index();
+}
+
 } // namespace mp
 
 #endif // MP_GROUND_TRUTH_HPP
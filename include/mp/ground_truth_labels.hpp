@@ -0,0 +1,96 @@
+#ifndef MP_GROUND_TRUTH_LABELS_HPP
+#define MP_GROUND_TRUTH_LABELS_HPP
+
+#include "defs.hpp"
+#include "ground_truth.hpp"
+
+namespace mp {
+
+struct similarity_data;
+
+/**
+ * The ground truth relations of a fixed list of device pairs,
+ * resolved for every timestamp in [begin_timestamp, end_timestamp].
+ *
+ * Every relation is stored as a 2-bit code. The codes of a pair are stored
+ * contiguously in time order, so loops that visit all timestamps of a pair
+ * read them sequentially.
+ */
+struct ground_truth_labels
+{
+    /// The number of relation codes stored in a single word.
+    static const i64 codes_per_word = 32;
+
+    /**
+     * Returns the relation of the pair with the given index at the given timestamp.
+     * The timestamp must be within [begin_timestamp, end_timestamp].
+     */
+    ground_truth_relation relation_at(size_t pair, i64 timestamp) const
+    {
+        assert(pair < num_pairs && "Pair index in range");
+        assert(timestamp >= begin_timestamp && timestamp <= end_timestamp && "Timestamp in range");
+
+        const i64 index = timestamp - begin_timestamp;
+        const u64 word = codes[pair * words_per_pair + size_t(index / codes_per_word)];
+        const u64 code = (word >> (2 * (index % codes_per_word))) & 3;
+        return static_cast<ground_truth_relation>(code);
+    }
+
+    /**
+     * Returns true iff the devices of the pair are co-moving at the given timestamp.
+     */
+    bool co_moving_at(size_t pair, i64 timestamp) const
+    {
+        return relation_at(pair, timestamp) != ground_truth_relation::none;
+    }
+
+    i64 begin_timestamp = 0;    ///< First timestamp (inclusive).
+    i64 end_timestamp = -1;     ///< Last timestamp (inclusive).
+    size_t num_pairs = 0;       ///< The number of pairs.
+    size_t words_per_pair = 0;  ///< The number of words used by every pair.
+
+    /// The relation codes of pair `p` start at `codes[p * words_per_pair]`.
+    vector<u64> codes;
+};
+
+/**
+ * Resolves the relations of the given device pairs for all timestamps
+ * in [begin, end] (inclusive).
+ * Devices are looked up by name in the ground truth; devices that
+ * are not part of the ground truth are never co-moving.
+ *
+ * \param devices   The names of all devices.
+ * \param pairs     Pairs of indices into `devices`.
+ *
+ * \relates ground_truth_labels
+ */
+ground_truth_labels make_ground_truth_labels(const interval_ground_truth &gt,
+                                             const vector<string> &devices,
+                                             const vector<tuple<i32, i32>> &pairs,
+                                             i64 begin, i64 end);
+
+/**
+ * Returns the number of (pair, timestamp) combinations in [begin, end] (inclusive)
+ * at which the devices of the pair are co-moving.
+ * Same as counting the co-moving codes of `make_ground_truth_labels()`
+ * for the same arguments, without materializing the labels.
+ *
+ * \relates ground_truth_labels
+ */
+i64 count_co_moving(const interval_ground_truth &gt,
+                    const vector<string> &devices,
+                    const vector<tuple<i32, i32>> &pairs,
+                    i64 begin, i64 end);
+
+/**
+ * Resolves the relations for all pairs of the similarity data,
+ * in the same order as `data.pairs`.
+ *
+ * \relates ground_truth_labels
+ */
+ground_truth_labels make_ground_truth_labels(const interval_ground_truth &gt,
+                                             const similarity_data &data);
+
+} // namespace mp
+
+#endif // MP_GROUND_TRUTH_LABELS_HPP
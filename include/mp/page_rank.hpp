@@ -30,6 +30,13 @@ void page_rank_step(const Graph &g,
 {
     using rank_type = typename boost::property_traits<RankMap1>::value_type;
 
+    // Sinks distribute their rank evenly. Their share is the same for every vertex.
+    rank_type sink_rank(0);
+    for (auto sink : sinks) {
+        sink_rank += get(from_rank, sink);
+    }
+    sink_rank /= num_vertices(g);
+
     // Iterate over all vertices and their incoming edges.
     for (auto vertex : make_iter_range(vertices(g))) {
         rank_type rank(0);
@@ -47,10 +54,7 @@ void page_rank_step(const Graph &g,
         }
 
         // Treat all "sinks" as incoming edges, too.
-        for (auto sink : sinks) {
-            // Sinks distribute their rank evenly.
-            rank += get(from_rank, sink) / num_vertices(g);
-        }
+        rank += sink_rank;
 
         rank = ((rank_type(1) - damping) / num_vertices(g)) + damping * rank;
         put(to_rank, vertex, rank);
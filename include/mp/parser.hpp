@@ -18,11 +18,52 @@ signal_data parse_signal_data(std::istream &input);
  */
 location_data parse_location_data(std::istream &input);
 
+/**
+ * Parses signal data from the character range [begin, end).
+ * The format is the same as for parse_signal_data(std::istream &),
+ * but tokens are never copied and numbers are converted in place.
+ *
+ * The input is split into `threads` chunks at line boundaries which
+ * are parsed in parallel. The result does not depend on the number of threads.
+ */
+signal_data parse_signal_data(const char *begin, const char *end, i32 threads = 1);
+
+/**
+ * Parses the signal data file at the given path.
+ * The file is mapped into memory and then parsed in place,
+ * which is a lot faster than parsing from a stream.
+ *
+ * \sa parse_signal_data(const char *, const char *, i32)
+ */
+signal_data parse_signal_file(const string &path, i32 threads = 1);
+
+/**
+ * Parses location data from the character range [begin, end).
+ * Only the timestamp, device, lat, lng and alt columns are parsed,
+ * all other fields of location_data::measurement are set to zero.
+ *
+ * \sa parse_signal_data(const char *, const char *, i32)
+ */
+location_data parse_location_data(const char *begin, const char *end, i32 threads = 1);
+
+/**
+ * Parses the location data file at the given path.
+ * \sa parse_location_data(const char *, const char *, i32)
+ * \sa parse_signal_file(const string &, i32)
+ */
+location_data parse_location_file(const string &path, i32 threads = 1);
+
 /**
  * Parses ground truth files for scipted scenes.
  */
 ground_truth parse_ground_truth_data(std::istream &input);
 
+/**
+ * Parses ground truth files for scripted scenes
+ * and returns the interval representation.
+ */
+interval_ground_truth parse_ground_truth_intervals(std::istream &input);
+
 /**
  * Parses game signal strength data files.
  * This needs to be a class because a game experiment
@@ -31,6 +72,18 @@ ground_truth parse_ground_truth_data(std::istream &input);
  */
 class game_signal_data_parser
 {
+public:
+    /**
+     * The result of parsing a single file.
+     * Access point ids are local to this object.
+     */
+    struct partial_result
+    {
+        string device_id;
+        vector<string> bssids;                      ///< Access points seen in this file.
+        vector<signal_data::measurement> data;      ///< Indices into \p bssids.
+    };
+
 public:
     /**
      * Parse signal data from `input` into the result.
@@ -38,6 +91,21 @@ public:
      */
     void parse(const string &device_id, std::istream &input);
 
+    /**
+     * Parses the signal data in `input` without modifying the parser.
+     * Multiple files can be parsed concurrently by calling this function
+     * from different threads. Use `merge()` to add the results.
+     */
+    partial_result parse_partial(const string &device_id, std::istream &input) const;
+
+    /**
+     * Adds a partial result to the parser.
+     * Access point and device indices are assigned in merge order,
+     * thus merging results in the same order as the files would have been
+     * passed to `parse()` produces the same result.
+     */
+    void merge(partial_result &&partial);
+
     /**
      * Returns the signal_data instance that contains
      * all parsed data (up to this point).
@@ -79,12 +147,43 @@ public:
                              i64 timestamp_begin,
                              i64 timestamp_end);
 
+    /**
+     * The result of parsing a single file.
+     */
+    struct partial_result
+    {
+        string device_id;
+        bool is_evader = false;
+
+        /**
+         * Time ranges [begin, end] (inclusive) and the id of the evader
+         * followed during that time, or -1 if the device did not follow anyone.
+         */
+        vector<tuple<i64, i64, i32>> segments;
+    };
+
+public:
     /**
      * Parse ground truth data from the given input stream.
      * The data must belong to the device called "device_id".
      */
     void parse(const string &device_id, std::istream &input);
 
+    /**
+     * Parses the ground truth data in `input` without modifying the parser.
+     * Multiple files can be parsed concurrently by calling this function
+     * from different threads. Use `merge()` to add the results.
+     */
+    partial_result parse_partial(const string &device_id, std::istream &input) const;
+
+    /**
+     * Adds a partial result to the parser.
+     * Group ids for devices that move alone are assigned in merge order,
+     * thus merging results in the same order as the files would have been
+     * passed to `parse()` produces the same result.
+     */
+    void merge(partial_result &&partial);
+
     /**
      * Returns the ground truth data that contains all parsed
      * information up to this point.
@@ -92,6 +191,11 @@ public:
      */
     ground_truth take();
 
+    /**
+     * Same as `take()`, but returns the interval representation.
+     */
+    interval_ground_truth take_intervals();
+
 private:
     using evader_set = std::unordered_set<i32>;
 
@@ -101,7 +205,7 @@ private:
     i32 m_next_id;
     i64 m_begin;
     i64 m_end;
-    ground_truth m_gt;
+    ground_truth_builder m_gt;
 };
 
 } // namespace mp
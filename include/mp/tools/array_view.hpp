@@ -1,6 +1,7 @@
 #ifndef MP_TOOLS_ARRAY_VIEW_HPP
 #define MP_TOOLS_ARRAY_VIEW_HPP
 
+#include <stdexcept>
 #include <type_traits>
 
 #include "../defs.hpp"
@@ -0,0 +1,116 @@
+#ifndef MP_TOOLS_PARALLEL_HPP
+#define MP_TOOLS_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+
+#include "../defs.hpp"
+
+namespace mp {
+
+// Calls func(i) for every i in [0, n) using up to "threads" threads.
+// The index range is split into contiguous blocks of (approx.) equal size,
+// the last block is executed by the calling thread.
+// If any invocation throws, the first exception (by block index) is rethrown
+// after all threads have finished.
+template<typename Function>
+void parallel_for(i32 threads, size_t n, Function &&func)
+{
+    if (n == 0) {
+        return;
+    }
+
+    const size_t threads_used = std::max(size_t(1), std::min(size_t(std::max(threads, 1)), n));
+    if (threads_used == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    vector<std::exception_ptr> errors(threads_used);
+    auto thread_func = [&](size_t block, size_t begin, size_t end) {
+        try {
+            for (size_t i = begin; i < end; ++i) {
+                func(i);
+            }
+        } catch (...) {
+            errors[block] = std::current_exception();
+        }
+    };
+
+    const size_t chunk_size = n / threads_used;
+    const size_t remainder = n % threads_used;
+
+    vector<std::thread> workers;
+    workers.reserve(threads_used - 1);
+
+    size_t offset = 0;
+    for (size_t block = 0; block < threads_used; ++block) {
+        // The first "remainder" blocks get one additional index.
+        size_t end = offset + chunk_size + (block < remainder ? 1 : 0);
+        if (block + 1 < threads_used) {
+            workers.emplace_back(thread_func, block, offset, end);
+        } else {
+            thread_func(block, offset, end);
+        }
+        offset = end;
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    for (auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+// Same as parallel_for(), but indices are handed out one at a time
+// to the next idle thread. Use this if the cost of func(i) varies a lot,
+// e.g. when every index corresponds to a file.
+// If any invocation throws, the exception with the lowest index is rethrown
+// after all threads have finished.
+template<typename Function>
+void parallel_for_dynamic(i32 threads, size_t n, Function &&func)
+{
+    if (n == 0) {
+        return;
+    }
+
+    const size_t threads_used = std::max(size_t(1), std::min(size_t(std::max(threads, 1)), n));
+    vector<std::exception_ptr> errors(n);
+    std::atomic<size_t> next(0);
+    auto thread_func = [&]() {
+        for (size_t i = next++; i < n; i = next++) {
+            try {
+                func(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    vector<std::thread> workers;
+    workers.reserve(threads_used - 1);
+    for (size_t t = 0; t + 1 < threads_used; ++t) {
+        workers.emplace_back(thread_func);
+    }
+    thread_func();
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    for (auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+} // namespace mp
+
+#endif // MP_TOOLS_PARALLEL_HPP
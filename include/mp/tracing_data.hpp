@@ -1,6 +1,8 @@
 #ifndef MP_TRACING_DATA_HPP
 #define MP_TRACING_DATA_HPP
 
+#include <algorithm>
+
 #include "defs.hpp"
 #include "tools/array_2d.hpp"
 
@@ -11,7 +13,11 @@ class location_data;
 
 /**
  * Tracing data is an abstraction over both signal data and location data.
- * For every device, it stores a matrix with "duration" rows and "data_dimension" columns.
+ * For every device, it stores a matrix with "data_dimension" columns and
+ * one row for every second in the device's active span, i.e. the time between
+ * its first and its last measurement.
+ * Before its first measurement, a device has no data (see device_data::padding);
+ * after its last measurement, it is assumed to stay where it was last seen.
  * Every row contains the tracing data (either location or signal data) for a second
  * in the source data.
  */
@@ -25,7 +31,7 @@ struct tracing_data
         string name; ///< unique device name.
 
         /**
-         * One row for every time step,
+         * One row for every time step in [begin_timestamp, end_timestamp],
          * Number of columns == data_dimension.
          */
         array_2d<double> data;
@@ -41,6 +47,25 @@ struct tracing_data
          // Note that i use chars because array_2d interally uses a vector
          // and vector<bool> is completely broken.
         array_2d<char> has_data;
+
+        i64 begin_timestamp = 0;    ///< Timestamp of the first measurement (first row).
+        i64 end_timestamp = 0;      ///< Timestamp of the last measurement (last row).
+
+        /**
+         * The data vector (and has_data vector) for all timestamps before begin_timestamp,
+         * i.e. the default values used when no measurement is available
+         * (the default signal strength or zeros for location data).
+         * The entries of `padding_has_data` are 0 for signal data and 1 for
+         * location data (location rows always report data, see `has_data`).
+         */
+        vector<double> padding;
+        vector<char>   padding_has_data;
+
+        /**
+         * Returns true iff the device has no measurements at all.
+         * The span of an empty device is meaningless.
+         */
+        bool empty() const { return data.rows() == 0; }
     };
 
     /**
@@ -59,22 +84,24 @@ struct tracing_data
 
     /**
      * Returns the data vector for the given device and timestamp.
+     * Timestamps before the device's active span return the padding vector,
+     * timestamps after its span return the last row
+     * (the device is assumed to stay where it was last seen).
      */
     array_view<double> data_at(device_data &device, i64 timestamp) const
     {
-        assert(timestamp >= min_timestamp && timestamp <= max_timestamp
-               && "Timestamp in range");
-        return device.data.row(timestamp - min_timestamp);
+        i64 row = row_index(device, timestamp);
+        return row == -1 ? array_view<double>(device.padding) : device.data.row(row);
     }
 
     /**
      * Returns the data vector for the given device and timestamp.
+     * \sa tracing_data::data_at(device_data &, i64)
      */
     array_view<const double> data_at(const device_data &device, i64 timestamp) const
     {
-        assert(timestamp >= min_timestamp && timestamp <= max_timestamp
-               && "Timestamp in range");
-        return device.data.row(timestamp - min_timestamp);
+        i64 row = row_index(device, timestamp);
+        return row == -1 ? array_view<const double>(device.padding) : device.data.row(row);
     }
 
     /**
@@ -83,9 +110,8 @@ struct tracing_data
      */
     array_view<char> has_data_at(device_data &device, i64 timestamp)
     {
-        assert(timestamp >= min_timestamp && timestamp <= max_timestamp
-               && "Timestamp in range");
-        return device.has_data.row(timestamp - min_timestamp);
+        i64 row = row_index(device, timestamp);
+        return row == -1 ? array_view<char>(device.padding_has_data) : device.has_data.row(row);
     }
 
     /**
@@ -93,10 +119,32 @@ struct tracing_data
      * \sa tracing_data::device_data.has_data for more information.
      */
     array_view<const char> has_data_at(const device_data &device, i64 timestamp) const
+    {
+        i64 row = row_index(device, timestamp);
+        return row == -1 ? array_view<const char>(device.padding_has_data) : device.has_data.row(row);
+    }
+
+    /**
+     * Returns the row that contains the data for the given device and timestamp,
+     * or -1 if the device has no data at that timestamp, i.e. if the timestamp
+     * is before the device's active span or if the device is empty.
+     * Timestamps after the span return the last row.
+     */
+    i64 row_index(const device_data &device, i64 timestamp) const
     {
         assert(timestamp >= min_timestamp && timestamp <= max_timestamp
                && "Timestamp in range");
-        return device.has_data.row(timestamp - min_timestamp);
+        assert(device.end_timestamp - device.begin_timestamp + 1 == i64(device.data.rows())
+               && "Span matches the number of rows");
+
+        if (device.empty() || timestamp < device.begin_timestamp) {
+            assert(device.padding.size() == size_t(data_dimension)
+                   && device.padding_has_data.size() == size_t(data_dimension)
+                   && "Padding matches the data dimension");
+            return -1;
+        }
+        timestamp = std::min(timestamp, device.end_timestamp);
+        return timestamp - device.begin_timestamp;
     }
 
     /**
@@ -129,6 +177,15 @@ struct tracing_data
  */
 tracing_data transform(const signal_data &sd, i32 default_signal_strength);
 
+/**
+ * Same as the function above, but all measurements outside
+ * of [begin, end] (inclusive) are ignored.
+ *
+ * \relates tracing_data
+ */
+tracing_data transform(const signal_data &sd, i32 default_signal_strength,
+                       i64 begin, i64 end);
+
 /**
  * Does the same as the function above, but for location data.
  *
@@ -137,10 +194,19 @@ tracing_data transform(const signal_data &sd, i32 default_signal_strength);
  */
 tracing_data transform(const location_data &ld);
 
+/**
+ * Same as the function above, but all measurements outside
+ * of [begin, end] (inclusive) are ignored.
+ *
+ * \relates tracing_data
+ */
+tracing_data transform(const location_data &ld, i64 begin, i64 end);
+
 /**
  * Replaces the values at all timestamps and all
  * columns with their moving average at that point.
  * The moving average will be separately computed for every column.
+ * Timestamps before a device's active span contribute its padding values.
  *
  * `n` is the number of values that are considered for each
  * average calculation (and must be positive).
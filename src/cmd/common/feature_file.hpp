@@ -1,6 +1,8 @@
 #ifndef COMMON_FEATURE_FILE_HPP
 #define COMMON_FEATURE_FILE_HPP
 
+#include <memory>
+
 #include <cereal/archives/json.hpp>
 #include <cereal/archives/portable_binary.hpp>
 
@@ -67,28 +69,144 @@ void serialize(Archive &ar, feature_parameters &p)
     assert(p.time_lag >= 0);
 }
 
+// Feature files start with this marker, followed by the version of the
+// similarity data format (see mp::similarity_data_version).
+// Files written before the format had a version start with the parameters,
+// they are treated as version 0.
+static const char feature_file_marker[] = "mp-feature-file";
+
 // Save a feature file (feature vectors, ground truth and parameters).
 template<typename Archive>
 void save_feature_file(Archive &ar,
                        const mp::similarity_data &sim,
                        const feature_parameters &p)
 {
-    ar(cereal::make_nvp("params", p),
+    ar(cereal::make_nvp("format", std::string(feature_file_marker)),
+       cereal::make_nvp("version", mp::similarity_data_version),
+       cereal::make_nvp("params", p),
        cereal::make_nvp("feature_data", sim));
 }
 
-// Load a feature file.
+// Returns the version of the json feature file read by "ar".
+inline mp::u32 read_feature_file_version(cereal::JSONInputArchive &ar)
+{
+    std::string marker;
+    try {
+        ar(cereal::make_nvp("format", marker));
+    } catch (const cereal::Exception &) {
+        // No marker, the file is older than the version.
+        return 0;
+    }
+    if (marker != feature_file_marker) {
+        throw std::runtime_error("not a feature file: \"" + marker + "\"");
+    }
+
+    mp::u32 version;
+    ar(cereal::make_nvp("version", version));
+    return version;
+}
+
+// Returns the version of the binary feature file in "in".
+// The stream is reset to its current position afterwards.
+inline mp::u32 read_feature_file_version(std::istream &in)
+{
+    const auto start = in.tellg();
+
+    // The first string is either the marker or the data source of an old file.
+    std::string marker;
+    mp::u32 version = 0;
+    {
+        cereal::PortableBinaryInputArchive ar(in);
+        ar(marker);
+        if (marker == feature_file_marker) {
+            ar(version);
+        }
+    }
+
+    in.clear();
+    in.seekg(start);
+    return version;
+}
+
+// Reads the marker, version and parameters at the start of a feature file.
+// "version" must be the version of the file (see read_feature_file_version()).
+template<typename Archive>
+void load_feature_file_prefix(Archive &ar, feature_parameters &p, mp::u32 version)
+{
+    if (version > 0) {
+        std::string marker;
+        mp::u32 file_version;
+        ar(cereal::make_nvp("format", marker),
+           cereal::make_nvp("version", file_version));
+        if (marker != feature_file_marker || file_version != version) {
+            throw std::runtime_error("feature file version mismatch");
+        }
+    }
+    ar(cereal::make_nvp("params", p));
+}
+
+// Throws if the similarity data's header is inconsistent
+// or does not match the feature parameters.
+inline void check_feature_header(const mp::similarity_data &sim,
+                                 const feature_parameters &p)
+{
+    if (p.window_size <= 0 || p.time_lag < 0) {
+        throw std::runtime_error("invalid feature parameters");
+    }
+    if (sim.begin_timestamp > sim.end_timestamp
+            || sim.duration != sim.end_timestamp - sim.begin_timestamp + 1) {
+        throw std::runtime_error("invalid time range in feature file");
+    }
+    if (sim.feature_dimension != p.time_lag * 2 + 1) {
+        throw std::runtime_error("feature dimension does not match the time lag");
+    }
+}
+
+// Throws if the pair does not fit the header of its feature file.
+inline void check_feature_pair(const mp::similarity_data &header,
+                               const mp::similarity_data::pair_data &pair)
+{
+    const mp::i32 devices = static_cast<mp::i32>(header.devices.size());
+    if (pair.left < 0 || pair.left >= devices
+            || pair.right < 0 || pair.right >= devices) {
+        throw std::runtime_error("invalid device index in feature file");
+    }
+    if (pair.features.columns() != static_cast<size_t>(header.feature_dimension)) {
+        throw std::runtime_error("invalid feature vector size in feature file");
+    }
+
+    if (pair.segments.empty()) {
+        if (pair.features.rows() != static_cast<size_t>(header.duration)) {
+            throw std::runtime_error("invalid number of feature vectors in feature file");
+        }
+        return;
+    }
+
+    mp::i64 last_end = header.begin_timestamp - 1;
+    for (const auto &s : pair.segments) {
+        if (s.begin <= last_end || s.begin > s.end || s.end > header.end_timestamp
+                || s.row < 0
+                || s.row + (s.end - s.begin + 1) > static_cast<mp::i64>(pair.features.rows())) {
+            throw std::runtime_error("invalid segment in feature file");
+        }
+        last_end = s.end;
+    }
+}
+
+// Load a feature file of the given version.
 template<typename Archive>
 void load_feature_file(Archive &ar,
                        mp::similarity_data &sim,
-                       feature_parameters &p)
+                       feature_parameters &p,
+                       mp::u32 version)
 {
-    ar(cereal::make_nvp("params", p),
-       cereal::make_nvp("feature_data", sim));
+    load_feature_file_prefix(ar, p, version);
+    ar(cereal::make_nvp("feature_data", mp::versioned(sim, version)));
 
-    assert(sim.begin_timestamp <= sim.end_timestamp);
-    assert(sim.duration == sim.end_timestamp - sim.begin_timestamp + 1);
-    assert(sim.feature_dimension == p.time_lag * 2 + 1);
+    check_feature_header(sim, p);
+    for (const auto &pair : sim.pairs) {
+        check_feature_pair(sim, pair);
+    }
 }
 
 inline void read_feature_file(const std::string &path,
@@ -106,15 +224,66 @@ inline void read_feature_file(const std::string &path,
 
     if (type == "json") {
         cereal::JSONInputArchive ar(in_stream);
-        load_feature_file(ar, sim, params);
+        load_feature_file(ar, sim, params, read_feature_file_version(ar));
     } else if (type == "binary") {
+        const mp::u32 version = read_feature_file_version(in_stream);
         cereal::PortableBinaryInputArchive ar(in_stream);
-        load_feature_file(ar, sim, params);
+        load_feature_file(ar, sim, params, version);
     } else {
         throw std::logic_error("unsupported input type: " + type);
     }
 }
 
+// Reads a binary feature file one pair at a time.
+// The header (parameters, devices and time range) is read by the constructor,
+// pairs are read by calling next().
+// Throws std::runtime_error if the file is malformed.
+class binary_feature_stream
+{
+public:
+    explicit binary_feature_stream(const std::string &path)
+    {
+        try_open(m_stream, path, std::ios_base::in | std::ios_base::binary);
+        m_version = read_feature_file_version(m_stream);
+        if (m_version > mp::similarity_data_version) {
+            throw std::runtime_error("unsupported feature file version: " + std::to_string(m_version));
+        }
+        m_archive.reset(new cereal::PortableBinaryInputArchive(m_stream));
+
+        auto &ar = *m_archive;
+        load_feature_file_prefix(ar, m_params, m_version);
+        mp::detail::serialize_header(ar, m_header);
+        ar(cereal::make_size_tag(m_remaining));
+
+        check_feature_header(m_header, m_params);
+    }
+
+    const feature_parameters& params() const { return m_params; }
+
+    // Similarity data without any pairs.
+    const mp::similarity_data& header() const { return m_header; }
+
+    // Reads the next pair. Returns false if there are no more pairs.
+    bool next(mp::similarity_data::pair_data &pair)
+    {
+        if (m_remaining == 0) {
+            return false;
+        }
+        (*m_archive)(mp::detail::versioned_pair{pair, m_version});
+        check_feature_pair(m_header, pair);
+        --m_remaining;
+        return true;
+    }
+
+private:
+    std::fstream m_stream;
+    std::unique_ptr<cereal::PortableBinaryInputArchive> m_archive;
+    mp::u32 m_version = 0;
+    feature_parameters m_params;
+    mp::similarity_data m_header;
+    cereal::size_type m_remaining = 0;
+};
+
 inline void write_feature_file(const std::string &path, const std::string &type,
                                const mp::similarity_data &sim,
                                const feature_parameters &params)
@@ -1,15 +1,26 @@
 #ifndef COMMON_GROUND_TRUTH_FILE_HPP
 #define COMMON_GROUND_TRUTH_FILE_HPP
 
+#include <iterator>
+#include <sstream>
 #include <stdexcept>
 #include <unordered_set>
 
+#include <cereal/archives/json.hpp>
+
 #include "mp/ground_truth.hpp"
 
+// Ground truth files store one of these markers as "format",
+// which determines the representation of the ground truth.
+// Files written before the marker existed are recognized by their first key.
+static const char dense_ground_truth_marker[] = "mp-ground-truth";
+static const char interval_ground_truth_marker[] = "mp-interval-ground-truth";
+
 template<typename Archive>
 void save_ground_truth_file(Archive &ar, const mp::ground_truth &gt)
 {
-    ar(cereal::make_nvp("ground_truth", gt));
+    ar(cereal::make_nvp("format", std::string(dense_ground_truth_marker)),
+       cereal::make_nvp("ground_truth", gt));
 }
 
 template<typename Archive>
@@ -18,6 +29,64 @@ void load_ground_truth_file(Archive &ar, mp::ground_truth &gt)
     ar(cereal::make_nvp("ground_truth", gt));
 }
 
+template<typename Archive>
+void save_ground_truth_file(Archive &ar, const mp::interval_ground_truth &gt)
+{
+    ar(cereal::make_nvp("format", std::string(interval_ground_truth_marker)),
+       cereal::make_nvp("interval_ground_truth", gt));
+}
+
+template<typename Archive>
+void load_ground_truth_file(Archive &ar, mp::interval_ground_truth &gt)
+{
+    ar(cereal::make_nvp("interval_ground_truth", gt));
+}
+
+// Returns the format marker of a ground truth file without one,
+// based on the name of the first key.
+inline std::string legacy_ground_truth_format(const std::string &content)
+{
+    std::string key;
+    size_t key_begin = content.find('"');
+    if (key_begin != std::string::npos) {
+        size_t key_end = content.find('"', key_begin + 1);
+        if (key_end != std::string::npos) {
+            key = content.substr(key_begin + 1, key_end - key_begin - 1);
+        }
+    }
+    return key == "ground_truth" ? dense_ground_truth_marker : interval_ground_truth_marker;
+}
+
+// Reads a json ground truth file in either format.
+// Files that store a ground truth entry for every timestamp
+// are converted into the interval representation.
+inline void read_ground_truth_json(std::istream &input, mp::interval_ground_truth &gt)
+{
+    std::string content{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+    const std::string legacy_format = legacy_ground_truth_format(content);
+
+    std::istringstream stream(std::move(content));
+    cereal::JSONInputArchive ar(stream);
+
+    std::string format;
+    try {
+        ar(cereal::make_nvp("format", format));
+    } catch (const cereal::Exception &) {
+        // No marker, the file is older than the marker.
+        format = legacy_format;
+    }
+
+    if (format == dense_ground_truth_marker) {
+        mp::ground_truth dense;
+        load_ground_truth_file(ar, dense);
+        gt = mp::make_interval_ground_truth(dense);
+    } else if (format == interval_ground_truth_marker) {
+        load_ground_truth_file(ar, gt);
+    } else {
+        throw std::runtime_error("unknown ground truth format: \"" + format + "\"");
+    }
+}
+
 // The ground truth object must have the given start, end and list of devices.
 inline void must_match(const mp::ground_truth &gt,
                        mp::i64 start, mp::i64 end,
@@ -51,4 +120,27 @@ inline void must_match(const mp::ground_truth &gt,
     }
 }
 
+// Same as above, for the interval representation.
+inline void must_match(const mp::interval_ground_truth &gt,
+                       mp::i64 start, mp::i64 end,
+                       const mp::vector<mp::string> &targets)
+{
+    if (gt.begin_timestamp > gt.end_timestamp) {
+        throw std::invalid_argument("ground truth is empty");
+    }
+    if (gt.begin_timestamp != start) {
+        throw std::invalid_argument("start timestamp does not match");
+    }
+    if (gt.end_timestamp != end) {
+        throw std::invalid_argument("end timestamp does not match");
+    }
+
+    for (const mp::string &dev : targets) {
+        mp::i32 index = gt.device_index(dev);
+        if (index == -1 || gt.memberships[index].empty()) {
+            throw std::invalid_argument("missing device in ground truth: " + dev);
+        }
+    }
+}
+
 #endif // COMMON_GROUND_TRUTH_FILE_HPP
@@ -0,0 +1,26 @@
+#ifndef COMMON_GROUP_FILE_HPP
+#define COMMON_GROUP_FILE_HPP
+
+#include "mp/following_graph.hpp"
+
+#include "feature_file.hpp"
+
+template<typename Archive>
+void save_group_file(Archive &ar,
+                     const mp::group_data &gd,
+                     const feature_parameters &params)
+{
+    ar(cereal::make_nvp("params", params),
+       cereal::make_nvp("group_data", gd));
+}
+
+template<typename Archive>
+void load_group_file(Archive &ar,
+                     mp::group_data &gd,
+                     feature_parameters &params)
+{
+    ar(cereal::make_nvp("params", params),
+       cereal::make_nvp("group_data", gd));
+}
+
+#endif // COMMON_GROUP_FILE_HPP
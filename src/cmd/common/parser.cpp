@@ -3,11 +3,14 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <thread>
 
 #include <boost/filesystem.hpp>
 
 #include "mp/parser.hpp"
 #include "mp/signal_data.hpp"
+#include "mp/tools/parallel.hpp"
 
 #include "util.hpp"
 
@@ -18,6 +21,46 @@ using namespace std;
 
 namespace {
 
+// Input files are parsed using all available cores,
+// unless "threads" is greater than zero.
+i32 parser_threads(i32 threads = 0)
+{
+    return threads > 0 ? threads : i32(std::max(1u, thread::hardware_concurrency()));
+}
+
+// Opens and parses the file "<dir>/<target><extension>" for every target
+// using a pool of worker threads. "parse_file(target, stream)" is invoked for every file,
+// the results are returned in the order of "targets".
+// Exits on error.
+template<typename Result, typename ParseFile>
+vector<Result> parse_target_files(const vector<string> &targets,
+                                  const string &dir, const char *extension,
+                                  const char *kind, i32 threads,
+                                  ParseFile &&parse_file)
+{
+    vector<Result> results(targets.size());
+    vector<string> errors(targets.size());
+    parallel_for_dynamic(parser_threads(threads), targets.size(), [&](size_t i) {
+        fs::path path = (fs::path(dir) / targets[i]).replace_extension(extension);
+        fstream stream;
+        try {
+            try_open(stream, path.string(), ios_base::in);
+            results[i] = parse_file(targets[i], stream);
+        } catch (const std::exception &e) {
+            errors[i] = string("failed to read ") + kind + " file \""
+                    + path.string() + "\": " + e.what();
+        }
+    });
+
+    for (auto &error : errors) {
+        if (!error.empty()) {
+            cerr << error << endl;
+            exit(1);
+        }
+    }
+    return results;
+}
+
 void average_access_points(const tracing_data &td)
 {
     cout << "Calculating average number of access points "
@@ -27,7 +70,10 @@ void average_access_points(const tracing_data &td)
     i64 total = 0;
     i64 count = 0;
     for (auto &dev : td.devices) {
-        for (i64 ts = td.min_timestamp; ts <= td.max_timestamp; ++ts) {
+        if (dev.empty()) {
+            continue;
+        }
+        for (i64 ts = dev.begin_timestamp; ts <= dev.end_timestamp; ++ts) {
             auto has_data = td.has_data_at(dev, ts);
             total += std::count(has_data.begin(), has_data.end(), 1);
             ++count;
@@ -64,64 +110,87 @@ void clean_access_points(signal_data &sd, double minimum_average)
 tracing_data read_signal_file(const string &path,
                               double minimum_average,
                               i32 missing_reading)
+{
+    return read_signal_file(path, minimum_average, missing_reading,
+                            numeric_limits<i64>::min(), numeric_limits<i64>::max());
+}
 
+tracing_data read_signal_file(const string &path,
+                              double minimum_average,
+                              i32 missing_reading,
+                              i64 begin, i64 end)
 {
     tracing_data trace;
     {
-        fstream signal_stream;
+        signal_data signal;
         try {
-            try_open(signal_stream, path, ios_base::in);
+            signal = parse_signal_file(path, parser_threads());
         } catch (const std::exception &e) {
-            cerr << "failed to open input file \""
+            cerr << "failed to read input file \""
                  << path << "\": "
                  << e.what() << endl;
             exit(1);
         }
 
-        auto signal = parse_signal_data(signal_stream);
         clean_access_points(signal, minimum_average);
-        trace = transform(signal, missing_reading);
+        trace = transform(signal, missing_reading, begin, end);
         average_access_points(trace);
     }
     return trace;
 }
 
 tracing_data read_location_file(const string &path)
+{
+    return read_location_file(path, numeric_limits<i64>::min(), numeric_limits<i64>::max());
+}
+
+tracing_data read_location_file(const string &path, i64 begin, i64 end)
 {
     tracing_data trace;
     {
-        fstream location_stream;
+        location_data loc;
         try {
-            try_open(location_stream, path, ios_base::in);
+            loc = parse_location_file(path, parser_threads());
         } catch (const std::exception &e) {
-            cerr << "failed to open input file \""
+            cerr << "failed to read input file \""
                  << path << "\": "
                  << e.what() << endl;
             exit(1);
         }
 
-        auto loc = parse_location_data(location_stream);
-        trace = transform(loc);
+        trace = transform(loc, begin, end);
     }
     return trace;
 }
 
-ground_truth read_ground_truth_file(const string &path)
+// Opens the ground truth file at "path" and passes the stream to "parse".
+template<typename Result, typename Function>
+static Result parse_ground_truth_file(const string &path, Function &&parse)
 {
-    ground_truth gt;
-    {
-        fstream gt_stream;
-        try {
-            try_open(gt_stream, path, ios_base::in);
-        } catch (const std::exception &e) {
-            cerr << "failed to open ground truth file \""
-                 << path << "\": "
-                 << e.what() << endl;
-            exit(1);
-        }
-        gt = parse_ground_truth_data(gt_stream);
+    fstream gt_stream;
+    try {
+        try_open(gt_stream, path, ios_base::in);
+    } catch (const std::exception &e) {
+        cerr << "failed to open ground truth file \""
+             << path << "\": "
+             << e.what() << endl;
+        exit(1);
     }
-    return gt;
+    return parse(gt_stream);
+}
+
+ground_truth read_ground_truth_file(const string &path)
+{
+    return parse_ground_truth_file<ground_truth>(path, [](istream &input) {
+        return parse_ground_truth_data(input);
+    });
+}
+
+interval_ground_truth read_ground_truth_intervals(const string &path)
+{
+    return parse_ground_truth_file<interval_ground_truth>(path, [](istream &input) {
+        return parse_ground_truth_intervals(input);
+    });
 }
 
 scene_manifest read_scene_manifest(const string &path)
@@ -176,56 +245,73 @@ tracing_data read_game_signal_files(const scene_manifest &sm,
                                     double minimum_average,
                                     i32 missing_reading)
 {
+    return read_game_signal_files(sm, minimum_average, missing_reading,
+                                  numeric_limits<i64>::min(), numeric_limits<i64>::max(), 0);
+}
+
+tracing_data read_game_signal_files(const scene_manifest &sm,
+                                    double minimum_average,
+                                    i32 missing_reading,
+                                    i64 begin, i64 end,
+                                    i32 threads)
+{
+    using partial_result = game_signal_data_parser::partial_result;
+
     const game_scene_data &gd = sm.get_game_scene_data();
 
-    fs::path game_dir(gd.folder);
     game_signal_data_parser p;
-    for (const string &target : sm.targets) {
-        fs::path scan = (game_dir / target).replace_extension(".scanresult.csv");
-        fstream scan_stream;
-        try {
-            try_open(scan_stream, scan.string(), ios_base::in);
-        } catch (const std::exception &e) {
-            cerr << "failed to open scanresult file \""
-                 << scan.string() << "\": "
-                 << e.what() << endl;
-            exit(1);
-        }
-
-        p.parse(target, scan_stream);
+    vector<partial_result> results = parse_target_files<partial_result>(
+                sm.targets, gd.folder, ".scanresult.csv", "scanresult", threads,
+                [&](const string &target, istream &input) {
+        return p.parse_partial(target, input);
+    });
+    for (auto &result : results) {
+        p.merge(std::move(result));
     }
 
     signal_data data = p.take();
     clean_access_points(data, minimum_average);
-    tracing_data td = transform(data, missing_reading);
+    tracing_data td = transform(data, missing_reading, begin, end);
     average_access_points(td);
     return td;
 }
 
 ground_truth read_game_ground_truth(const scene_manifest &sm)
 {
-    const game_scene_data &gd = sm.get_game_scene_data();
+    return read_game_ground_truth(sm, 0);
+}
 
-    ground_truth gt;
-    {
-        fs::path game_dir(gd.folder);
-        game_ground_truth_parser p(gd.evaders, sm.start, sm.end);
-        for (const string &target : sm.targets) {
-            fs::path follow = (game_dir / target).replace_extension(".followevent.csv");
-            fstream follow_stream;
-            try {
-                try_open(follow_stream, follow.string(), ios_base::in);
-            } catch (const std::exception &e) {
-                cerr << "failed to open followevent file \""
-                     << follow.string() << "\": "
-                     << e.what() << endl;
-                exit(1);
-            }
+// Parses all followevent files of the scene and merges them into "p".
+static void parse_game_ground_truth(const scene_manifest &sm, i32 threads,
+                                    game_ground_truth_parser &p)
+{
+    using partial_result = game_ground_truth_parser::partial_result;
 
-            p.parse(target, follow_stream);
-        }
-        gt = p.take();
+    const game_scene_data &gd = sm.get_game_scene_data();
+    vector<partial_result> results = parse_target_files<partial_result>(
+                sm.targets, gd.folder, ".followevent.csv", "followevent", threads,
+                [&](const string &target, istream &input) {
+        return p.parse_partial(target, input);
+    });
+    for (auto &result : results) {
+        p.merge(std::move(result));
     }
-    return gt;
 }
 
+ground_truth read_game_ground_truth(const scene_manifest &sm, i32 threads)
+{
+    const game_scene_data &gd = sm.get_game_scene_data();
+
+    game_ground_truth_parser p(gd.evaders, sm.start, sm.end);
+    parse_game_ground_truth(sm, threads, p);
+    return p.take();
+}
+
+interval_ground_truth read_game_ground_truth_intervals(const scene_manifest &sm, i32 threads)
+{
+    const game_scene_data &gd = sm.get_game_scene_data();
+
+    game_ground_truth_parser p(gd.evaders, sm.start, sm.end);
+    parse_game_ground_truth(sm, threads, p);
+    return p.take_intervals();
+}
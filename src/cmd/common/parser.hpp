@@ -15,18 +15,48 @@ mp::tracing_data read_signal_file(const mp::string &path,
                               double minimum_average,
                               mp::i32 missing_reading);
 
+// Reads a plain signal file, but ignores measurements
+// outside of [begin, end]. Exits on error.
+mp::tracing_data read_signal_file(const mp::string &path,
+                                  double minimum_average,
+                                  mp::i32 missing_reading,
+                                  mp::i64 begin, mp::i64 end);
+
 // Reads a plain location file. Exits on error.
 mp::tracing_data read_location_file(const mp::string &path);
 
+// Reads a plain location file, but ignores measurements
+// outside of [begin, end]. Exits on error.
+mp::tracing_data read_location_file(const mp::string &path, mp::i64 begin, mp::i64 end);
+
 // Reads a plain ground truth file. Exits on error.
 mp::ground_truth read_ground_truth_file(const mp::string &path);
 
+// Reads a plain ground truth file into the interval representation. Exits on error.
+mp::interval_ground_truth read_ground_truth_intervals(const mp::string &path);
+
 // Reads game signal files. Exits on error.
 mp::tracing_data read_game_signal_files(const scene_manifest &gm,
                                          double minimum_average,
                                          mp::i32 missing_reading);
 
+// Reads game signal files, but ignores measurements
+// outside of [begin, end]. The files are parsed by "threads" threads
+// (0 means one per core). Exits on error.
+mp::tracing_data read_game_signal_files(const scene_manifest &gm,
+                                         double minimum_average,
+                                         mp::i32 missing_reading,
+                                         mp::i64 begin, mp::i64 end,
+                                         mp::i32 threads);
+
 // Reads game ground truth files. Exits on error.
 mp::ground_truth read_game_ground_truth(const scene_manifest &gm);
 
+// Reads game ground truth files using "threads" threads
+// (0 means one per core). Exits on error.
+mp::ground_truth read_game_ground_truth(const scene_manifest &gm, mp::i32 threads);
+
+// Same as above, but returns the interval representation.
+mp::interval_ground_truth read_game_ground_truth_intervals(const scene_manifest &gm, mp::i32 threads);
+
 #endif // COMMON_PARSER_HPP
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <thread>
 
 #include <boost/program_options.hpp>
 
@@ -28,6 +30,8 @@ string classifier_file;
 // Path to output file.
 string out_file;
 
+int threads;        // >= 0, 0 -> automatic
+
 int main(int argc, char *argv[]) {
     setlocale(LC_ALL, "C");
     parse_options(argc, argv);
@@ -78,10 +82,14 @@ int main(int argc, char *argv[]) {
          << "  Duration: " << sim.duration << " seconds\n"
          << flush;
 
-    cout << "Computing results..." << endl;
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+
+    cout << "Computing results using " << threads << " threads..." << endl;
     following_data result;
     double seconds = execution_seconds([&]{
-        result = classify(classifier, sim);
+        result = classify(classifier, sim, threads);
     });
     cout << "Computation took " << seconds << " seconds." << endl;
 
@@ -130,6 +138,9 @@ void parse_options(int argc, char *argv[])
              po::value<string>(&out_file)->value_name("PATH")->required(),
              "The outfile file.\n"
              "Detected leadership and following relations will be written to this file.")
+            ("threads",
+             po::value<int>(&threads)->value_name("NUMBER")->default_value(0),
+             "The number of threads. 0 means automatic, greater values specifiy the exact number.")
             ;
 
     po::variables_map vm;
@@ -173,6 +184,10 @@ void validate_options()
         cerr << "input type is invalid (" << in_type << ")" << endl;
         ok = false;
     }
+    if (threads < 0) {
+        cerr << "threads must be greater than or equal to zero (" << threads << ")" << endl;
+        ok = false;
+    }
 
     if (!ok) {
         exit(1);
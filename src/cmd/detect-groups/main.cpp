@@ -0,0 +1,121 @@
+#include <iostream>
+
+#include <boost/program_options.hpp>
+#include <cereal/archives/json.hpp>
+
+#include "mp/following_graph.hpp"
+
+#include "../common/util.hpp"
+#include "../common/follower_file.hpp"
+#include "../common/group_file.hpp"
+
+using namespace mp;
+using namespace std;
+
+void parse_options(int argc, char *argv[]);
+
+string in_file;
+string out_file;
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_ALL, "C");
+    parse_options(argc, argv);
+
+    following_data fd;
+    feature_parameters params;
+
+    {
+        fstream in_stream;
+        try {
+            try_open(in_stream, in_file, ios_base::in);
+        } catch (const std::exception &e) {
+            cerr << "failed to open input file \""
+                 << in_file << "\": "
+                 << e.what() << endl;
+            exit(1);
+        }
+
+        cereal::JSONInputArchive ar(in_stream);
+        load_follower_file(ar, fd, params);
+    }
+
+    cout << "Detecting groups:\n"
+         << "  Source: " << in_file << "\n"
+         << "  Data source: " << params.data_source << "\n"
+         << "  Algorithm: " << params.algorithm << "\n"
+         << "  Time lag: " << params.time_lag << " seconds\n"
+         << "  Window size: " << params.window_size << " seconds\n"
+         << flush;
+
+    group_data gd;
+    double seconds = execution_seconds([&]{
+        gd = detect_groups(fd);
+    });
+
+    size_t memberships = 0;
+    for (const auto &group : gd.groups) {
+        memberships += group.members.size();
+    }
+    cout << "Detection took " << seconds << " seconds" << endl;
+    cout << "Groups: " << gd.groups.size() << "\n"
+         << "Membership intervals: " << memberships << endl;
+
+    {
+        fstream out_stream;
+        try {
+            try_open(out_stream, out_file, ios_base::out);
+        } catch (const std::exception &e) {
+            cerr << "failed to open output file \""
+                 << out_file << "\": "
+                 << e.what() << endl;
+            exit(1);
+        }
+
+        cereal::JSONOutputArchive ar(out_stream);
+        save_group_file(ar, gd, params);
+    }
+    return 0;
+}
+
+void parse_options(int argc, char *argv[])
+{
+    namespace po = boost::program_options;
+
+    po::options_description opts("Options");
+    opts.add_options()
+            ("help,h",
+             "Print this help message")
+            ("input",
+             po::value<string>(&in_file)->value_name("PATH")->required(),
+             "The path to a file generated by the detect-followers program.")
+            ("output",
+             po::value<string>(&out_file)->value_name("PATH")->required(),
+             "The output path. The results will be written to this file.")
+            ;
+
+    po::variables_map vm;
+    try {
+        auto parser = po::command_line_parser(argc, argv);
+        parser.options(opts);
+        po::store(parser.run(), vm);
+
+        if (vm.count("help")) {
+            cerr << "Usage: " << argv[0] << " [options]" << "\n";
+            cerr << "\n";
+            cerr << "This program reads a follower file created by the detect-followers program\n"
+                 << "and detects groups of devices.\n"
+                 << "Groups keep their ID over time; for every group, the intervals\n"
+                 << "in which devices have been members of the group will be produced.\n"
+                 << "The result data will be written to the output file.\n\n"
+                 << flush;
+            cerr << opts << flush;
+            exit(1);
+        }
+
+        po::notify(vm);
+    } catch (const po::error &e) {
+        cerr << e.what() << endl;
+        exit(1);
+    }
+}
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 #include <boost/program_options.hpp>
 #include <cereal/archives/json.hpp>
@@ -19,6 +21,13 @@ void validate_options();
 string in_file;
 string out_file;
 bool use_weights = false;
+bool warm_start = false;
+int threads;        // >= 0, 0 -> automatic
+string method;
+i64 cache_size = 0;     // 0 -> no cache
+i64 window_size = 0;    // 0 -> no window, i.e. every second on its own
+i64 window_step = 0;
+double window_decay = 0;
 
 string gt_file;
 
@@ -46,6 +55,10 @@ int main(int argc, char *argv[])
         load_follower_file(ar, fd, params);
     }
 
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+
     cout << "Detecting leaders:\n"
          << "  Source: " << in_file << "\n"
          << "  Data source: " << params.data_source << "\n"
@@ -53,13 +66,53 @@ int main(int argc, char *argv[])
          << "  Time lag: " << params.time_lag << " seconds\n"
          << "  Window size: " << params.window_size << " seconds\n"
          << "  Edge weights: " << std::boolalpha << use_weights << "\n"
-         << flush;
+         << "  Warm start: " << std::boolalpha << warm_start << "\n"
+         << "  Threads: " << threads << "\n"
+         << "  PageRank method: " << method << "\n"
+         << "  Cache size: " << cache_size << "\n";
+    if (window_size > 0) {
+        cout << "  Aggregation window: " << window_size << " seconds\n"
+             << "  Aggregation step: " << window_step << " seconds\n"
+             << "  Aggregation decay: " << window_decay << "\n";
+    }
+    cout << flush;
+
+    leader_detection_options options;
+    options.use_weights = use_weights;
+    options.warm_start = warm_start;
+    options.threads = threads;
+    options.cache_size = cache_size;
+    if (method == "gauss-seidel") {
+        options.method = page_rank_method::gauss_seidel;
+    } else if (method == "extrapolation") {
+        options.method = page_rank_method::extrapolation;
+    } else {
+        options.method = page_rank_method::power;
+    }
 
     leader_data ld;
+    leader_detection_stats stats;
     double seconds = execution_seconds([&]{
-        ld = detect_leaders(fd, use_weights);
+        if (window_size > 0) {
+            window_options window;
+            window.size = window_size;
+            window.step = window_step;
+            window.decay = window_decay;
+            ld = detect_leaders(fd, window, options, &stats);
+        } else {
+            ld = detect_leaders(fd, options, &stats);
+        }
     });
     cout << "Detection took " << seconds << " seconds" << endl;
+    const i64 lookups = stats.timestamps - stats.unchanged;
+    const i64 computed = lookups - stats.cache_hits;
+    cout << "Unchanged " << (window_size > 0 ? "windows: " : "timestamps: ")
+         << stats.unchanged << " of " << stats.timestamps << "\n"
+         << "Cache hits: " << stats.cache_hits << " of " << lookups << " (hit rate "
+         << (lookups > 0 ? 100.0 * double(stats.cache_hits) / double(lookups) : 0.0) << "%)\n"
+         << "PageRank iterations: " << stats.page_rank_iterations << " (average "
+         << (computed > 0 ? double(stats.page_rank_iterations) / double(computed) : 0.0)
+         << " per computed graph)" << endl;
 
     {
         fstream out_stream;
@@ -95,6 +148,35 @@ void parse_options(int argc, char *argv[])
             ("use-weights",
              po::value<bool>(&use_weights)->default_value(true),
              "Whether to use edge weights in PageRank or not.")
+            ("warm-start",
+             po::value<bool>(&warm_start)->default_value(false),
+             "Whether to start PageRank with the ranks of the previous timestamp. "
+             "Converges faster, but leaders of components with (almost) equal "
+             "top ranks may differ.")
+            ("threads",
+             po::value<int>(&threads)->value_name("NUMBER")->default_value(0),
+             "The number of threads. 0 means automatic, greater values specifiy the exact number.")
+            ("page-rank-method",
+             po::value<string>(&method)->value_name("METHOD")->default_value("power"),
+             "The iteration scheme used for PageRank. "
+             "Possible values are \"power\", \"gauss-seidel\" and \"extrapolation\". "
+             "All of them compute the same ranks, but may need a different number of iterations.")
+            ("cache-size",
+             po::value<i64>(&cache_size)->value_name("NUMBER")->default_value(10000),
+             "The maximum number of edge sets per thread whose leaders are remembered. "
+             "Timestamps with a known edge set reuse its leaders. 0 disables the cache.")
+            ("window-size",
+             po::value<i64>(&window_size)->value_name("SECONDS")->default_value(0),
+             "If greater than zero, leaders are detected in the following graphs aggregated "
+             "over a sliding window of this many seconds instead of every second on its own.")
+            ("window-step",
+             po::value<i64>(&window_step)->value_name("SECONDS")->default_value(10),
+             "The number of seconds between two windows. "
+             "The leaders of a window are reported until the next window ends.")
+            ("window-decay",
+             po::value<double>(&window_decay)->value_name("FACTOR")->default_value(1.0),
+             "Edge weights are multiplied with this factor for every second of their age "
+             "within a window. 1 means that weights are summed up.")
             ;
 
     po::variables_map vm;
@@ -125,5 +207,39 @@ void parse_options(int argc, char *argv[])
 
 void validate_options()
 {
+    auto contains = [](const vector<string> &v, const string &s) {
+        return std::find(v.begin(), v.end(), s) != v.end();
+    };
+
+    static const vector<string> allowed_methods{"power", "gauss-seidel", "extrapolation"};
 
+    bool ok = true;
+    if (threads < 0) {
+        cerr << "threads must be greater than or equal to zero (" << threads << ")" << endl;
+        ok = false;
+    }
+    if (cache_size < 0) {
+        cerr << "cache size must be greater than or equal to zero (" << cache_size << ")" << endl;
+        ok = false;
+    }
+    if (window_size < 0) {
+        cerr << "window size must be greater than or equal to zero (" << window_size << ")" << endl;
+        ok = false;
+    }
+    if (window_step <= 0) {
+        cerr << "window step must be greater than zero (" << window_step << ")" << endl;
+        ok = false;
+    }
+    if (!(window_decay > 0 && window_decay <= 1)) {
+        cerr << "window decay must be in (0, 1] (" << window_decay << ")" << endl;
+        ok = false;
+    }
+    if (!contains(allowed_methods, method)) {
+        cerr << "page rank method is invalid (" << method << ")" << endl;
+        ok = false;
+    }
+
+    if (!ok) {
+        exit(1);
+    }
 }
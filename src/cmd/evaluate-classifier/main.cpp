@@ -200,7 +200,7 @@ vector<binary_classifier_result> evaluate_classifier(co_moving_classifier &c,
         const string &ground_truth_path = in_files[i++];
 
         similarity_data sim;
-        ground_truth gt;
+        interval_ground_truth gt;
         feature_parameters params;
 
         // Read feature file and validate the parameters.
@@ -226,8 +226,7 @@ vector<binary_classifier_result> evaluate_classifier(co_moving_classifier &c,
                 exit(1);
             }
 
-            cereal::JSONInputArchive ar(gt_stream);
-            load_ground_truth_file(ar, gt);
+            read_ground_truth_json(gt_stream, gt);
         }
 
         try {
@@ -246,38 +245,13 @@ vector<binary_classifier_result> evaluate_classifier(co_moving_classifier &c,
              << "  Duration:     " << sim.duration << " seconds\n"
              << flush;
 
-        i64 true_positive = 0;
-        i64 false_positive = 0;
-        i64 false_negative = 0;
-        i64 true_negative = 0;
-
-        for (auto &pair : sim.pairs) {
-            auto &left_name = sim.devices[pair.left];
-            auto &right_name = sim.devices[pair.right];
-
-            for (i64 ts = sim.begin_timestamp; ts <= sim.end_timestamp; ++ts) {
-                bool co_moving = gt.co_moving_at(ts, left_name, right_name);
-                bool predicted = c.co_moving(sim.feature_at(pair, ts));
-
-                if (co_moving) {
-                    if (predicted) {
-                        ++true_positive;
-                    } else {
-                        ++false_negative;
-                    }
-                } else {
-                    if (!predicted) {
-                        ++true_negative;
-                    } else {
-                        ++false_positive;
-                    }
-                }
-            }
-        }
+        // Pairs that were pruned during feature computation still count
+        // (as predicted negatives), see count_classifications().
+        const classification_counts counts = count_classifications(c, sim, gt);
 
         result.push_back(binary_classifier_result(feature_path,
-                                                  true_positive, false_positive,
-                                                  false_negative, true_negative));
+                                                  counts.true_positive, counts.false_positive,
+                                                  counts.false_negative, counts.true_negative));
 
         cout << "\n" << flush;
     }
@@ -15,7 +15,7 @@ using namespace mp;
 
 follower_evaluation_result eval_followers(const string &name,
                                           const following_data &fd,
-                                          const ground_truth &gt);
+                                          const interval_ground_truth &gt);
 void parse_options(int argc, char *argv[]);
 void validate_options();
 
@@ -33,7 +33,7 @@ int main(int argc, char *argv[])
     validate_options();
 
     feature_parameters params;
-    ground_truth gt;
+    interval_ground_truth gt;
     following_data fd;
 
     {
@@ -62,8 +62,7 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
-        cereal::JSONInputArchive ar(gt_stream);
-        load_ground_truth_file(ar, gt);
+        read_ground_truth_json(gt_stream, gt);
     }
 
     cout << "Evaluating follower file:\n"
@@ -102,25 +101,29 @@ int main(int argc, char *argv[])
 
 follower_evaluation_result eval_followers(const string &name,
                                           const following_data &fd,
-                                          const ground_truth &gt)
+                                          const interval_ground_truth &gt)
 {
     i64 correct = 0;
     i64 total = 0;
     i64 total_co_moving = 0;
 
+    // Ground truth index of every device in the following data.
+    vector<i32> device_ids;
+    device_ids.reserve(fd.devices.size());
+    for (const string &dev : fd.devices) {
+        device_ids.push_back(gt.device_index(dev));
+    }
+
     for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
-        auto &data = fd.data_at(ts);
+        auto data = fd.data_at(ts);
 
         i64 ts_correct = 0;
         i64 ts_total = 0;
         i64 ts_total_co_moving = 0;
 
         for (auto &pair : data.co_moving) {
-            const string &left_name = fd.devices[pair.left];
-            const string &right_name = fd.devices[pair.right];
-
             following_type predicted = pair.type;
-            ground_truth_relation real = gt.relation_at(ts, left_name, right_name);
+            ground_truth_relation real = gt.relation_at(ts, device_ids[pair.left], device_ids[pair.right]);
 
             if (real != ground_truth_relation::none) {
                 ++ts_total_co_moving;
@@ -16,7 +16,7 @@ using namespace mp;
 
 binary_classifier_result eval_leaders(const string &name,
                                       const leader_data &fd,
-                                      const ground_truth &gt);
+                                      const interval_ground_truth &gt);
 void parse_options(int argc, char *argv[]);
 void validate_options();
 
@@ -32,7 +32,7 @@ int main(int argc, char *argv[])
     validate_options();
 
     feature_parameters params;
-    ground_truth gt;
+    interval_ground_truth gt;
     leader_data ld;
 
     {
@@ -61,8 +61,7 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
-        cereal::JSONInputArchive ar(gt_stream);
-        load_ground_truth_file(ar, gt);
+        read_ground_truth_json(gt_stream, gt);
     }
 
     cout << "Evaluating leader file:\n"
@@ -100,23 +99,22 @@ int main(int argc, char *argv[])
 }
 
 // A group may have more than one leader.
-unordered_map<i32, vector<string>> gt_leaders_at(const ground_truth &gt, i64 ts)
+unordered_map<i32, vector<string>> gt_leaders_at(const interval_ground_truth &gt, i64 ts)
 {
-    using device = ground_truth::device;
+    using membership = interval_ground_truth::membership;
 
     unordered_map<i32, vector<string>> leaders;
 
-    auto it = gt.timestamps.find(ts);
-    if (it == gt.timestamps.end()) {
+    if (ts < gt.begin_timestamp || ts > gt.end_timestamp) {
         cerr << "Timestamp not in ground truth: " << ts << endl;
         exit(1);
     }
 
-    const vector<device> &devs = it->second;
-    for (const device &dev : devs) {
+    for (size_t dev = 0; dev < gt.devices.size(); ++dev) {
         // Only the leader of a group may have order 0
-        if (dev.order == 0) {
-            leaders[dev.group].push_back(dev.name);
+        const membership *m = gt.membership_at(i32(dev), ts);
+        if (m && m->order == 0) {
+            leaders[m->group].push_back(gt.devices[dev]);
         }
     }
 
@@ -125,7 +123,7 @@ unordered_map<i32, vector<string>> gt_leaders_at(const ground_truth &gt, i64 ts)
 
 binary_classifier_result eval_leaders(const string &name,
                                       const leader_data &ld,
-                                      const ground_truth &gt)
+                                      const interval_ground_truth &gt)
 {
     const i64 num_devices = static_cast<i64>(ld.devices.size());
 
@@ -6,6 +6,7 @@
 
 #include "mp/following_detection.hpp"
 #include "mp/following_graph.hpp"
+#include "mp/following_window.hpp"
 #include "mp/tracing_data.hpp"
 
 #include "../common/util.hpp"
@@ -68,6 +69,9 @@ string manifest_file;
 bool absolute_timestamp = false;
 i64  at_timestamp = 0;
 
+// Aggregate the follower data over this many seconds (ending at the timestamp).
+i64 window_size = 1;
+
 // Path to output file.
 string out_file;
 
@@ -126,6 +130,7 @@ int main(int argc, char *argv[]) {
          << "  Output:           " << out_file << "\n"
          << "  Timestamp (abs.): " << abs_ts << "\n"
          << "  Timestamp (rel.): " << rel_ts << "\n"
+         << "  Window size:      " << window_size << " seconds\n"
          << flush;
 
     if (abs_ts < followers.begin_timestamp || abs_ts > followers.end_timestamp) {
@@ -137,7 +142,14 @@ int main(int argc, char *argv[]) {
     }
 
     // Construct the graph and detect groups + their leaders.
-    following_graph graph = following_graph_at(followers, abs_ts);
+    following_graph graph;
+    if (window_size > 1) {
+        following_window window(followers, window_size);
+        window.move_to(abs_ts);
+        graph = following_graph_at(window);
+    } else {
+        graph = following_graph_at(followers, abs_ts);
+    }
     // Finds the node for the given device or exits.
     auto find_vertex = [&](const string &name) {
         for (auto vertex : make_iter_range(vertices(graph))) {
@@ -159,7 +171,7 @@ int main(int argc, char *argv[]) {
                                [&](const tracing_data::device_data &d) {
             return d.name == name;
         });
-        if (it == td.devices.end()) {
+        if (it == td.devices.end() || it->empty()) {
             cerr << "No coordinates for device " << name << endl;
             exit(1);
         }
@@ -246,6 +258,10 @@ void parse_options(int argc, char *argv[])
             ("absolute",
              po::bool_switch(&absolute_timestamp)->default_value(false),
              "Interpret the timestamp given for --at as absolute instead of relative.")
+            ("window",
+             po::value<i64>(&window_size)->value_name("SECONDS")->default_value(1),
+             "Aggregate the follower data over the given number of seconds, "
+             "ending at the timestamp given for --at. Edge weights are summed up.")
             ("output",
              po::value<string>(&out_file)->value_name("PATH")->required(),
              "The output path. The detected groups will be written to this file.")
@@ -278,5 +294,9 @@ void parse_options(int argc, char *argv[])
 
 void validate_options()
 {
+    if (window_size < 1) {
+        cerr << "window must be at least 1 (" << window_size << ")" << endl;
+        exit(1);
+    }
 }
 
@@ -4,6 +4,7 @@
 
 #include <boost/program_options.hpp>
 
+#include "mp/access_point_index.hpp"
 #include "mp/feature_computation.hpp"
 #include "mp/metrics.hpp"
 #include "mp/tracing_data.hpp"
@@ -22,6 +23,9 @@ void compute_features(const tracing_data &trace,
 
 void clean_devices(tracing_data &trace, const vector<string> &targets);
 
+vector<candidate_pair> prune_pairs(const tracing_data &trace,
+                                   const vector<tuple<i32, i32>> &pairs);
+
 array_2d<double> evaluate_warp_path(const tracing_data &td,
                                     const vector<tuple<i32, i32>> &pairs,
                                     const feature_computation &f);
@@ -58,6 +62,11 @@ int window_size;    // > 0
 int time_lag;       // >= 0
 int threads;        // >= 0, 0 -> automatic
 
+// Candidate pruning using the access point index (signal data only)
+int    min_shared_aps;      // >= 0, 0 -> disabled
+double min_jaccard;         // in [0, 1]
+int    index_block_size;    // > 0
+
 bool disable_target_filter = false;
 int  limit_targets = -1;
 
@@ -71,12 +80,18 @@ int main(int argc, char *argv[])
     tracing_data trace;
     vector<tuple<i32, i32>> pairs; // device pairs to consider
 
+    // Measurements outside of the manifest's time range are not needed,
+    // except for the ones covered by the first and last time windows.
+    const i64 margin = window_size + time_lag;
+    const i64 begin = sm.start - margin;
+    const i64 end = sm.end + margin;
+
     if (sm.scene_type == "plain") {
         const plain_scene_data &p = sm.get_plain_scene_data();
         if (sm.data_type == "signal") {
-            trace = read_signal_file(p.data_file, minimum_signal_average, missing_signal_reading);
+            trace = read_signal_file(p.data_file, minimum_signal_average, missing_signal_reading, begin, end);
         } else if (sm.data_type == "location") {
-            trace = read_location_file(p.data_file);
+            trace = read_location_file(p.data_file, begin, end);
         } else {
             assert(false);
         }
@@ -86,9 +101,9 @@ int main(int argc, char *argv[])
     } else if (sm.scene_type == "game") {
         const game_scene_data &g = sm.get_game_scene_data();
         if (sm.data_type == "signal") {
-            trace = read_game_signal_files(sm, minimum_signal_average, missing_signal_reading);
+            trace = read_game_signal_files(sm, minimum_signal_average, missing_signal_reading, begin, end, threads);
         } else if (sm.data_type == "location") {
-            trace = read_location_file(g.location_file);
+            trace = read_location_file(g.location_file, begin, end);
         } else {
             assert(false);
         }
@@ -114,6 +129,22 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+// Runs the selected algorithm on either device pairs or candidate pairs.
+template<typename Pairs>
+similarity_data compute_similarity(feature_computation &f,
+                                   const tracing_data &trace,
+                                   const Pairs &pairs)
+{
+    if (algorithm == "dtw") {
+        return f.compute_dtw(trace, pairs);
+    } else if (algorithm == "multi-dtw") {
+        return f.compute_multi_dtw(trace, pairs);
+    } else if (algorithm == "euclid") {
+        return f.compute_euclid(trace, pairs);
+    }
+    throw logic_error("unsupported algorithm");
+}
+
 // Compute the feature values and write them to the output file.
 void compute_features(const tracing_data &trace,
                       const scene_manifest &sm,
@@ -133,6 +164,9 @@ void compute_features(const tracing_data &trace,
             << " but measurements already stop at " << trace.max_timestamp << endl;
         throw runtime_error(msg.str());
     }
+    if (min_shared_aps > 0 && sm.data_type != "signal") {
+        throw runtime_error("candidate pruning requires signal data");
+    }
 
     feature_computation f;
     f.time_lag = time_lag;
@@ -161,6 +195,13 @@ void compute_features(const tracing_data &trace,
          << "  Threads:        " << f.threads << "\n"
          << "  Algorithm:      " << algorithm << "\n"
          << flush;
+    if (min_shared_aps > 0) {
+        cout << "Candidate pruning:\n"
+             << "  Shared APs:     " << min_shared_aps << "\n"
+             << "  Jaccard index:  " << min_jaccard << "\n"
+             << "  Block size:     " << index_block_size << " seconds\n"
+             << flush;
+    }
 
     if (algorithm == "eval-dtw") {
         cout << "Running dtw evaluation" << endl;
@@ -173,26 +214,54 @@ void compute_features(const tracing_data &trace,
         cout << "Evaluation took " << seconds << " seconds" << endl;
         write_dtw_frequencies(freqs);
     } else {
-        cout << "Computing feature values" << endl;
-
         similarity_data result;
-        double seconds = execution_seconds([&]{
-            if (algorithm == "dtw") {
-                result = f.compute_dtw(trace, pairs);
-            } else if (algorithm == "multi-dtw") {
-                result = f.compute_multi_dtw(trace, pairs);
-            } else if (algorithm == "euclid") {
-                result = f.compute_euclid(trace, pairs);
-            } else {
-                throw logic_error("unsupported algorithm");
-            }
-        });
+        double seconds;
+        if (min_shared_aps > 0) {
+            vector<candidate_pair> candidates = prune_pairs(trace, pairs);
+
+            cout << "Computing feature values" << endl;
+            seconds = execution_seconds([&]{
+                result = compute_similarity(f, trace, candidates);
+            });
+        } else {
+            cout << "Computing feature values" << endl;
+            seconds = execution_seconds([&]{
+                result = compute_similarity(f, trace, pairs);
+            });
+        }
         cout << "Computation took " << seconds << " seconds" << endl;
 
         write_feature_file(result, sm);
     }
 }
 
+// Uses the access point index to find the time ranges in which
+// the devices of a pair could have been close to each other.
+vector<candidate_pair> prune_pairs(const tracing_data &trace,
+                                   const vector<tuple<i32, i32>> &pairs)
+{
+    cout << "Building access point index" << endl;
+
+    vector<candidate_pair> candidates;
+    double seconds = execution_seconds([&]{
+        access_point_index index = make_access_point_index(trace, index_block_size);
+        candidates = candidate_pairs(index, pairs, min_shared_aps, min_jaccard);
+    });
+
+    i64 total_seconds = 0;
+    for (auto &c : candidates) {
+        for (auto &range : c.ranges) {
+            total_seconds += get<1>(range) - get<0>(range) + 1;
+        }
+    }
+
+    cout << "Pruning took " << seconds << " seconds\n"
+         << "  Candidate pairs:   " << candidates.size() << " of " << pairs.size() << "\n"
+         << "  Candidate seconds: " << total_seconds << " of " << (i64(pairs.size()) * trace.duration) << "\n"
+         << flush;
+    return candidates;
+}
+
 // Removes all devices from "trace" that are never mentioned in "gt".
 void clean_devices(tracing_data &trace, const vector<string> &targets)
 {
@@ -359,8 +428,14 @@ array_2d<double> evaluate_warp_path(const tracing_data &td,
     for (auto &pair : pairs) {
         auto &ldev = td.devices.at(get<0>(pair));
         auto &rdev = td.devices.at(get<1>(pair));
+        if (ldev.empty() || rdev.empty()) {
+            continue;
+        }
 
-        for (i64 ts = f.begin_timestamp; ts <= f.end_timestamp; ++ts) {
+        // Only consider the time span in which both devices are active.
+        i64 begin = std::max({f.begin_timestamp, ldev.begin_timestamp, rdev.begin_timestamp});
+        i64 end = std::min({f.end_timestamp, ldev.end_timestamp, rdev.end_timestamp});
+        for (i64 ts = begin; ts <= end; ++ts) {
             for (i32 lag = -time_lag; lag <= time_lag; ++lag) {
                 d.compute_similarity(ts, lag, ldev, rdev);
             }
@@ -489,6 +564,18 @@ void parse_options(int argc, char *argv[])
             ("threads",
              po::value<int>(&threads)->value_name("NUMBER")->default_value(0),
              "The number of threads. 0 means automatic, greater values specifiy the exact number.")
+            ("min-shared-aps",
+             po::value<int>(&min_shared_aps)->value_name("NUMBER")->default_value(0),
+             "Only compute feature vectors for device pairs that received signals from at least this many "
+             "common access points within the same index block. Only supported for signal data.\n"
+             "0 means disabled (the default).")
+            ("min-jaccard",
+             po::value<double>(&min_jaccard)->value_name("VALUE")->default_value(0.0),
+             "The minimum jaccard index of the access point sets of a device pair within an index block. "
+             "Only used together with --min-shared-aps.")
+            ("index-block-size",
+             po::value<int>(&index_block_size)->value_name("SECONDS")->default_value(60),
+             "The size of a single block in the access point index. Only used together with --min-shared-aps.")
             ("disable-target-filter",
              po::bool_switch(&disable_target_filter),
              "Disable filtering of devices based on the target list. Only used for performance evaluation.")
@@ -557,6 +644,22 @@ void validate_options()
         cerr << "threads must be greater than or equal to zero (" << threads << ")" << endl;
         ok = false;
     }
+    if (min_shared_aps < 0) {
+        cerr << "minimum number of shared access points must be greater than or equal to zero (" << min_shared_aps << ")" << endl;
+        ok = false;
+    }
+    if (min_jaccard < 0.0 || min_jaccard > 1.0) {
+        cerr << "minimum jaccard index must be in [0, 1] (" << min_jaccard << ")" << endl;
+        ok = false;
+    }
+    if (index_block_size <= 0) {
+        cerr << "index block size must be greater than zero (" << index_block_size << ")" << endl;
+        ok = false;
+    }
+    if (min_shared_aps > 0 && algorithm == "eval-dtw") {
+        cerr << "candidate pruning is not supported for algorithm eval-dtw" << endl;
+        ok = false;
+    }
 
     if (!ok) {
         exit(1);
@@ -20,6 +20,8 @@ void validate_options();
 
 string in_file;
 string out_file;
+string format;   // "intervals" or "dense"
+int    threads;  // >= 0, 0 -> automatic
 
 int main(int argc, char *argv[])
 {
@@ -27,16 +29,7 @@ int main(int argc, char *argv[])
     parse_options(argc, argv);
     validate_options();
 
-    ground_truth gt;
     scene_manifest sm = read_scene_manifest(in_file);
-    if (sm.scene_type == "plain") {
-        gt = read_ground_truth_file(
-                    sm.get_plain_scene_data().ground_truth_file);
-    } else if (sm.scene_type == "game") {
-        gt = read_game_ground_truth(sm);
-    } else {
-        assert(false);
-    }
 
     {
         fstream out_stream;
@@ -50,7 +43,29 @@ int main(int argc, char *argv[])
         }
 
         cereal::JSONOutputArchive ar(out_stream);
-        save_ground_truth_file(ar, gt);
+        if (format == "intervals") {
+            interval_ground_truth gt;
+            if (sm.scene_type == "plain") {
+                gt = read_ground_truth_intervals(
+                            sm.get_plain_scene_data().ground_truth_file);
+            } else if (sm.scene_type == "game") {
+                gt = read_game_ground_truth_intervals(sm, threads);
+            } else {
+                assert(false);
+            }
+            save_ground_truth_file(ar, gt);
+        } else {
+            ground_truth gt;
+            if (sm.scene_type == "plain") {
+                gt = read_ground_truth_file(
+                            sm.get_plain_scene_data().ground_truth_file);
+            } else if (sm.scene_type == "game") {
+                gt = read_game_ground_truth(sm, threads);
+            } else {
+                assert(false);
+            }
+            save_ground_truth_file(ar, gt);
+        }
     }
 }
 
@@ -68,6 +83,13 @@ void parse_options(int argc, char *argv[])
             ("output",
              po::value<string>(&out_file)->value_name("PATH")->required(),
              "Output file.")
+            ("format",
+             po::value<string>(&format)->value_name("FORMAT")->default_value("intervals"),
+             "The output format. Either \"intervals\" (group membership intervals for every device) "
+             "or \"dense\" (a list of devices for every second).")
+            ("threads",
+             po::value<int>(&threads)->value_name("NUMBER")->default_value(0),
+             "The number of threads used to parse game files. 0 means automatic, greater values specifiy the exact number.")
             ;
 
     po::variables_map vm;
@@ -93,5 +115,12 @@ void parse_options(int argc, char *argv[])
 
 void validate_options()
 {
-
+    if (format != "intervals" && format != "dense") {
+        cerr << "invalid format: " << format << endl;
+        exit(1);
+    }
+    if (threads < 0) {
+        cerr << "threads must be greater than or equal to zero (" << threads << ")" << endl;
+        exit(1);
+    }
 }
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <thread>
 
 #include <boost/program_options.hpp>
 #include <cereal/archives/json.hpp>
@@ -17,25 +18,117 @@ using namespace std;
 
 void parse_options(int argc, char *argv[]);
 void validate_options();
+co_moving_classifier train_batch(feature_parameters &params);
+co_moving_classifier train_online(feature_parameters &params);
+interval_ground_truth read_ground_truth(const string &path);
+co_moving_classifier read_initial_classifier(const feature_parameters &params);
 
-// Input file path and its file type ("json" or "binary").
-string in_file;
+// Input file paths and their file type ("json" or "binary").
+vector<string> in_files;
 string in_type;
 
-string ground_truth_file;
+// One ground truth file for every input file.
+vector<string> ground_truth_files;
 
 // Output file path.
 string out_file;
 
+// Continue training this classifier instead of starting from scratch (optional).
+string init_file;
+
+// Online training: stream the input files instead of loading them.
+bool online;
+int  epochs;    // > 0
+int  buffer_size; // > 0
+
+// Sample selection in batch mode and the svm parameter C.
+co_moving_training_options training_options;
+
+// True if the batch mode sample selection options were given explicitly
+// (they are not supported in online mode).
+bool max_negatives_given;
+bool duplicate_tolerance_given;
+
+// Model selection: cross validate multiple values of C and use the best one (batch mode).
+bool select_C;
+int  folds;     // >= 2
+int  threads;   // >= 0, 0 -> automatic
+
 int main(int argc, char *argv[])
 {
     setlocale(LC_ALL, "C");
     parse_options(argc, argv);
     validate_options();
 
-    similarity_data sim;
     feature_parameters params;
-    ground_truth gt;
+    co_moving_classifier classifier = online ? train_online(params) : train_batch(params);
+
+    // Serialize classifier
+    {
+        fstream out_stream;
+        ios_base::openmode mode = ios_base::out | ios_base::trunc;
+
+        try {
+            try_open(out_stream, out_file, mode);
+        } catch (const std::exception &e) {
+            cerr << "failed to open output file \""
+                 << out_file << "\": "
+                 << e.what() << endl;
+            exit(1);
+        }
+
+        cereal::JSONOutputArchive ar(out_stream);
+        save_classifier_file(ar, classifier, params);
+    }
+    return 0;
+}
+
+interval_ground_truth read_ground_truth(const string &path)
+{
+    interval_ground_truth gt;
+    fstream gt_stream;
+    try {
+        try_open(gt_stream, path, ios_base::in);
+    } catch (const std::exception &e) {
+        cerr << "failed to read ground truth file \""
+             << path << "\": "
+             << e.what() << endl;
+        exit(1);
+    }
+
+    read_ground_truth_json(gt_stream, gt);
+    return gt;
+}
+
+// Loads the classifier from "init_file". Its feature parameters
+// must match the parameters of the input files. Exits on error.
+co_moving_classifier read_initial_classifier(const feature_parameters &params)
+{
+    co_moving_classifier classifier;
+    feature_parameters classifier_params;
+    try {
+        fstream in_stream;
+        try_open(in_stream, init_file, ios_base::in);
+
+        cereal::JSONInputArchive ar(in_stream);
+        load_classifier_file(ar, classifier, classifier_params);
+    } catch (const std::exception &e) {
+        cerr << "failed to read classifier file \""
+             << init_file << "\": "
+             << e.what() << endl;
+        exit(1);
+    }
+
+    must_equal(classifier_params, params, in_files[0]);
+    return classifier;
+}
+
+co_moving_classifier train_batch(feature_parameters &params)
+{
+    const string &in_file = in_files[0];
+
+    similarity_data sim;
+    interval_ground_truth gt;
 
     // Load feature file
     try {
@@ -48,20 +141,7 @@ int main(int argc, char *argv[])
     }
 
     // Load ground truth
-    {
-        fstream gt_stream;
-        try {
-            try_open(gt_stream, ground_truth_file, ios_base::in);
-        } catch (const std::exception &e) {
-            cerr << "failed to read ground truth file \""
-                 << in_file << "\": "
-                 << e.what() << endl;
-            exit(1);
-        }
-
-        cereal::JSONInputArchive ar(gt_stream);
-        load_ground_truth_file(ar, gt);
-    }
+    gt = read_ground_truth(ground_truth_files[0]);
 
     try {
         must_match(gt, sim.begin_timestamp, sim.end_timestamp, sim.devices);
@@ -79,35 +159,151 @@ int main(int argc, char *argv[])
          << "  Time lag:    " << params.time_lag << " seconds\n"
          << "  Devices:     " << sim.devices.size() << "\n"
          << "  Duration:    " << sim.duration << " seconds\n"
+         << "  Negatives:   " << (training_options.max_negatives > 0 ? std::to_string(training_options.max_negatives)
+                                                                       : string("unlimited")) << "\n"
          << endl;
 
+    if (select_C) {
+        if (threads == 0) {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+
+        cout << "Cross validating " << folds << " folds using " << threads << " threads ..." << endl;
+
+        vector<cross_validation_result> results;
+        double seconds = execution_seconds([&]{
+            results = co_moving_classifier::cross_validate(sim, gt, co_moving_classifier::default_C_values(),
+                                                           folds, threads, training_options);
+        });
+        for (const auto &r : results) {
+            cout << "  C = " << r.C
+                 << ", accuracy = " << r.positive_accuracy() << " " << r.negative_accuracy()
+                 << ", balanced = " << r.balanced_accuracy() << "\n";
+        }
+        training_options.C = best_result(results).C;
+
+        cout << "Cross validation took " << seconds << " seconds, using C = " << training_options.C << "\n" << endl;
+    }
+
     cout << "Training co-moving classifier ..." << endl;
 
     co_moving_classifier classifier;
+    if (!init_file.empty()) {
+        cout << "Continuing training of " << init_file << endl;
+        classifier = read_initial_classifier(params);
+    }
+
     double seconds = execution_seconds([&]{
-        classifier.learn(sim, gt);
+        classifier.update(sim, gt, training_options);
     });
 
     cout << "Training took " << seconds << " seconds" << endl;
+    return classifier;
+}
 
-    // Serialize classifier
-    {
-        fstream out_stream;
-        ios_base::openmode mode = ios_base::out | ios_base::trunc;
+// Opens the binary feature file at "path". Exits on error.
+unique_ptr<binary_feature_stream> open_feature_stream(const string &path)
+{
+    try {
+        return unique_ptr<binary_feature_stream>(new binary_feature_stream(path));
+    } catch (const std::exception &e) {
+        cerr << "failed to read input file \""
+             << path << "\": "
+             << e.what() << endl;
+        exit(1);
+    }
+}
 
+// Calls func(header, pair) for every pair in every input file.
+// Only one pair is kept in memory at a time.
+template<typename Function>
+void for_each_pair(Function &&func)
+{
+    similarity_data::pair_data pair;
+    for (size_t i = 0; i < in_files.size(); ++i) {
+        auto stream = open_feature_stream(in_files[i]);
         try {
-            try_open(out_stream, out_file, mode);
+            while (stream->next(pair)) {
+                func(i, stream->header(), pair);
+            }
         } catch (const std::exception &e) {
-            cerr << "failed to open output file \""
-                 << out_file << "\": "
+            cerr << "failed to read input file \""
+                 << in_files[i] << "\": "
                  << e.what() << endl;
             exit(1);
         }
+    }
+}
 
-        cereal::JSONOutputArchive ar(out_stream);
-        save_classifier_file(ar, classifier, params);
+co_moving_classifier train_online(feature_parameters &params)
+{
+    // Validate the headers and load all ground truth files.
+    // Ground truth files are small compared to feature files.
+    vector<interval_ground_truth> gts;
+    for (size_t i = 0; i < in_files.size(); ++i) {
+        auto stream = open_feature_stream(in_files[i]);
+        if (i == 0) {
+            params = stream->params();
+        } else {
+            must_equal(params, stream->params(), in_files[i]);
+        }
+
+        const similarity_data &header = stream->header();
+        gts.push_back(read_ground_truth(ground_truth_files[i]));
+        try {
+            must_match(gts.back(), header.begin_timestamp, header.end_timestamp, header.devices);
+        } catch (const std::exception &e) {
+            cerr << "Ground truth mismatch for \""
+                 << ground_truth_files[i] << "\": "
+                 << e.what() << endl;
+            exit(1);
+        }
     }
-    return 0;
+
+    cout << "Training feature data (online):\n"
+         << "  Sources:     " << in_files.size() << " files\n"
+         << "  Data source: " << params.data_source << "\n"
+         << "  Algorithm:   " << params.algorithm << "\n"
+         << "  Window size: " << params.window_size << " seconds\n"
+         << "  Time lag:    " << params.time_lag << " seconds\n"
+         << "  Epochs:      " << epochs << "\n"
+         << "  Buffer size: " << buffer_size << " samples\n"
+         << endl;
+
+    co_moving_online_trainer trainer = [&]() -> co_moving_online_trainer {
+        if (init_file.empty()) {
+            return co_moving_online_trainer(params.time_lag * 2 + 1, training_options.C,
+                                            training_options.seed, size_t(buffer_size));
+        }
+
+        cout << "Continuing training of " << init_file << endl;
+        co_moving_classifier initial = read_initial_classifier(params);
+        try {
+            return co_moving_online_trainer(initial, training_options.C,
+                                            training_options.seed, size_t(buffer_size));
+        } catch (const std::exception &e) {
+            cerr << "cannot continue training of \"" << init_file << "\": " << e.what() << endl;
+            exit(1);
+        }
+    }();
+    double seconds = execution_seconds([&]{
+        cout << "Computing feature statistics ..." << endl;
+        for_each_pair([&](size_t, const similarity_data &, const similarity_data::pair_data &pair) {
+            trainer.observe(pair);
+        });
+        cout << "Observed " << trainer.observed() << " feature vectors." << endl;
+
+        for (int epoch = 0; epoch < epochs; ++epoch) {
+            cout << "Training epoch " << (epoch + 1) << " of " << epochs << " ..." << endl;
+            for_each_pair([&](size_t i, const similarity_data &header, const similarity_data::pair_data &pair) {
+                trainer.train(header, pair, gts[i]);
+            });
+            trainer.flush();
+        }
+    });
+
+    cout << "Training took " << seconds << " seconds" << endl;
+    return trainer.classifier();
 }
 
 void parse_options(int argc, char *argv[])
@@ -119,8 +315,8 @@ void parse_options(int argc, char *argv[])
             ("help,h",
              "Print this help message")
             ("input",
-             po::value<string>(&in_file)->value_name("PATH")->required(),
-             "Input file (feature data)")
+             po::value<vector<string>>(&in_files)->value_name("PATH")->required(),
+             "Input file (feature data). Can be specified multiple times in online mode.")
             ("input-type",
              po::value<string>(&in_type)->value_name("TYPE")->required(),
              "The input type. Input files must be valid feature files.\n"
@@ -128,11 +324,54 @@ void parse_options(int argc, char *argv[])
              "  json:   \tRead the feature files as json.\n"
              "  binary: \tRead the feature files as binary files.")
             ("ground-truth",
-             po::value<string>(&ground_truth_file)->value_name("PATH")->required(),
-             "The path to the ground truth file. The ground truth is needed to classify the learning data.")
+             po::value<vector<string>>(&ground_truth_files)->value_name("PATH")->required(),
+             "The path to the ground truth file. The ground truth is needed to classify the learning data.\n"
+             "Must be specified once for every input file, in the same order.")
             ("output",
              po::value<string>(&out_file)->value_name("PATH")->required(),
              "The output file. The classifier will be serialized into this file.")
+            ("init-from",
+             po::value<string>(&init_file)->value_name("PATH"),
+             "Continue training the classifier in this file (produced by this program) "
+             "with the new input files instead of training from scratch. "
+             "The feature parameters must match.")
+            ("online",
+             po::bool_switch(&online),
+             "Train by streaming over the input files instead of loading them into memory.\n"
+             "Requires binary input files.")
+            ("epochs",
+             po::value<int>(&epochs)->value_name("NUMBER")->default_value(5),
+             "The number of passes over the input files in online mode.")
+            ("buffer-size",
+             po::value<int>(&buffer_size)->value_name("NUMBER")->default_value(1 << 16),
+             "The number of feature vectors held in memory to shuffle samples across pairs in online mode.")
+            ("max-negatives",
+             po::value<i64>(&training_options.max_negatives)->value_name("NUMBER")->default_value(1000000),
+             "The maximum number of non-co-moving samples used in batch mode. "
+             "All co-moving samples are used, the non-co-moving samples are chosen at random. "
+             "0 means no limit.")
+            ("duplicate-tolerance",
+             po::value<double>(&training_options.duplicate_tolerance)->value_name("VALUE")->default_value(-1.0),
+             "Drop samples in batch mode that differ by at most this value (in standard deviations) "
+             "from the previous sample of the same pair with the same label. "
+             "Removing samples changes the weight of the remaining ones, thus the filter "
+             "is disabled by default (negative value).")
+            ("seed",
+             po::value<u32>(&training_options.seed)->value_name("NUMBER")->default_value(42),
+             "The seed for the random selection of non-co-moving samples (batch mode) "
+             "or for the sample order (online mode).")
+            ("C",
+             po::value<double>(&training_options.C)->value_name("VALUE")->default_value(1.0),
+             "The regularization parameter of the svm.")
+            ("select-C",
+             po::bool_switch(&select_C),
+             "Choose C by cross validation (batch mode). Overrides --C.")
+            ("folds",
+             po::value<int>(&folds)->value_name("NUMBER")->default_value(3),
+             "The number of cross validation folds.")
+            ("threads",
+             po::value<int>(&threads)->value_name("NUMBER")->default_value(0),
+             "The number of threads used for cross validation. 0 means automatic, greater values specifiy the exact number.")
             ;
 
     po::variables_map vm;
@@ -153,6 +392,8 @@ void parse_options(int argc, char *argv[])
         }
 
         po::notify(vm);
+        max_negatives_given = !vm["max-negatives"].defaulted();
+        duplicate_tolerance_given = !vm["duplicate-tolerance"].defaulted();
     } catch (const po::error &e) {
         cerr << e.what() << endl;
         exit(1);
@@ -172,6 +413,54 @@ void validate_options()
         cerr << "invalid input type (" << in_type << ")" << endl;
         ok = false;
     }
+    if (in_files.size() != ground_truth_files.size()) {
+        cerr << "every input file needs a ground truth file" << endl;
+        ok = false;
+    }
+    if (!online && in_files.size() != 1) {
+        cerr << "multiple input files are only supported in online mode" << endl;
+        ok = false;
+    }
+    if (online && in_type != "binary") {
+        cerr << "online mode requires binary input files" << endl;
+        ok = false;
+    }
+    if (epochs <= 0) {
+        cerr << "epochs must be greater than zero (" << epochs << ")" << endl;
+        ok = false;
+    }
+    if (buffer_size <= 0) {
+        cerr << "buffer-size must be greater than zero (" << buffer_size << ")" << endl;
+        ok = false;
+    }
+    if (!(training_options.C > 0)) {
+        cerr << "C must be greater than zero (" << training_options.C << ")" << endl;
+        ok = false;
+    }
+    if (select_C && online) {
+        cerr << "select-C is not supported in online mode" << endl;
+        ok = false;
+    }
+    if (max_negatives_given && online) {
+        cerr << "max-negatives is not supported in online mode" << endl;
+        ok = false;
+    }
+    if (duplicate_tolerance_given && online) {
+        cerr << "duplicate-tolerance is not supported in online mode" << endl;
+        ok = false;
+    }
+    if (folds < 2) {
+        cerr << "folds must be at least 2 (" << folds << ")" << endl;
+        ok = false;
+    }
+    if (threads < 0) {
+        cerr << "threads must be greater than or equal to zero (" << threads << ")" << endl;
+        ok = false;
+    }
+    if (training_options.max_negatives < 0) {
+        cerr << "max-negatives must not be negative (" << training_options.max_negatives << ")" << endl;
+        ok = false;
+    }
 
     if (!ok) {
         exit(1);
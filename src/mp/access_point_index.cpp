@@ -0,0 +1,196 @@
+#include "mp/access_point_index.hpp"
+
+#include <unordered_map>
+
+#include "mp/tracing_data.hpp"
+
+namespace mp {
+
+namespace {
+
+// Key for an unordered pair of device indices.
+u64 pair_key(i32 a, i32 b)
+{
+    if (a > b) {
+        std::swap(a, b);
+    }
+    return (u64(u32(a)) << 32) | u64(u32(b));
+}
+
+// Computes the index for the time range [begin, end].
+void index_block(const tracing_data &td, i64 begin, i64 end,
+                 access_point_index::block_data &block)
+{
+    const i32 num_aps = td.data_dimension;
+    const i32 num_devices = numeric_cast<i32>(td.devices.size());
+
+    // First pass: find the set of access points for every device.
+    // The sets are stored in "device_aps", the range for device i is
+    // [device_offsets[i], device_offsets[i + 1]).
+    vector<char> seen(num_aps);
+    vector<i32> device_aps;
+    vector<i32> device_offsets;
+    device_offsets.reserve(num_devices + 1);
+    block.access_point_counts.assign(num_devices, 0);
+    for (i32 dev = 0; dev < num_devices; ++dev) {
+        device_offsets.push_back(device_aps.size());
+
+        // Only the device's active span has to be considered.
+        const auto &device = td.devices[dev];
+        const i64 span_begin = device.empty() ? end + 1 : std::max(begin, device.begin_timestamp);
+        const i64 span_end = device.empty() ? end : std::min(end, device.end_timestamp);
+
+        std::fill(seen.begin(), seen.end(), 0);
+        for (i64 ts = span_begin; ts <= span_end; ++ts) {
+            auto has_data = td.has_data_at(device, ts);
+            for (i32 ap = 0; ap < num_aps; ++ap) {
+                seen[ap] |= has_data[ap];
+            }
+        }
+        for (i32 ap = 0; ap < num_aps; ++ap) {
+            if (seen[ap]) {
+                device_aps.push_back(ap);
+            }
+        }
+        block.access_point_counts[dev] = device_aps.size() - device_offsets.back();
+    }
+    device_offsets.push_back(device_aps.size());
+
+    // Second pass: transpose the device -> access points mapping
+    // into access point -> devices (counting sort by access point).
+    // Devices are visited in ascending order, so the per-ap lists are sorted.
+    block.offsets.assign(num_aps + 1, 0);
+    for (i32 ap : device_aps) {
+        ++block.offsets[ap + 1];
+    }
+    for (i32 ap = 0; ap < num_aps; ++ap) {
+        block.offsets[ap + 1] += block.offsets[ap];
+    }
+
+    vector<i32> insert_pos(block.offsets.begin(), block.offsets.end() - 1);
+    block.devices.resize(device_aps.size());
+    for (i32 dev = 0; dev < num_devices; ++dev) {
+        for (i32 i = device_offsets[dev]; i < device_offsets[dev + 1]; ++i) {
+            block.devices[insert_pos[device_aps[i]]++] = dev;
+        }
+    }
+}
+
+} // namespace
+
+access_point_index make_access_point_index(const tracing_data &td, i64 block_size)
+{
+    if (block_size <= 0) {
+        throw std::logic_error("Block size must be > 0");
+    }
+    if (td.data_dimension <= 0 || td.duration <= 0) {
+        throw std::logic_error("Tracing data must not be empty");
+    }
+
+    access_point_index index;
+    index.begin_timestamp = td.min_timestamp;
+    index.end_timestamp = td.max_timestamp;
+    index.block_size = block_size;
+    index.access_points = td.data_dimension;
+    index.num_devices = numeric_cast<i32>(td.devices.size());
+    index.blocks.resize((td.duration + block_size - 1) / block_size);
+
+    for (size_t b = 0; b < index.blocks.size(); ++b) {
+        i64 begin, end;
+        std::tie(begin, end) = index.block_range(b);
+        index_block(td, begin, end, index.blocks[b]);
+    }
+    return index;
+}
+
+vector<candidate_pair> candidate_pairs(const access_point_index &index,
+                                       const vector<tuple<i32, i32>> &pairs,
+                                       i32 min_shared_access_points,
+                                       double min_jaccard)
+{
+    if (min_shared_access_points <= 0) {
+        throw std::logic_error("Minimum number of shared access points must be > 0");
+    }
+    if (min_jaccard < 0.0 || min_jaccard > 1.0) {
+        throw std::logic_error("Minimum jaccard index must be in [0, 1]");
+    }
+
+    const i32 num_pairs = numeric_cast<i32>(pairs.size());
+
+    // Maps an unordered device pair to its index in "pairs".
+    std::unordered_map<u64, i32> pair_ids;
+    pair_ids.reserve(num_pairs);
+    for (i32 i = 0; i < num_pairs; ++i) {
+        i32 left = get<0>(pairs[i]);
+        i32 right = get<1>(pairs[i]);
+        assert(left >= 0 && left < index.num_devices);
+        assert(right >= 0 && right < index.num_devices);
+
+        bool inserted;
+        std::tie(std::ignore, inserted) = pair_ids.emplace(pair_key(left, right), i);
+        assert(inserted && "Pairs are unique");
+        (void) inserted;
+    }
+
+    vector<vector<tuple<i64, i64>>> ranges(num_pairs);
+    vector<i32> shared(num_pairs, 0);   // shared access points in the current block
+    vector<i32> touched;                // pairs with shared[i] != 0
+    for (size_t b = 0; b < index.blocks.size(); ++b) {
+        const auto &block = index.blocks[b];
+
+        // Count the number of shared access points for every pair.
+        // Only devices that appear in the same list are visited, thus
+        // the effort scales with the number of neighbours of every device.
+        for (i32 ap = 0; ap < index.access_points; ++ap) {
+            auto devices = index.devices_at(block, ap);
+            for (size_t i = 0; i < devices.size(); ++i) {
+                for (size_t j = i + 1; j < devices.size(); ++j) {
+                    auto iter = pair_ids.find(pair_key(devices[i], devices[j]));
+                    if (iter == pair_ids.end()) {
+                        continue;
+                    }
+                    if (shared[iter->second]++ == 0) {
+                        touched.push_back(iter->second);
+                    }
+                }
+            }
+        }
+
+        i64 begin, end;
+        std::tie(begin, end) = index.block_range(b);
+        for (i32 id : touched) {
+            i32 common = shared[id];
+            shared[id] = 0;
+
+            if (common < min_shared_access_points) {
+                continue;
+            }
+
+            i32 left_count = block.access_point_counts[get<0>(pairs[id])];
+            i32 right_count = block.access_point_counts[get<1>(pairs[id])];
+            double jaccard = double(common) / double(left_count + right_count - common);
+            if (jaccard < min_jaccard) {
+                continue;
+            }
+
+            // Merge with the previous block if they are adjacent.
+            auto &r = ranges[id];
+            if (!r.empty() && get<1>(r.back()) + 1 == begin) {
+                get<1>(r.back()) = end;
+            } else {
+                r.push_back(make_tuple(begin, end));
+            }
+        }
+        touched.clear();
+    }
+
+    vector<candidate_pair> result;
+    for (i32 i = 0; i < num_pairs; ++i) {
+        if (!ranges[i].empty()) {
+            result.push_back({get<0>(pairs[i]), get<1>(pairs[i]), std::move(ranges[i])});
+        }
+    }
+    return result;
+}
+
+} // namespace mp
@@ -1,99 +1,612 @@
 #include "mp/co_moving_detection.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
 #include <dlib/svm.h>
 
 #include "mp/feature_computation.hpp"
 #include "mp/ground_truth.hpp"
+#include "mp/ground_truth_labels.hpp"
+#include "mp/tools/parallel.hpp"
 
 namespace mp {
 
 // Increment if any details in the layout of
 // co_moving_classifier::impl change.
-static const i32 VERSION = 3;
+static const i32 VERSION = 4;
+
+// Classifiers of version 3 stored a dlib function object.
+// These types are only needed to load such classifiers.
+static const i32 LEGACY_VERSION = 3;
 
 using sample_type        = dlib::matrix<double, 0, 1>; // 0 -> row size determined at runtime
-using vector_normalizer  = dlib::vector_normalizer<sample_type>;
 using kernel_type        = dlib::linear_kernel<sample_type>;
-using trainer_type       = dlib::svm_c_linear_trainer<kernel_type>; // TODO: Decide on a final trainer type.
 using decision_func_type = dlib::decision_function<kernel_type>;
 using function_type      = dlib::normalized_function<decision_func_type>;
 
-// Extracts a vector of samples (== feature vectors) and labels (== co-moving/not co-moving)
-// from the input data.
-static void get_learning_data(const similarity_data &data, const ground_truth &gt,
-                              vector<sample_type> &samples, vector<double> &labels)
+// Stopping criterion and iteration limit for the svm solver.
+static const double SOLVER_EPSILON = 0.1;
+static const i32    SOLVER_MAX_EPOCHS = 1000;
+
+// Seed for the random sample order during training.
+static const u32 SHUFFLE_SEED = 42;
+
+// The set of training samples.
+// Samples point into the feature matrices of a similarity_data instance,
+// i.e. no feature values are copied.
+struct training_set
+{
+    size_t dimension = 0;
+    vector<const double *> samples;
+    vector<double> labels;  // +1 (co-moving) or -1 (not co-moving)
+};
+
+// Computes the dot product of a and b (both of length n).
+// Uses independent partial sums so that the compiler can vectorize the loop.
+static double dot(const double *a, const double *b, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+// Running mean and variance of every feature (Welford's algorithm).
+struct feature_statistics
 {
-    samples.clear();
-    labels.clear();
+    i64            count = 0;
+    vector<double> means;
+    vector<double> m2;      // Sums of squared differences from the mean.
+
+    void reset(size_t dimension)
+    {
+        count = 0;
+        means.assign(dimension, 0.0);
+        m2.assign(dimension, 0.0);
+    }
 
-    samples.reserve(data.pairs.size() * data.duration);
-    labels.reserve(data.pairs.size() * data.duration);
+    void add(const double *x)
+    {
+        ++count;
+        for (size_t j = 0; j < means.size(); ++j) {
+            double delta = x[j] - means[j];
+            means[j] += delta / double(count);
+            m2[j] += delta * (x[j] - means[j]);
+        }
+    }
+
+    // Combines the statistics of two disjoint sets of samples (Chan et al.).
+    void merge(const feature_statistics &other)
+    {
+        if (other.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+
+        assert(means.size() == other.means.size());
+        const double n = double(count + other.count);
+        const double f = double(count) * double(other.count) / n;
+        for (size_t j = 0; j < means.size(); ++j) {
+            double delta = other.means[j] - means[j];
+            means[j] += delta * double(other.count) / n;
+            m2[j] += other.m2[j] + delta * delta * f;
+        }
+        count += other.count;
+    }
+
+    // The (unbiased) sample variance of feature j.
+    double variance(size_t j) const
+    {
+        return count > 1 ? m2[j] / double(count - 1) : 0.0;
+    }
+};
+
+// Normalizes feature vectors to zero mean and unit variance:
+// normalized(x)_j = (x_j - means_j) * scales_j.
+struct normalizer
+{
+    vector<double> means;
+    vector<double> scales;
+
+    normalizer() {}
+
+    explicit normalizer(const feature_statistics &stats)
+        : means(stats.means)
+        , scales(stats.means.size())
+    {
+        // Features without variance are ignored.
+        for (size_t j = 0; j < scales.size(); ++j) {
+            double var = stats.variance(j);
+            scales[j] = var > 0 ? 1.0 / std::sqrt(var) : 0.0;
+        }
+    }
+
+    void apply(const double *x, double *out) const
+    {
+        for (size_t j = 0; j < means.size(); ++j) {
+            out[j] = (x[j] - means[j]) * scales[j];
+        }
+    }
+};
+
+// A linear function on normalized feature vectors: dot(w, normalized(x)) + b.
+struct linear_model
+{
+    vector<double> w;
+    double         b = 0;
+};
+
+// Returns the model that computes the same function as "model"
+// for samples normalized by "to" instead of "from":
+//      dot(w, (x - m) * s) + b == dot(w', (x - m') * s') + b'
+// with w'_j = w_j * s_j / s'_j and b' = b + sum_j w_j * s_j * (m'_j - m_j).
+// Features without variance in "to" are ignored by the new normalizer,
+// their contribution (at x_j == m'_j) is moved into the bias.
+static linear_model renormalize(const linear_model &model, const normalizer &from, const normalizer &to)
+{
+    linear_model result;
+    result.w.assign(model.w.size(), 0.0);
+    result.b = model.b;
+    for (size_t j = 0; j < model.w.size(); ++j) {
+        const double weight = model.w[j] * from.scales[j];
+        if (to.scales[j] > 0) {
+            result.w[j] = weight / to.scales[j];
+        }
+        result.b += weight * (to.means[j] - from.means[j]);
+    }
+    return result;
+}
+
+// Collects the feature vectors and their labels (== co-moving/not co-moving)
+// from the input data. All co-moving samples are kept, the non-co-moving ones
+// are subject to options.max_negatives (reservoir sampling, algorithm R).
+// Near duplicates are removed first, see co_moving_training_options.
+static training_set get_learning_data(const similarity_data &data, const interval_ground_truth &gt,
+                                      const co_moving_training_options &options)
+{
+    const size_t dim = size_t(data.feature_dimension);
+    const bool filter_duplicates = options.duplicate_tolerance >= 0;
+
+    training_set set;
+    set.dimension = dim;
+
+    // The duplicate filter measures differences in standard deviations
+    // of the complete data set.
+    normalizer norm;
+    if (filter_duplicates) {
+        feature_statistics stats;
+        stats.reset(dim);
+        for (auto &pair : data.pairs) {
+            for (size_t row = 0; row < pair.features.rows(); ++row) {
+                stats.add(pair.features.row(row).begin());
+            }
+        }
+        norm = normalizer(stats);
+    }
+
+    if (options.max_negatives == 0) {
+        size_t rows = 0;
+        for (auto &pair : data.pairs) {
+            rows += pair.features.rows();
+        }
+        set.samples.reserve(rows);
+        set.labels.reserve(rows);
+    }
+
+    // Reservoir of non-co-moving samples. Only used when the number
+    // of negatives is bounded, otherwise they are added to the set directly.
+    const size_t max_negatives = size_t(options.max_negatives);
+    vector<const double *> negatives;
+    i64 negatives_seen = 0;
+    std::mt19937_64 rng(options.seed);
+
+    // Resolve the ground truth for all pairs at once.
+    const ground_truth_labels gt_labels = make_ground_truth_labels(gt, data);
 
-    sample_type sample;
-    sample.set_size(data.feature_dimension, 1);
     // For each pair ...
-    for (auto &pair : data.pairs) {
-        const string &left_name = data.devices[pair.left];
-        const string &right_name = data.devices[pair.right];
+    for (size_t p = 0; p < data.pairs.size(); ++p) {
+        const auto &pair = data.pairs[p];
+        const double *last = nullptr;
+        bool last_co_moving = false;
 
         // ... and each timestamp ...
         for (i64 ts = data.begin_timestamp; ts <= data.end_timestamp; ++ts) {
+            // Skip timestamps that have been pruned during feature computation.
+            i64 row = data.row_at(pair, ts);
+            if (row == -1) {
+                continue;
+            }
+
             // ... get the feature vector and its corresponding ground truth
-            auto feature = data.feature_at(pair, ts);
-            for (i32 i = 0; i < data.feature_dimension; ++i) {
-                sample(i) = feature[i];
+            const double *sample = pair.features.row(size_t(row)).begin();
+            const bool co_moving = gt_labels.co_moving_at(p, ts);
+
+            if (filter_duplicates) {
+                if (last && last_co_moving == co_moving) {
+                    double diff = 0;
+                    for (size_t j = 0; j < dim; ++j) {
+                        diff = std::max(diff, std::abs(sample[j] - last[j]) * norm.scales[j]);
+                    }
+                    if (diff <= options.duplicate_tolerance) {
+                        continue;
+                    }
+                }
+                last = sample;
+                last_co_moving = co_moving;
             }
-            samples.push_back(sample);
 
-            bool co_moving = gt.co_moving_at(ts, left_name, right_name);
-            labels.push_back(co_moving ? 1.0 : -1.0);
+            if (co_moving || max_negatives == 0) {
+                set.samples.push_back(sample);
+                set.labels.push_back(co_moving ? 1.0 : -1.0);
+            } else if (negatives.size() < max_negatives) {
+                negatives.push_back(sample);
+                ++negatives_seen;
+            } else {
+                // Replace a random element with probability max_negatives / (negatives_seen + 1).
+                std::uniform_int_distribution<i64> dist(0, negatives_seen);
+                i64 index = dist(rng);
+                if (index < i64(max_negatives)) {
+                    negatives[size_t(index)] = sample;
+                }
+                ++negatives_seen;
+            }
         }
     }
+
+    set.samples.insert(set.samples.end(), negatives.begin(), negatives.end());
+    set.labels.resize(set.samples.size(), -1.0);
+    return set;
 }
 
-// Trains the given normalizer using the provided samples
-// and then normalizes the samples.
-static void normalize(vector_normalizer &norm, vector<sample_type> &samples)
+// Trains a linear svm by solving the dual of
+//      min_w 0.5 * |w|^2 + C / n * sum_i max(0, 1 - y_i * (dot(w, z_i) + b))
+// with dual coordinate descent (Hsieh et al., 2008), where z_i is the normalized sample i.
+// This is the objective of dlib's svm_c_linear_trainer, which was used before,
+// i.e. the loss is averaged over the n samples and values of C keep their meaning.
+// The bias is treated as an additional feature with constant value 1.
+// Only the samples in "indices" are used.
+// If "norm" is null, the samples must have been normalized in advance.
+//
+// If "initial" is not null, the solver starts with the given model (warm start)
+// and the regularization term becomes 0.5 * |w - initial.w|^2 (including the bias),
+// i.e. the result stays close to the initial model unless the new samples disagree with it.
+static linear_model train_svm(const training_set &set, const normalizer *norm,
+                              const vector<size_t> &indices, double C,
+                              const linear_model *initial = nullptr)
 {
-    norm.train(samples);
-    for (auto &sample : samples) {
-        sample = norm(sample);
+    const size_t dim = set.dimension;
+    const size_t n = indices.size();
+
+    linear_model model;
+    if (initial) {
+        assert(initial->w.size() == dim);
+        model = *initial;
+    } else {
+        model.w.assign(dim, 0.0);
+    }
+    if (n == 0) {
+        return model;
+    }
+
+    // Returns the normalized sample i.
+    vector<double> z(dim);
+    auto normalized = [&](size_t i) -> const double * {
+        const double *x = set.samples[indices[i]];
+        if (!norm) {
+            return x;
+        }
+        norm->apply(x, z.data());
+        return z.data();
+    };
+
+    // Diagonal of the kernel matrix: |z_i|^2 + 1 (bias feature).
+    vector<double> diag(n);
+    for (size_t i = 0; i < n; ++i) {
+        const double *zi = normalized(i);
+        diag[i] = dot(zi, zi, dim) + 1.0;
     }
+
+    // Upper bound of the dual variables.
+    const double U = C / double(n);
+
+    vector<double> alpha(n, 0.0);
+    vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+
+    std::mt19937 rng(SHUFFLE_SEED);
+    for (i32 epoch = 0; epoch < SOLVER_MAX_EPOCHS; ++epoch) {
+        std::shuffle(order.begin(), order.end(), rng);
+
+        double max_pg = -std::numeric_limits<double>::infinity();
+        double min_pg = std::numeric_limits<double>::infinity();
+        for (size_t i : order) {
+            const double y = set.labels[indices[i]];
+            const double *zi = normalized(i);
+
+            const double g = y * (dot(model.w.data(), zi, dim) + model.b) - 1.0;
+
+            // Projected gradient.
+            double pg = g;
+            if (alpha[i] == 0) {
+                pg = std::min(g, 0.0);
+            } else if (alpha[i] == U) {
+                pg = std::max(g, 0.0);
+            }
+            max_pg = std::max(max_pg, pg);
+            min_pg = std::min(min_pg, pg);
+
+            if (pg != 0) {
+                const double old_alpha = alpha[i];
+                alpha[i] = std::min(std::max(old_alpha - g / diag[i], 0.0), U);
+
+                const double d = (alpha[i] - old_alpha) * y;
+                for (size_t j = 0; j < dim; ++j) {
+                    model.w[j] += d * zi[j];
+                }
+                model.b += d;
+            }
+        }
+
+        if (max_pg - min_pg < SOLVER_EPSILON) {
+            break;
+        }
+    }
+    return model;
+}
+
+// Returns the sample indices [0, n) in a random (but reproducible) order.
+static vector<size_t> shuffled_indices(size_t n)
+{
+    vector<size_t> indices(n);
+    for (size_t i = 0; i < n; ++i) {
+        indices[i] = i;
+    }
+    std::mt19937 rng(SHUFFLE_SEED);
+    std::shuffle(indices.begin(), indices.end(), rng);
+    return indices;
+}
+
+static feature_statistics compute_statistics(const training_set &set)
+{
+    feature_statistics stats;
+    stats.reset(set.dimension);
+    for (const double *sample : set.samples) {
+        stats.add(sample);
+    }
+    return stats;
 }
 
 struct co_moving_classifier::impl
 {
-    function_type func;
-    size_t        training_dimension;
-    sample_type   sample;
+    size_t             training_dimension;
+    feature_statistics stats;   // Statistics of the training samples, used for normalization.
+    linear_model       model;   // Operates on normalized feature vectors.
+
+    // The normalizer and the model folded into
+    // a single linear function: co_moving(x) <=> dot(weights, x) + bias >= 0.
+    // Not serialized, computed by fold() instead.
+    vector<double> weights;
+    double         bias;
+
+    void fold();
+    void load_legacy(std::istream &i);
 };
 
+void co_moving_classifier::impl::fold()
+{
+    // dot(w, (x - means) * scales) + b
+    //      == dot(w * scales, x) - dot(w * scales, means) + b
+    normalizer norm(stats);
+
+    weights.resize(training_dimension);
+    bias = model.b;
+    for (size_t j = 0; j < training_dimension; ++j) {
+        weights[j] = model.w[j] * norm.scales[j];
+        bias -= weights[j] * norm.means[j];
+    }
+}
+
 void co_moving_classifier::print_cross_validation(const similarity_data &data, const ground_truth &gt, std::ostream &o)
 {
-    vector<sample_type> samples;
-    vector<double> labels;
-    get_learning_data(data, gt, samples, labels);
-    dlib::randomize_samples(samples, labels);
+    print_cross_validation(data, make_interval_ground_truth(gt), o);
+}
 
-    vector_normalizer norm;
-    normalize(norm, samples);
+void co_moving_classifier::print_cross_validation(const similarity_data &data, const interval_ground_truth &gt, std::ostream &o)
+{
+    const vector<cross_validation_result> results = cross_validate(data, gt, default_C_values());
 
-    trainer_type trainer;
     o << "Cross validation results: " << std::endl;
-    for (double C = 1; C < 100000; C *= 5) {
-        trainer.set_c(C);
-
+    for (const auto &r : results) {
         // Two values:
         // - fraction of correctly identified +1 cases
         // - ________________________________ -1 cases
-        o << "C = " << C
-          << ", accuracy = " << dlib::cross_validate_trainer(trainer, samples, labels, 3);
-        o << std::flush;
+        o << "C = " << r.C
+          << ", accuracy = "
+          << r.positive_accuracy() << " "
+          << r.negative_accuracy() << "\n";
+    }
+    o << std::flush;
+}
+
+vector<double> co_moving_classifier::default_C_values()
+{
+    vector<double> values;
+    for (double C = 1; C < 100000; C *= 5) {
+        values.push_back(C);
+    }
+    return values;
+}
+
+vector<cross_validation_result> co_moving_classifier::cross_validate(
+        const similarity_data &data, const interval_ground_truth &gt,
+        const vector<double> &C_values, i32 folds, i32 threads,
+        const co_moving_training_options &options)
+{
+    if (folds < 2) {
+        throw std::invalid_argument("folds must be at least 2");
+    }
+    for (double C : C_values) {
+        if (!(C > 0)) {
+            throw std::invalid_argument("C must be greater than zero");
+        }
+    }
+    if (options.max_negatives < 0) {
+        throw std::invalid_argument("max_negatives must not be negative");
+    }
+
+    const training_set set = get_learning_data(data, gt, options);
+    const size_t dim = set.dimension;
+    const size_t n = set.samples.size();
+
+    // Normalize every sample once. The normalized samples are shared
+    // (read only) by all trainers.
+    array_2d<double> normalized_values(n, dim);
+    training_set normalized;
+    normalized.dimension = dim;
+    normalized.labels = set.labels;
+    normalized.samples.resize(n);
+    {
+        const normalizer norm(compute_statistics(set));
+        for (size_t i = 0; i < n; ++i) {
+            double *z = normalized_values.data() + i * dim;
+            norm.apply(set.samples[i], z);
+            normalized.samples[i] = z;
+        }
+    }
+
+    // Sample i is in the test set of fold (i % folds).
+    const size_t fold_count = size_t(folds);
+    const vector<size_t> indices = shuffled_indices(n);
+    vector<vector<size_t>> train_sets(fold_count), test_sets(fold_count);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t fold = 0; fold < fold_count; ++fold) {
+            (i % fold_count == fold ? test_sets : train_sets)[fold].push_back(indices[i]);
+        }
+    }
+
+    // One task for every (C, fold) combination. The solver's running time
+    // varies a lot with C, so tasks are handed out dynamically.
+    vector<cross_validation_result> task_results(C_values.size() * fold_count);
+    parallel_for_dynamic(threads, task_results.size(), [&](size_t task) {
+        const double C = C_values[task / fold_count];
+        const size_t fold = task % fold_count;
+
+        const linear_model model = train_svm(normalized, nullptr, train_sets[fold], C);
+
+        cross_validation_result &r = task_results[task];
+        for (size_t i : test_sets[fold]) {
+            bool predicted = dot(model.w.data(), normalized.samples[i], dim) + model.b >= 0;
+            if (normalized.labels[i] > 0) {
+                ++r.positives;
+                r.correct_positives += predicted;
+            } else {
+                ++r.negatives;
+                r.correct_negatives += !predicted;
+            }
+        }
+    });
+
+    vector<cross_validation_result> results(C_values.size());
+    for (size_t c = 0; c < C_values.size(); ++c) {
+        cross_validation_result &r = results[c];
+        r.C = C_values[c];
+        for (size_t fold = 0; fold < fold_count; ++fold) {
+            const cross_validation_result &t = task_results[c * fold_count + fold];
+            r.positives += t.positives;
+            r.correct_positives += t.correct_positives;
+            r.negatives += t.negatives;
+            r.correct_negatives += t.correct_negatives;
+        }
+    }
+    return results;
+}
+
+const cross_validation_result& best_result(const vector<cross_validation_result> &results)
+{
+    assert(!results.empty() && "Results must not be empty");
+
+    const cross_validation_result *best = &results[0];
+    for (const auto &r : results) {
+        const double accuracy = r.balanced_accuracy();
+        const double best_accuracy = best->balanced_accuracy();
+        if (accuracy > best_accuracy || (accuracy == best_accuracy && r.C < best->C)) {
+            best = &r;
+        }
+    }
+    return *best;
+}
+
+classification_counts count_classifications(const co_moving_classifier &c,
+                                            const similarity_data &data,
+                                            const interval_ground_truth &gt)
+{
+    classification_counts counts;
+    const i64 duration = data.end_timestamp - data.begin_timestamp + 1;
+    const i32 devices = static_cast<i32>(data.devices.size());
+
+    // Pairs with feature vectors.
+    vector<char> has_features(size_t(devices) * size_t(devices), 0);
+    const ground_truth_labels gt_labels = make_ground_truth_labels(gt, data);
+    vector<char> co_moving_rows;
+    for (size_t p = 0; p < data.pairs.size(); ++p) {
+        const auto &pair = data.pairs[p];
+        const i32 a = std::min(pair.left, pair.right), b = std::max(pair.left, pair.right);
+        if (has_features[size_t(a) * size_t(devices) + size_t(b)]) {
+            continue;
+        }
+        has_features[size_t(a) * size_t(devices) + size_t(b)] = 1;
+
+        c.co_moving_batch(pair.features, co_moving_rows);
+        for (i64 ts = data.begin_timestamp; ts <= data.end_timestamp; ++ts) {
+            const bool co_moving = gt_labels.co_moving_at(p, ts);
+            // Timestamps without a feature vector have been pruned
+            // during feature computation, i.e. the pair is not co-moving.
+            const i64 row = data.row_at(pair, ts);
+            const bool predicted = row != -1 && co_moving_rows[size_t(row)];
+
+            if (co_moving) {
+                ++(predicted ? counts.true_positive : counts.false_negative);
+            } else {
+                ++(predicted ? counts.false_positive : counts.true_negative);
+            }
+        }
     }
+
+    // Pairs without feature vectors are never co-moving.
+    vector<tuple<i32, i32>> missing;
+    for (i32 a = 0; a < devices; ++a) {
+        for (i32 b = a + 1; b < devices; ++b) {
+            if (!has_features[size_t(a) * size_t(devices) + size_t(b)]) {
+                missing.push_back(make_tuple(a, b));
+            }
+        }
+    }
+    const i64 positives = count_co_moving(gt, data.devices, missing,
+                                          data.begin_timestamp, data.end_timestamp);
+    counts.false_negative += positives;
+    counts.true_negative += i64(missing.size()) * duration - positives;
+    return counts;
 }
 
-bool co_moving_classifier::co_moving(array_view<const double> a)
+bool co_moving_classifier::co_moving(array_view<const double> a) const
 {
     if (!m_impl) {
         return false;
@@ -103,42 +616,133 @@ bool co_moving_classifier::co_moving(array_view<const double> a)
     // that equals the training dimension.
     assert(a.size() == m_impl->training_dimension);
 
-    // Sample is an instance of sample_type that is
-    // cached by this instance of co_moving_classifier.
-    // This saves us an allocation per classification.
-    sample_type &sample = m_impl->sample;
-    for (size_t i = 0; i < m_impl->training_dimension; ++i) {
-        sample(i) = a[i];
+    return dot(m_impl->weights.data(), a.begin(), a.size()) + m_impl->bias >= 0;
+}
+
+void co_moving_classifier::learn(const similarity_data &data, const ground_truth &gt,
+                                 const co_moving_training_options &options)
+{
+    learn(data, make_interval_ground_truth(gt), options);
+}
+
+void co_moving_classifier::co_moving_batch(const array_2d<double> &features, vector<char> &out) const
+{
+    out.resize(features.rows());
+    if (!m_impl) {
+        std::fill(out.begin(), out.end(), 0);
+        return;
+    }
+
+    // May only be used with an input dimension
+    // that equals the training dimension.
+    assert(features.rows() == 0 || features.columns() == m_impl->training_dimension);
+
+    const size_t dim = m_impl->training_dimension;
+    const double *weights = m_impl->weights.data();
+    const double bias = m_impl->bias;
+    for (size_t row = 0; row < features.rows(); ++row) {
+        out[row] = dot(weights, features.data() + row * dim, dim) + bias >= 0;
     }
-    return m_impl->func(sample) >= 0;
 }
 
-void co_moving_classifier::learn(const similarity_data &data, const ground_truth &gt)
+static void check_options(const co_moving_training_options &options)
 {
-    trainer_type trainer;
-    trainer.set_c(1);
+    if (!(options.C > 0)) {
+        throw std::invalid_argument("C must be greater than zero");
+    }
+    if (options.max_negatives < 0) {
+        throw std::invalid_argument("max_negatives must not be negative");
+    }
+}
 
-    vector<sample_type> samples;
-    vector<double> labels;
-    get_learning_data(data, gt, samples, labels);
-    dlib::randomize_samples(samples, labels);
+void co_moving_classifier::learn(const similarity_data &data, const interval_ground_truth &gt,
+                                 const co_moving_training_options &options)
+{
+    check_options(options);
 
-    vector_normalizer norm;
-    normalize(norm, samples);
+    const training_set set = get_learning_data(data, gt, options);
 
     std::unique_ptr<impl> ptr(new impl());
-    ptr->training_dimension = data.feature_dimension;
-    ptr->func.normalizer = norm; // other samples will be normalized, too.
-    ptr->func.function = trainer.train(samples, labels);
-    ptr->sample.set_size(ptr->training_dimension, 1);
+    ptr->training_dimension = set.dimension;
+    ptr->stats = compute_statistics(set);
+    const normalizer norm(ptr->stats);
+    ptr->model = train_svm(set, &norm, shuffled_indices(set.samples.size()), options.C);
+    ptr->fold();
     m_impl = std::move(ptr);
 }
 
+void co_moving_classifier::update(const similarity_data &data, const ground_truth &gt,
+                                  const co_moving_training_options &options)
+{
+    update(data, make_interval_ground_truth(gt), options);
+}
+
+void co_moving_classifier::update(const similarity_data &data, const interval_ground_truth &gt,
+                                  const co_moving_training_options &options)
+{
+    if (!m_impl) {
+        learn(data, gt, options);
+        return;
+    }
+
+    check_options(options);
+    if (size_t(data.feature_dimension) != m_impl->training_dimension) {
+        throw std::invalid_argument("feature dimension of the data (" + std::to_string(data.feature_dimension)
+                                    + ") does not match the classifier (" + std::to_string(m_impl->training_dimension) + ")");
+    }
+
+    const training_set set = get_learning_data(data, gt, options);
+
+    std::unique_ptr<impl> ptr(new impl());
+    ptr->training_dimension = set.dimension;
+    ptr->stats = m_impl->stats;
+    ptr->stats.merge(compute_statistics(set));
+
+    const normalizer old_norm(m_impl->stats);
+    const normalizer norm(ptr->stats);
+    const linear_model initial = renormalize(m_impl->model, old_norm, norm);
+    ptr->model = train_svm(set, &norm, shuffled_indices(set.samples.size()), options.C, &initial);
+    ptr->fold();
+    m_impl = std::move(ptr);
+}
+
+// Converts a classifier stored by older versions.
+void co_moving_classifier::impl::load_legacy(std::istream &i)
+{
+    function_type func;
+    dlib::deserialize(func, i);
+    dlib::deserialize(training_dimension, i);
+
+    // The decision function computes sum_i(alpha_i * dot(sv_i, z)) - b,
+    // i.e. dot(w, z) - b with w = sum_i(alpha_i * sv_i).
+    const auto &df = func.function;
+    model.w.assign(training_dimension, 0.0);
+    for (long k = 0; k < df.basis_vectors.size(); ++k) {
+        const sample_type &sv = df.basis_vectors(k);
+        for (size_t j = 0; j < training_dimension; ++j) {
+            model.w[j] += df.alpha(k) * sv(j);
+        }
+    }
+    model.b = -df.b;
+
+    // The dlib normalizer only stores means and reciprocal standard deviations.
+    // The sample count is unknown, the variances are reconstructed for count == 2.
+    const auto &means = func.normalizer.means();
+    const auto &inv_std_devs = func.normalizer.std_devs();
+    stats.count = 2;
+    stats.means.resize(training_dimension);
+    stats.m2.resize(training_dimension);
+    for (size_t j = 0; j < training_dimension; ++j) {
+        stats.means[j] = means(j);
+        stats.m2[j] = inv_std_devs(j) > 0 ? 1.0 / (inv_std_devs(j) * inv_std_devs(j)) : 0.0;
+    }
+}
+
 void co_moving_classifier::load(std::istream &i)
 {
     i32 version;
     dlib::deserialize(version, i);
-    if (version != VERSION) {
+    if (version != VERSION && version != LEGACY_VERSION) {
         throw std::runtime_error("Serialized classifier has incorrect version " + std::to_string(version)
                                  + ", version must be " + std::to_string(VERSION));
     }
@@ -147,9 +751,17 @@ void co_moving_classifier::load(std::istream &i)
     dlib::deserialize(valid, i);
     if (valid) {
         std::unique_ptr<impl> ptr(new impl());
-        dlib::deserialize(ptr->func, i);
-        dlib::deserialize(ptr->training_dimension, i);
-        ptr->sample.set_size(ptr->training_dimension, 1);
+        if (version == LEGACY_VERSION) {
+            ptr->load_legacy(i);
+        } else {
+            dlib::deserialize(ptr->training_dimension, i);
+            dlib::deserialize(ptr->stats.count, i);
+            dlib::deserialize(ptr->stats.means, i);
+            dlib::deserialize(ptr->stats.m2, i);
+            dlib::deserialize(ptr->model.w, i);
+            dlib::deserialize(ptr->model.b, i);
+        }
+        ptr->fold();
         m_impl = std::move(ptr);
     } else {
         m_impl.reset();
@@ -163,14 +775,292 @@ void co_moving_classifier::save(std::ostream &o) const
     dlib::serialize(valid, o);
 
     if (valid) {
-        dlib::serialize(m_impl->func, o);
         dlib::serialize(m_impl->training_dimension, o);
-        // sample does not need to be stored,
-        // because its value does not matter and its
-        // size equals training_dimension.
+        dlib::serialize(m_impl->stats.count, o);
+        dlib::serialize(m_impl->stats.means, o);
+        dlib::serialize(m_impl->stats.m2, o);
+        dlib::serialize(m_impl->model.w, o);
+        dlib::serialize(m_impl->model.b, o);
+        // The folded weights are not stored,
+        // they are recomputed after loading.
     }
 }
 
+// Pegasos (Shalev-Shwartz et al., 2007) with the bias as an additional feature.
+// The weight vector is represented as w = scale * v, which makes
+// the regularization step O(1).
+//
+// Feature files are sorted by pair, and consecutive samples of the same
+// pair usually share their label. Stochastic gradient descent degenerates
+// on such an input (e.g. all samples of a co-moving pair followed by thousands
+// of non-co-moving ones), so samples pass through a bounded shuffle buffer:
+// once the buffer is full, every new sample replaces a random buffered one,
+// which is then used for the next step.
+// The result is the average of all iterates after the first half epoch,
+// which is much less sensitive to the remaining order effects than the last iterate.
+struct co_moving_online_trainer::state
+{
+    size_t             dimension;
+    double             C;
+    std::mt19937       rng;
+    feature_statistics stats;
+
+    // Warm start: the model (and its normalizer) training starts with.
+    bool           has_initial = false;
+    linear_model   initial;
+    normalizer     initial_norm;
+    i64            initial_count = 0;
+
+    // Initialized by the first call to train().
+    bool           training = false;
+    normalizer     norm;
+    double         lambda = 0;
+    i64            steps = 0;
+    vector<double> v;           // dimension + 1 entries, the last one is the bias.
+    double         scale = 1;
+    double         v_norm2 = 0; // |v|^2
+    vector<double> average;     // Average of all w after the first half epoch.
+    i64            averaged = 0;
+
+    vector<double> z;           // Normalized sample + bias feature.
+
+    size_t         buffer_size;
+    size_t         buffered = 0;
+    vector<double> buffer;      // buffer_size rows with "dimension" features.
+    vector<double> labels;      // buffer_size labels.
+
+    void start_training()
+    {
+        training = true;
+        norm = normalizer(stats);
+        // Pegasos minimizes 0.5 * lambda * |w|^2 + 1 / n * sum_i loss_i,
+        // which has the same minimum as the objective of train_svm() for lambda == 1 / C.
+        lambda = 1.0 / C;
+        v.assign(dimension + 1, 0.0);
+        z.assign(dimension + 1, 1.0);
+        if (has_initial) {
+            // Continue as if the initial model was the result of
+            // one step for every one of its training samples.
+            linear_model w = renormalize(initial, initial_norm, norm);
+            std::copy(w.w.begin(), w.w.end(), v.begin());
+            v[dimension] = w.b;
+            v_norm2 = dot(v.data(), v.data(), v.size());
+            steps = initial_count;
+        }
+        average.assign(dimension + 1, 0.0);
+        buffer.resize(buffer_size * dimension);
+        labels.resize(buffer_size);
+    }
+
+    void add(const double *x, double y)
+    {
+        if (buffered < buffer_size) {
+            std::copy(x, x + dimension, buffer.data() + buffered * dimension);
+            labels[buffered] = y;
+            ++buffered;
+            return;
+        }
+
+        std::uniform_int_distribution<size_t> dist(0, buffer_size - 1);
+        const size_t i = dist(rng);
+        double *slot = buffer.data() + i * dimension;
+        step(slot, labels[i]);
+        std::copy(x, x + dimension, slot);
+        labels[i] = y;
+    }
+
+    void flush()
+    {
+        vector<size_t> order(buffered);
+        for (size_t i = 0; i < buffered; ++i) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        for (size_t i : order) {
+            step(buffer.data() + i * dimension, labels[i]);
+        }
+        buffered = 0;
+    }
+
+    void step(const double *x, double y)
+    {
+        ++steps;
+        const double eta = 1.0 / (lambda * double(steps));
+
+        norm.apply(x, z.data());
+        z[dimension] = 1.0;
+
+        double vz = dot(v.data(), z.data(), z.size());
+        const bool violated = y * scale * vz < 1.0;
+
+        // Regularization: w *= (1 - eta * lambda) == (1 - 1 / steps).
+        if (steps == 1) {
+            std::fill(v.begin(), v.end(), 0.0);
+            scale = 1;
+            v_norm2 = 0;
+            vz = 0;
+        } else {
+            scale *= 1.0 - 1.0 / double(steps);
+        }
+
+        // Subgradient of the hinge loss: w += eta * y * z.
+        if (violated) {
+            const double a = eta * y / scale;
+            for (size_t j = 0; j < z.size(); ++j) {
+                v[j] += a * z[j];
+            }
+            v_norm2 += 2 * a * vz + a * a * dot(z.data(), z.data(), z.size());
+        }
+
+        // Projection onto the ball with radius 1 / sqrt(lambda).
+        const double w_norm2 = scale * scale * v_norm2;
+        if (w_norm2 > 1.0 / lambda) {
+            scale *= std::sqrt(1.0 / (lambda * w_norm2));
+        }
+
+        // Fold the scale into v before it underflows.
+        if (scale < 1e-9) {
+            for (double &value : v) {
+                value *= scale;
+            }
+            v_norm2 *= scale * scale;
+            scale = 1;
+        }
+
+        if (2 * steps > stats.count) {
+            ++averaged;
+            const double f = 1.0 / double(averaged);
+            for (size_t j = 0; j < v.size(); ++j) {
+                average[j] += (scale * v[j] - average[j]) * f;
+            }
+        }
+    }
+
+    // Returns the current weight vector (including the bias).
+    vector<double> weights() const
+    {
+        vector<double> w(v.size());
+        for (size_t j = 0; j < v.size(); ++j) {
+            w[j] = averaged > 0 ? average[j] : scale * v[j];
+        }
+        return w;
+    }
+};
+
+co_moving_online_trainer::co_moving_online_trainer(i32 dimension, double C, u32 seed, size_t buffer_size)
+    : m_state(new state())
+{
+    if (dimension <= 0) {
+        throw std::invalid_argument("dimension must be greater than zero");
+    }
+    if (!(C > 0)) {
+        throw std::invalid_argument("C must be greater than zero");
+    }
+    if (buffer_size == 0) {
+        throw std::invalid_argument("buffer_size must be greater than zero");
+    }
+
+    m_state->dimension = size_t(dimension);
+    m_state->C = C;
+    m_state->rng.seed(seed);
+    m_state->buffer_size = buffer_size;
+    m_state->stats.reset(size_t(dimension));
+}
+
+co_moving_online_trainer::co_moving_online_trainer(const co_moving_classifier &initial,
+                                                   double C, u32 seed, size_t buffer_size)
+    : co_moving_online_trainer(initial.m_impl ? i32(initial.m_impl->training_dimension) : 0, C, seed, buffer_size)
+{
+    const co_moving_classifier::impl &c = *initial.m_impl;
+    m_state->stats = c.stats;
+    m_state->has_initial = true;
+    m_state->initial = c.model;
+    m_state->initial_norm = normalizer(c.stats);
+    m_state->initial_count = c.stats.count;
+}
+
+void co_moving_online_trainer::observe(const similarity_data::pair_data &pair)
+{
+    state &s = *m_state;
+    if (s.training) {
+        throw std::logic_error("observe() must not be called after train()");
+    }
+    assert(pair.features.rows() == 0 || pair.features.columns() == s.dimension);
+
+    for (size_t row = 0; row < pair.features.rows(); ++row) {
+        s.stats.add(pair.features.row(row).begin());
+    }
+}
+
+void co_moving_online_trainer::train(const similarity_data &data,
+                                     const similarity_data::pair_data &pair,
+                                     const interval_ground_truth &gt)
+{
+    state &s = *m_state;
+    if (!s.training) {
+        s.start_training();
+    }
+    assert(pair.features.rows() == 0 || pair.features.columns() == s.dimension);
+
+    const i32 left = gt.device_index(data.devices[pair.left]);
+    const i32 right = gt.device_index(data.devices[pair.right]);
+
+    for (i64 ts = data.begin_timestamp; ts <= data.end_timestamp; ++ts) {
+        i64 row = data.row_at(pair, ts);
+        if (row != -1) {
+            s.add(pair.features.row(size_t(row)).begin(), gt.co_moving_at(ts, left, right) ? 1.0 : -1.0);
+        }
+    }
+}
+
+void co_moving_online_trainer::flush()
+{
+    state &s = *m_state;
+    if (s.training) {
+        s.flush();
+    }
+}
+
+i64 co_moving_online_trainer::observed() const
+{
+    return m_state->stats.count;
+}
+
+co_moving_classifier co_moving_online_trainer::classifier() const
+{
+    const state &s = *m_state;
+
+    std::unique_ptr<co_moving_classifier::impl> ptr(new co_moving_classifier::impl());
+    ptr->training_dimension = s.dimension;
+    ptr->stats = s.stats;
+    ptr->model.w.assign(s.dimension, 0.0);
+    if (s.training) {
+        vector<double> w = s.weights();
+        std::copy(w.begin(), w.begin() + s.dimension, ptr->model.w.begin());
+        ptr->model.b = w[s.dimension];
+    } else if (s.has_initial) {
+        ptr->model = renormalize(s.initial, s.initial_norm, normalizer(s.stats));
+    }
+    ptr->fold();
+
+    co_moving_classifier c;
+    c.m_impl = std::move(ptr);
+    return c;
+}
+
+co_moving_online_trainer::co_moving_online_trainer(co_moving_online_trainer &&other)
+    : m_state(std::move(other.m_state))
+{}
+
+co_moving_online_trainer::~co_moving_online_trainer()
+{}
+
+co_moving_online_trainer& co_moving_online_trainer::operator =(co_moving_online_trainer &&other)
+{
+    m_state = std::move(other.m_state);
+    return *this;
+}
+
 co_moving_classifier::co_moving_classifier()
     : m_impl()
 {}
@@ -0,0 +1,544 @@
+#include "mp/device_graph.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace mp {
+
+void device_graph::assign(i32 num_vertices, array_view<const following_data::pair_data> pairs)
+{
+    assert(num_vertices >= 0);
+    m_num_vertices = num_vertices;
+
+    m_edges.clear();
+    for (const auto &pair : pairs) {
+        assert(pair.left >= 0 && pair.left < num_vertices);
+        assert(pair.right >= 0 && pair.right < num_vertices);
+
+        const double weight = std::abs(pair.lag);
+        switch (pair.type) {
+        case following_type::following:
+            m_edges.push_back({pair.left, pair.right, weight});
+            break;
+        case following_type::leading:
+            m_edges.push_back({pair.right, pair.left, weight});
+            break;
+        case following_type::co_leading:
+            m_edges.push_back({pair.left, pair.right, weight});
+            m_edges.push_back({pair.right, pair.left, weight});
+            break;
+        }
+    }
+
+    // Counting sort by source (out-edges) and by target (in-edges).
+    // Both are stable, thus edges keep their relative order.
+    const size_t n = static_cast<size_t>(num_vertices);
+    m_out_offsets.assign(n + 1, 0);
+    m_in_offsets.assign(n + 1, 0);
+    for (const edge &e : m_edges) {
+        ++m_out_offsets[e.source + 1];
+        ++m_in_offsets[e.target + 1];
+    }
+    for (size_t v = 0; v < n; ++v) {
+        m_out_offsets[v + 1] += m_out_offsets[v];
+        m_in_offsets[v + 1] += m_in_offsets[v];
+    }
+
+    m_targets.resize(m_edges.size());
+    m_out_weights.resize(m_edges.size());
+    m_sources.resize(m_edges.size());
+    m_in_weights.resize(m_edges.size());
+
+    // The offsets are used as insertion cursors and restored afterwards:
+    // after the loop, offsets[v] is the old value of offsets[v + 1].
+    for (const edge &e : m_edges) {
+        size_t out = m_out_offsets[e.source]++;
+        m_targets[out] = e.target;
+        m_out_weights[out] = e.weight;
+
+        size_t in = m_in_offsets[e.target]++;
+        m_sources[in] = e.source;
+        m_in_weights[in] = e.weight;
+    }
+    for (size_t v = n; v > 0; --v) {
+        m_out_offsets[v] = m_out_offsets[v - 1];
+        m_in_offsets[v] = m_in_offsets[v - 1];
+    }
+    m_out_offsets[0] = 0;
+    m_in_offsets[0] = 0;
+}
+
+// Scales the ranks to a sum of 1. Returns false if that is not possible,
+// i.e. if a rank is negative or not finite or if all ranks are zero.
+static bool normalize_ranks(vector<double> &ranks)
+{
+    double sum = 0;
+    for (double r : ranks) {
+        if (!std::isfinite(r) || r < 0) {
+            return false;
+        }
+        sum += r;
+    }
+    if (!(sum > 0)) {
+        return false;
+    }
+    for (double &r : ranks) {
+        r /= sum;
+    }
+    return true;
+}
+
+void page_rank_engine::assign(const device_graph &g, bool use_weights)
+{
+    const i32 n = g.num_vertices();
+    m_num_vertices = n;
+
+    // The total weight of every vertex's outgoing edges (temporarily stored in m_next).
+    m_next.resize(static_cast<size_t>(n));
+    m_sinks.clear();
+    m_is_sink.assign(static_cast<size_t>(n), 0);
+    for (i32 v = 0; v < n; ++v) {
+        double total = 0;
+        for (double w : g.out_weights(v)) {
+            total += use_weights ? w : 1.0;
+        }
+        m_next[v] = total;
+        if (g.out_degree(v) == 0) {
+            m_sinks.push_back(v);
+            m_is_sink[v] = 1;
+        }
+    }
+
+    m_offsets.resize(static_cast<size_t>(n) + 1);
+    m_offsets[0] = 0;
+    m_sources.clear();
+    m_coefficients.clear();
+    for (i32 v = 0; v < n; ++v) {
+        // Sources of incoming edges give the current vertex a part of their
+        // rank, according to the edge's weight.
+        auto sources = g.in_sources(v);
+        auto weights = g.in_weights(v);
+        for (size_t i = 0; i < sources.size(); ++i) {
+            const i32 u = sources[i];
+            m_sources.push_back(u);
+            m_coefficients.push_back((use_weights ? weights[i] : 1.0) / m_next[u]);
+        }
+        m_offsets[v + 1] = m_sources.size();
+    }
+}
+
+i32 page_rank_engine::run(double damping, double error, i32 max_iterations,
+                          vector<double> &ranks, bool warm_start,
+                          page_rank_method method)
+{
+    const i32 n = m_num_vertices;
+    const size_t size = static_cast<size_t>(n);
+    if (n == 0) {
+        ranks.clear();
+        return 0;
+    }
+
+    // The start rank of every vertex is 1/n, unless a usable start vector was given.
+    if (!warm_start || ranks.size() != size || !normalize_ranks(ranks)) {
+        ranks.assign(size, 1.0 / n);
+    }
+
+    // Like the stop condition used with the generic page_rank(), max_iterations
+    // counts the checks (including the one before the first iteration),
+    // thus at most max_iterations - 1 iterations are performed.
+    const i32 max_steps = max_iterations - 1;
+    switch (method) {
+    case page_rank_method::power:
+        return run_power(damping, error, max_steps, ranks);
+    case page_rank_method::gauss_seidel:
+        return run_gauss_seidel(damping, error, max_steps, ranks);
+    case page_rank_method::extrapolation:
+        return run_extrapolation(damping, error, max_steps, ranks);
+    }
+    throw std::invalid_argument("invalid page rank method");
+}
+
+double page_rank_engine::power_step(double damping, const double *rank, double *next) const
+{
+    const i32 n = m_num_vertices;
+    const size_t *offsets = m_offsets.data();
+    const i32 *sources = m_sources.data();
+    const double *coefficients = m_coefficients.data();
+
+    // Sinks (vertices without outgoing edges) distribute their rank evenly,
+    // this part is the same for every vertex.
+    double sink_rank = 0;
+    for (i32 v : m_sinks) {
+        sink_rank += rank[v];
+    }
+    const double base = (1.0 - damping) / n + damping * (sink_rank / n);
+
+    double err = 0;
+    for (i32 v = 0; v < n; ++v) {
+        double r = 0;
+        for (size_t e = offsets[v], end = offsets[v + 1]; e < end; ++e) {
+            r += coefficients[e] * rank[sources[e]];
+        }
+        const double value = base + damping * r;
+        const double diff = value - rank[v];
+        err += diff * diff;
+        next[v] = value;
+    }
+    return err;
+}
+
+i32 page_rank_engine::run_power(double damping, double error, i32 max_steps, vector<double> &ranks)
+{
+    const size_t size = ranks.size();
+    m_next.resize(size);
+
+    double *rank = ranks.data();
+    double *next = m_next.data();
+
+    // Stop if the maximum number of iterations has been reached
+    // or the euclidean distance to the last result is small enough.
+    i32 iterations = 0;
+    while (iterations < max_steps) {
+        const double err = power_step(damping, rank, next);
+        std::swap(rank, next);
+        ++iterations;
+        if (std::sqrt(err) <= error) {
+            break;
+        }
+    }
+
+    if (rank != ranks.data()) {
+        std::copy(rank, rank + size, ranks.begin());
+    }
+    return iterations;
+}
+
+i32 page_rank_engine::run_gauss_seidel(double damping, double error, i32 max_steps, vector<double> &ranks)
+{
+    const i32 n = m_num_vertices;
+    const size_t *offsets = m_offsets.data();
+    const i32 *sources = m_sources.data();
+    const double *coefficients = m_coefficients.data();
+    double *rank = ranks.data();
+
+    // The ranks are updated in place, every vertex uses the new ranks
+    // of the vertices before it. The total rank of the sinks is kept up to date.
+    // The ranks are rescaled to a sum of 1 after every sweep: without that,
+    // the error of the total would only decrease by the damping factor per sweep.
+    i32 iterations = 0;
+    while (iterations < max_steps) {
+        double sink_rank = 0;
+        for (i32 v : m_sinks) {
+            sink_rank += rank[v];
+        }
+
+        double err = 0;
+        double sum = 0;
+        for (i32 v = 0; v < n; ++v) {
+            double r = 0;
+            for (size_t e = offsets[v], end = offsets[v + 1]; e < end; ++e) {
+                r += coefficients[e] * rank[sources[e]];
+            }
+            const double value = (1.0 - damping) / n + damping * (sink_rank / n + r);
+            const double diff = value - rank[v];
+            err += diff * diff;
+            sum += value;
+            if (m_is_sink[v]) {
+                sink_rank += diff;
+            }
+            rank[v] = value;
+        }
+        if (sum > 0) {
+            for (i32 v = 0; v < n; ++v) {
+                rank[v] /= sum;
+            }
+        }
+        ++iterations;
+        if (std::sqrt(err) <= error) {
+            break;
+        }
+    }
+    return iterations;
+}
+
+i32 page_rank_engine::run_extrapolation(double damping, double error, i32 max_steps, vector<double> &ranks)
+{
+    const size_t size = ranks.size();
+    m_next.resize(size);
+    m_last.resize(size);
+    m_oldest.resize(size);
+
+    // x0, ..., x3 are the four most recent iterates (x3 is the newest).
+    // Every power step overwrites the oldest one.
+    double *x0 = m_oldest.data();
+    double *x1 = m_last.data();
+    double *x2 = m_next.data();
+    double *x3 = ranks.data();
+
+    i32 iterations = 0;
+    i32 since_extrapolation = 0;
+    while (iterations < max_steps) {
+        const double err = power_step(damping, x3, x0);
+        double *oldest = x0;
+        x0 = x1;
+        x1 = x2;
+        x2 = x3;
+        x3 = oldest;
+        ++iterations;
+        ++since_extrapolation;
+        if (std::sqrt(err) <= error) {
+            break;
+        }
+
+        if (since_extrapolation >= extrapolation_interval) {
+            since_extrapolation = 0;
+            extrapolate(x0, x1, x2, x3, size);
+        }
+    }
+
+    if (x3 != ranks.data()) {
+        std::copy(x3, x3 + size, ranks.begin());
+    }
+    return iterations;
+}
+
+void page_rank_engine::extrapolate(const double *x0, const double *x1, const double *x2, double *x3, size_t size)
+{
+    // Quadratic extrapolation (Kamvar et al., "Extrapolation Methods for Accelerating PageRank Computations"):
+    // Assume that x0 is a combination of the first three eigenvectors of the iteration matrix.
+    // The coefficients g1, g2 of the characteristic polynomial are the least squares solution of
+    // [y1 y2] * (g1, g2) = -y3, where yi = xi - x0.
+    double a11 = 0, a12 = 0, a22 = 0, b1 = 0, b2 = 0;
+    for (size_t v = 0; v < size; ++v) {
+        const double y1 = x1[v] - x0[v];
+        const double y2 = x2[v] - x0[v];
+        const double y3 = x3[v] - x0[v];
+        a11 += y1 * y1;
+        a12 += y1 * y2;
+        a22 += y2 * y2;
+        b1 += y1 * y3;
+        b2 += y2 * y3;
+    }
+    const double det = a11 * a22 - a12 * a12;
+    if (!(std::abs(det) > 0) || !std::isfinite(det)) {
+        return;
+    }
+    const double g1 = -(a22 * b1 - a12 * b2) / det;
+    const double g2 = -(a11 * b2 - a12 * b1) / det;
+    const double beta0 = g1 + g2 + 1;
+    const double beta1 = g2 + 1;
+
+    // The extrapolation is discarded if it does not produce a valid distribution.
+    double sum = 0;
+    for (size_t v = 0; v < size; ++v) {
+        const double value = beta0 * x1[v] + beta1 * x2[v] + x3[v];
+        if (!(value >= 0) || !std::isfinite(value)) {
+            return;
+        }
+        sum += value;
+    }
+    if (!(sum > 0)) {
+        return;
+    }
+    for (size_t v = 0; v < size; ++v) {
+        x3[v] = (beta0 * x1[v] + beta1 * x2[v] + x3[v]) / sum;
+    }
+}
+
+i32 page_rank(const device_graph &g, bool use_weights,
+              double damping, double error, i32 max_iterations,
+              vector<double> &ranks, bool warm_start,
+              page_rank_method method)
+{
+    page_rank_engine engine;
+    engine.assign(g, use_weights);
+    return engine.run(damping, error, max_iterations, ranks, warm_start, method);
+}
+
+i32 connected_components(const device_graph &g, vector<i32> &components, vector<i32> &stack)
+{
+    const i32 n = g.num_vertices();
+    components.assign(static_cast<size_t>(n), -1);
+    stack.clear();
+
+    i32 count = 0;
+    for (i32 root = 0; root < n; ++root) {
+        if (components[root] != -1) {
+            continue;
+        }
+
+        // Depth first search, edge directions are ignored.
+        const i32 c = count++;
+        components[root] = c;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const i32 v = stack.back();
+            stack.pop_back();
+
+            auto visit = [&](i32 w) {
+                if (components[w] == -1) {
+                    components[w] = c;
+                    stack.push_back(w);
+                }
+            };
+            for (i32 w : g.out_targets(v)) {
+                visit(w);
+            }
+            for (i32 w : g.in_sources(v)) {
+                visit(w);
+            }
+        }
+    }
+    return count;
+}
+
+i32 component_leaders::find(const device_graph &g, bool use_weights,
+                            double damping, double error, i32 max_iterations,
+                            vector<double> &ranks, vector<i32> &leaders,
+                            bool warm_start, page_rank_method method)
+{
+    const i32 n = g.num_vertices();
+    const size_t size = static_cast<size_t>(n);
+    if (!warm_start || ranks.size() != size) {
+        ranks.assign(size, 0.0);
+    }
+    leaders.clear();
+
+    // Union-find over all edges. The root of every tree is its smallest vertex.
+    m_parent.resize(size);
+    for (i32 v = 0; v < n; ++v) {
+        m_parent[v] = v;
+    }
+    for (i32 v = 0; v < n; ++v) {
+        for (i32 w : g.out_targets(v)) {
+            i32 a = find_root(v);
+            i32 b = find_root(w);
+            if (a < b) {
+                m_parent[b] = a;
+            } else if (b < a) {
+                m_parent[a] = b;
+            }
+        }
+    }
+
+    // Number the components in the order of their smallest vertex
+    // and group the vertices of every component (in ascending order).
+    m_component.resize(size);
+    m_local.resize(size);
+    m_offsets.assign(1, 0);
+    i32 count = 0;
+    for (i32 v = 0; v < n; ++v) {
+        const i32 root = find_root(v);
+        if (root == v) {
+            m_component[v] = count++;
+            m_offsets.push_back(0);
+        } else {
+            m_component[v] = m_component[root];
+        }
+        m_local[v] = static_cast<i32>(m_offsets[m_component[v] + 1]++);
+    }
+    for (i32 c = 0; c < count; ++c) {
+        m_offsets[c + 1] += m_offsets[c];
+    }
+    m_vertices.resize(size);
+    for (i32 v = 0; v < n; ++v) {
+        m_vertices[m_offsets[m_component[v]] + static_cast<size_t>(m_local[v])] = v;
+    }
+
+    i32 iterations = 0;
+    for (i32 c = 0; c < count; ++c) {
+        const i32 *begin = m_vertices.data() + m_offsets[c];
+        const i32 *end = m_vertices.data() + m_offsets[c + 1];
+        array_view<const i32> vertices(begin, end);
+
+        iterations += solve_component(g, use_weights, damping, error, max_iterations,
+                                      vertices, ranks, warm_start, method);
+
+        // Ties are resolved in favor of the last vertex.
+        i32 leader = vertices[0];
+        for (i32 v : vertices) {
+            if (ranks[v] >= ranks[leader]) {
+                leader = v;
+            }
+        }
+        leaders.push_back(leader);
+    }
+    return iterations;
+}
+
+i32 component_leaders::find_root(i32 v)
+{
+    // Path halving.
+    while (m_parent[v] != v) {
+        m_parent[v] = m_parent[m_parent[v]];
+        v = m_parent[v];
+    }
+    return v;
+}
+
+i32 component_leaders::solve_component(const device_graph &g, bool use_weights,
+                                       double damping, double error, i32 max_iterations,
+                                       array_view<const i32> vertices, vector<double> &ranks,
+                                       bool warm_start, page_rank_method method)
+{
+    // Within a component, PageRank is a multiple of (I - damping * P^T)^-1 * 1,
+    // where P is the transition matrix of the component.
+    if (vertices.size() == 1) {
+        ranks[vertices[0]] = 1.0;
+        return 0;
+    }
+    if (vertices.size() == 2) {
+        // All edges of a vertex lead to the other vertex (unless there are self loops),
+        // thus edge weights are irrelevant: if only one vertex has outgoing edges,
+        // its rank is 1 and the other's rank is 1 + damping. Otherwise, both are equal.
+        const i32 a = vertices[0];
+        const i32 b = vertices[1];
+        auto only_leads_to = [&](i32 from, i32 to) -> bool {
+            for (i32 w : g.out_targets(from)) {
+                if (w != to) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        if (only_leads_to(a, b) && only_leads_to(b, a)) {
+            const bool a_out = g.out_degree(a) > 0;
+            const bool b_out = g.out_degree(b) > 0;
+            const double ra = b_out && !a_out ? 1.0 + damping : 1.0;
+            const double rb = a_out && !b_out ? 1.0 + damping : 1.0;
+            ranks[a] = ra / (ra + rb);
+            ranks[b] = rb / (ra + rb);
+            return 0;
+        }
+    }
+
+    // General case: PageRank on the subgraph induced by the component.
+    m_pairs.clear();
+    for (i32 v : vertices) {
+        auto targets = g.out_targets(v);
+        auto weights = g.out_weights(v);
+
+        double total = 0;
+        for (double w : weights) {
+            total += w;
+        }
+        for (size_t i = 0; i < targets.size(); ++i) {
+            double weight = use_weights && total > 0 ? weights[i] : 1.0;
+            m_pairs.push_back({m_local[v], m_local[targets[i]], weight, following_type::following});
+        }
+    }
+    m_graph.assign(static_cast<i32>(vertices.size()), m_pairs);
+
+    m_ranks.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        m_ranks[i] = ranks[vertices[i]];
+    }
+    m_engine.assign(m_graph, use_weights);
+    const i32 iterations = m_engine.run(damping, error, max_iterations, m_ranks, warm_start, method);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        ranks[vertices[i]] = m_ranks[i];
+    }
+    return iterations;
+}
+
+} // namespace mp
@@ -13,6 +13,7 @@
 namespace mp {
 
 using pair_list = vector<tuple<i32, i32>>;
+using candidate_list = vector<candidate_pair>;
 
 namespace {
 
@@ -27,7 +28,7 @@ struct similarity_computation
 {
 public:
     similarity_computation(const tracing_data &td,
-                           const pair_list &pairs,
+                           const candidate_list &pairs,
                            const feature_computation &settings,
                            similarity_data &result)
         : td(td)
@@ -63,18 +64,29 @@ public:
         }
 
         // Initialize every pair.
-        result.pairs.resize(num_pairs);
-        for (i32 i = 0; i < num_pairs; ++i) {
-            auto &npair = result.pairs[i];
-            auto &opair = pairs[i];
-
-            npair.left = get<0>(opair);
-            npair.right = get<1>(opair);
-            npair.features.resize(duration, feature_dimension, 0.0);
+        // Pairs without any timestamps in [begin_timestamp, end_timestamp]
+        // (or whose devices are never active at the same time) are skipped.
+        result.pairs.reserve(num_pairs);
+        for (auto &opair : pairs) {
+            similarity_data::pair_data npair;
+            npair.left = opair.left;
+            npair.right = opair.right;
 
             assert(npair.left >= 0 && npair.left < num_devices);
             assert(npair.right >= 0 && npair.right < num_devices);
+
+            i64 rows = init_segments(opair, npair.segments);
+            if (rows == 0) {
+                continue;
+            }
+            if (rows == duration) {
+                // Covers the entire time range, store densely.
+                npair.segments.clear();
+            }
+            npair.features.resize(rows, feature_dimension, 0.0);
+            result.pairs.push_back(std::move(npair));
         }
+        num_pairs = result.pairs.size();
 
         i32 threads_used = std::min(threads, num_pairs);
         if (threads_used > 1) {
@@ -85,6 +97,37 @@ public:
     }
 
 private:
+    // Clips the time ranges of the candidate pair to [begin_timestamp, end_timestamp]
+    // and to the time span in which both devices are active.
+    // The clipped ranges are stored as segments.
+    // Returns the total number of rows required by the segments.
+    i64 init_segments(const candidate_pair &pair, vector<similarity_data::segment> &segments)
+    {
+        const auto &left = td.devices[pair.left];
+        const auto &right = td.devices[pair.right];
+        if (left.empty() || right.empty()) {
+            return 0;
+        }
+
+        const i64 span_begin = std::max({begin_timestamp, left.begin_timestamp, right.begin_timestamp});
+        const i64 span_end = std::min({end_timestamp, left.end_timestamp, right.end_timestamp});
+
+        i64 rows = 0;
+        for (auto &range : pair.ranges) {
+            i64 begin = std::max(get<0>(range), span_begin);
+            i64 end = std::min(get<1>(range), span_end);
+            if (begin > end) {
+                continue;
+            }
+
+            assert((segments.empty() || segments.back().end < begin)
+                   && "Ranges are sorted and do not overlap");
+            segments.push_back({begin, end, rows});
+            rows += end - begin + 1;
+        }
+        return rows;
+    }
+
     // Run the similarity algorithm in parallel using "threads_used" threads.
     // The set of all pairs will be partioned into blocks of (approx.) equal size
     // and computed in parallel.
@@ -146,8 +189,26 @@ private:
                       const tracing_data::device_data &right,
                       similarity_data::pair_data &pair)
     {
-        for (i64 ts = begin_timestamp; ts <= end_timestamp; ++ts) {
-            auto result_row = result.feature_at(pair, ts);
+        if (pair.segments.empty()) {
+            compute_range(sim, left, right, begin_timestamp, end_timestamp, 0, pair);
+        } else {
+            for (auto &seg : pair.segments) {
+                compute_range(sim, left, right, seg.begin, seg.end, seg.row, pair);
+            }
+        }
+    }
+
+    // Computes the feature vectors for all timestamps in [begin, end].
+    // The result for "begin" will be stored in "first_row".
+    void compute_range(Similarity &sim,
+                       const tracing_data::device_data &left,
+                       const tracing_data::device_data &right,
+                       i64 begin, i64 end, i64 first_row,
+                       similarity_data::pair_data &pair)
+    {
+        i64 row = first_row;
+        for (i64 ts = begin; ts <= end; ++ts, ++row) {
+            auto result_row = pair.features.row(row);
 
             i32 lag = -time_lag;
             for (size_t i = 0; lag <= time_lag; ++lag, ++i) {
@@ -158,7 +219,7 @@ private:
 
 public:
     const tracing_data &td;
-    const pair_list &pairs;
+    const candidate_list &pairs;
     const i32 time_lag;
     const i32 window_size;
     const i32 threads;
@@ -250,6 +311,11 @@ public:
                 }
             }
 
+            // Neither device has data at this timestamp: distance 0.
+            if (n == 0) {
+                continue;
+            }
+
             array_view<const double> lview(left_buf.data(), n);
             array_view<const double> rview(right_buf.data(), n);
             result += euclidean_distance(lview, rview);
@@ -427,6 +493,11 @@ public:
             }
         }
 
+        // Neither device has data at this timestamp: all distances are 0.
+        if (n == 0) {
+            return 0.0;
+        }
+
         table_view left_view{left_buf, n};
         table_view right_view{right_buf, n};
         return norm_factor * d.run(left_view, right_view, euclidean_distance);
@@ -455,7 +526,7 @@ void check(bool cond, Func &&otherwise)
 
 template<typename Similarity>
 similarity_data run_similarity(const tracing_data &td,
-                               const pair_list &pairs,
+                               const candidate_list &pairs,
                                const feature_computation &settings)
 {
     check(settings.time_lag >= 0,   []{ throw std::logic_error("Time lag must be >= 0"); });
@@ -476,22 +547,55 @@ similarity_data run_similarity(const tracing_data &td,
     return result;
 }
 
+// Every pair is a candidate for the entire time range of the computation.
+candidate_list all_timestamps(const pair_list &pairs, const feature_computation &settings)
+{
+    candidate_list result;
+    result.reserve(pairs.size());
+    for (auto &pair : pairs) {
+        candidate_pair c;
+        c.left = get<0>(pair);
+        c.right = get<1>(pair);
+        c.ranges.push_back(make_tuple(settings.begin_timestamp, settings.end_timestamp));
+        result.push_back(std::move(c));
+    }
+    return result;
+}
+
 } // namespace
 
 similarity_data feature_computation::compute_euclid(const tracing_data &td,
                                                     const pair_list &pairs)
 {
-    return run_similarity<euclid_similarity>(td, pairs, *this);
+    return run_similarity<euclid_similarity>(td, all_timestamps(pairs, *this), *this);
 }
 
 similarity_data feature_computation::compute_dtw(const tracing_data &td,
                                                  const pair_list &pairs)
 {
-    return run_similarity<dtw_similarity>(td, pairs, *this);
+    return run_similarity<dtw_similarity>(td, all_timestamps(pairs, *this), *this);
 }
 
 similarity_data feature_computation::compute_multi_dtw(const tracing_data &td,
                                                        const pair_list &pairs)
+{
+    return run_similarity<multi_dtw_similarity>(td, all_timestamps(pairs, *this), *this);
+}
+
+similarity_data feature_computation::compute_euclid(const tracing_data &td,
+                                                    const candidate_list &pairs)
+{
+    return run_similarity<euclid_similarity>(td, pairs, *this);
+}
+
+similarity_data feature_computation::compute_dtw(const tracing_data &td,
+                                                 const candidate_list &pairs)
+{
+    return run_similarity<dtw_similarity>(td, pairs, *this);
+}
+
+similarity_data feature_computation::compute_multi_dtw(const tracing_data &td,
+                                                       const candidate_list &pairs)
 {
     return run_similarity<multi_dtw_similarity>(td, pairs, *this);
 }
@@ -6,6 +6,7 @@
 #include "mp/co_moving_detection.hpp"
 #include "mp/feature_computation.hpp"
 #include "mp/tools/iter.hpp"
+#include "mp/tools/parallel.hpp"
 
 namespace mp {
 
@@ -69,7 +70,7 @@ following_type time_lag_estimation::get_following_type(double est_lag)
     }
 }
 
-following_data classify(co_moving_classifier &c, const similarity_data &data)
+following_data classify(const co_moving_classifier &c, const similarity_data &data, i32 threads)
 {
     const i32 time_lag = (data.feature_dimension - 1) / 2;
 
@@ -80,26 +81,60 @@ following_data classify(co_moving_classifier &c, const similarity_data &data)
     result.begin_timestamp = data.begin_timestamp;
     result.end_timestamp = data.end_timestamp;
     result.duration = data.duration;
-    result.timestamps.resize(static_cast<size_t>(data.duration));
-    for (size_t i = 0; i < result.timestamps.size(); ++i) {
-        result.timestamps[i].timestamp = result.begin_timestamp + i64(i);
+    result.clear();
+
+    // Classify all feature vectors of every pair at once.
+    vector<vector<char>> co_moving_rows(data.pairs.size());
+    parallel_for(threads, data.pairs.size(), [&](size_t p) {
+        c.co_moving_batch(data.pairs[p].features, co_moving_rows[p]);
+    });
+
+    // Returns the feature row of pair p at ts if the pair is co-moving, -1 otherwise.
+    // Pairs that have been pruned at this timestamp are not co-moving.
+    auto co_moving_row = [&](size_t p, i64 ts) -> i64 {
+        i64 row = data.row_at(data.pairs[p], ts);
+        return row != -1 && co_moving_rows[p][size_t(row)] ? row : -1;
+    };
+
+    // Count the co-moving pairs of every timestamp and compute the offsets.
+    const size_t timestamps = static_cast<size_t>(data.duration);
+    parallel_for(threads, timestamps, [&](size_t index) {
+        const i64 ts = data.begin_timestamp + i64(index);
+        size_t count = 0;
+        for (size_t p = 0; p < data.pairs.size(); ++p) {
+            count += co_moving_row(p, ts) != -1;
+        }
+        result.offsets[index + 1] = count;
+    });
+    for (size_t i = 0; i < timestamps; ++i) {
+        result.offsets[i + 1] += result.offsets[i];
     }
+    result.pairs.resize(result.offsets[timestamps]);
+
+    // Every thread fills the results for a contiguous block of timestamps.
+    // Pairs are visited in order, thus the co-moving entries
+    // of every timestamp are ordered by pair index.
+    parallel_for(threads, timestamps, [&](size_t index) {
+        time_lag_estimation est(time_lag);
+
+        const i64 ts = data.begin_timestamp + i64(index);
+        size_t out = result.offsets[index];
+        for (size_t p = 0; p < data.pairs.size(); ++p) {
+            i64 row = co_moving_row(p, ts);
+            if (row == -1) {
+                continue;
+            }
 
-    time_lag_estimation est(time_lag);
-    for (i64 ts = data.begin_timestamp; ts <= data.end_timestamp; ++ts) {
-        for (auto &pair : data.pairs) {
-            auto feature = data.feature_at(pair, ts);
             // Pair (left, right) is co-moving at ts.
             // Classify its following type and store the result.
-            if (c.co_moving(feature)) {
-                double est_lag = est.estimate_lag_complex(feature);
-                following_type type = est.get_following_type(est_lag);
-
-                auto &co_moving = result.data_at(ts).co_moving;
-                co_moving.push_back({pair.left, pair.right, est_lag, type});
-            }
+            const auto &pair = data.pairs[p];
+            auto feature = pair.features.row(size_t(row));
+            double est_lag = est.estimate_lag_complex(feature);
+            following_type type = est.get_following_type(est_lag);
+            result.pairs[out++] = {pair.left, pair.right, est_lag, type};
         }
-    }
+        assert(out == result.offsets[index + 1]);
+    });
 
     return result;
 }
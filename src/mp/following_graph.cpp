@@ -1,14 +1,19 @@
 #include "mp/following_graph.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <sstream>
 #include <unordered_map>
 #include <type_traits>
 
+#include <boost/functional/hash.hpp>
 #include <boost/graph/connected_components.hpp>
 #include <pugixml/pugixml.hpp>
 
+#include "mp/device_graph.hpp"
 #include "mp/following_detection.hpp"
-#include "mp/page_rank.hpp"
+#include "mp/tools/parallel.hpp"
 
 namespace mp {
 
@@ -38,7 +43,7 @@ following_graph following_graph_at(const following_data &f, i64 timestamp)
 
     // The data at "timestamp" can be thought of as
     // the list of edges for the result graph.
-    auto &data = f.data_at(timestamp);
+    auto data = f.data_at(timestamp);
     for (auto &pair : data.co_moving) {
         auto left = get_vertex(pair.left);
         auto right = get_vertex(pair.right);
@@ -63,6 +68,24 @@ following_graph following_graph_at(const following_data &f, i64 timestamp)
     return g;
 }
 
+following_graph following_graph_at(const following_window &w)
+{
+    const following_data &f = w.data();
+
+    following_graph g;
+    for (const auto &device : f.devices) {
+        add_vertex(vertex_data{device}, g);
+    }
+    for (const auto &edge : w.edges()) {
+        edge_data d;
+        d.weight = edge.lag;
+        add_edge(vertex(static_cast<size_t>(edge.left), g),
+                 vertex(static_cast<size_t>(edge.right), g),
+                 d, g);
+    }
+    return g;
+}
+
 // Takes a following graph as input
 // and computes the set of connected components.
 // The edges and vertices of the following_graph must not be modified
@@ -131,94 +154,34 @@ private:
     vector<int> vertex_components;
 };
 
-// Stop condition for the PageRank algorithm.
-// The algorithm will stop running if
-// a) the absolute error (as measured by euclidean distance) is smaller
-//    than "error" or
-// b) the maximum number of iterations has been reached (as specified by "limit").
-template<typename LastResultMap>
-struct page_rank_stop
-{
-    page_rank_stop(double error, int limit, LastResultMap last)
-        : counter(0)
-        , limit(limit)
-        , error(error)
-        , last(last)
-    {}
-
-    int counter;
-    int limit;
-    double error;
-    LastResultMap last;
-
-    template<typename RankMap, typename Graph>
-    bool operator()(const RankMap &result, const Graph &g)
-    {
-        if (++counter >= limit) {
-            return true;
-        }
-
-        double err = 0.0;
-        for (auto vertex : make_iter_range(vertices(g))) {
-            double rank = get(result, vertex);
-            double last_rank = get(last, vertex);
-            double diff = rank - last_rank;
-
-            err += diff * diff;
-            put(last, vertex, rank);
-        }
-        return std::sqrt(err) <= error;
-    }
-};
+// Parameters of the PageRank algorithm used for leader detection.
+static constexpr double error = 0.000001;
+static constexpr double damping_factor = 0.85;
+static constexpr int    max_iterations = 500;
 
 vector<string> detect_leaders(const following_graph &g, bool use_weights)
 {
-    static constexpr double error = 0.000001;
-    static constexpr double damping_factor = 0.85;
-    static constexpr int    max_iterations = 500;
-
-    // Run PageRank
-    vector<double> ranks(num_vertices(g));
-    auto rank_map = boost::make_iterator_property_map(
-                ranks.begin(), get(boost::vertex_index, g));
-    {
-        vector<double> last_ranks(ranks);
-        auto last_rank_map = boost::make_iterator_property_map(
-                    last_ranks.begin(), get(boost::vertex_index, g));
-        // All edges have the same weight for now.
-        auto stop = page_rank_stop<decltype(last_rank_map)>(
-                    error, max_iterations, last_rank_map);
-
-        if (use_weights) {
-            auto weight_map = get(&edge_data::weight, g);
-            page_rank(g, rank_map, damping_factor, weight_map, stop);
-        } else {
-            auto weight_map = boost::make_static_property_map<
-                    following_graph::edge_descriptor, double>(1.0);
-            page_rank(g, rank_map, damping_factor, weight_map, stop);
-        }
+    // The edge list of the following graph, as pairs of vertex indices.
+    vector<following_data::pair_data> pairs;
+    pairs.reserve(num_edges(g));
+    for (auto edge : make_iter_range(edges(g))) {
+        i32 s = static_cast<i32>(get(boost::vertex_index, g, source(edge, g)));
+        i32 t = static_cast<i32>(get(boost::vertex_index, g, target(edge, g)));
+        pairs.push_back({s, t, g[edge].weight, following_type::following});
     }
 
-    // Find leaders by taking the node with the hightest
-    // PageRank value in each connected component.
-    vector<string> leaders;
-    graph_components c(g);
-    for (int i = 0; i < c.components(); ++i) {
-        double max_rank = 0;
-        following_graph::vertex_descriptor max_vertex{};
+    device_graph dg;
+    dg.assign(static_cast<i32>(num_vertices(g)), pairs);
 
-        for (auto vertex : make_iter_range(vertices(g))) {
-            if (c.component_of(vertex) == i) {
-                double rank = get(rank_map, vertex);
-                if (rank >= max_rank) {
-                    max_rank = rank;
-                    max_vertex = vertex;
-                }
-            }
-        }
-        // There is at least one vertex in each component,
-        // thus max_vertex is valid.
-        leaders.push_back(g[max_vertex].name);
+    vector<double> ranks;
+    vector<i32> leader_vertices;
+    component_leaders finder;
+    finder.find(dg, use_weights, damping_factor, error, max_iterations, ranks, leader_vertices);
+
+    vector<string> leaders;
+    leaders.reserve(leader_vertices.size());
+    for (i32 v : leader_vertices) {
+        leaders.push_back(g[vertex(static_cast<size_t>(v), g)].name);
     }
     return leaders;
 }
@@ -236,7 +199,159 @@ vector<vector<string>> detect_groups(const following_graph &g)
     return result;
 }
 
-leader_data detect_leaders(const following_data &fd, bool use_weights)
+// Computes the same leaders as detect_leaders(following_graph_at(fd, ts), use_weights)
+// using a device_graph. All buffers are reused between timestamps.
+// Timestamps should be passed in order: the edges, ranks and leaders of the
+// last timestamp are kept to detect unchanged graphs and for warm starts.
+class leader_detector
+{
+public:
+    // The graph consists of one vertex for every device and
+    // the edges described by "pairs" (see device_graph::assign()).
+    void detect(const vector<string> &devices, array_view<const following_data::pair_data> pairs,
+                const leader_detection_options &options,
+                vector<string> &leaders, leader_detection_stats &stats)
+    {
+        const i32 n = static_cast<i32>(devices.size());
+
+        ++stats.timestamps;
+        if (m_has_last && same_edges(pairs, options.use_weights)) {
+            ++stats.unchanged;
+            leaders = m_leaders;
+            return;
+        }
+        m_has_last = true;
+        m_last_pairs.assign(pairs.begin(), pairs.end());
+
+        const bool use_cache = options.cache_size > 0;
+        if (use_cache) {
+            const u64 hash = canonicalize(pairs, options.use_weights);
+            if (const cache_entry *entry = lookup(hash)) {
+                ++stats.cache_hits;
+                m_leaders = entry->leaders;
+                leaders = m_leaders;
+                return;
+            }
+        }
+
+        m_graph.assign(n, pairs);
+        stats.page_rank_iterations += m_finder.find(
+                    m_graph, options.use_weights, damping_factor, error, max_iterations,
+                    m_ranks, m_leader_vertices, options.warm_start, options.method);
+
+        m_leaders.clear();
+        for (i32 v : m_leader_vertices) {
+            m_leaders.push_back(devices[v]);
+        }
+        leaders = m_leaders;
+
+        if (use_cache && i64(m_cache.size()) < options.cache_size) {
+            m_cache_index.emplace(m_key_hash, m_cache.size());
+            m_cache.push_back(cache_entry{m_key, m_leaders});
+        }
+    }
+
+private:
+    struct cache_entry
+    {
+        vector<following_data::pair_data> key;
+        vector<string>                    leaders;
+    };
+
+    // Returns true if the pairs produce the same graph as the pairs of the last timestamp.
+    // Lags are only relevant if they are used as edge weights.
+    bool same_edges(array_view<const following_data::pair_data> pairs, bool use_weights) const
+    {
+        if (pairs.size() != m_last_pairs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            const auto &a = pairs[i];
+            const auto &b = m_last_pairs[i];
+            if (a.left != b.left || a.right != b.right || a.type != b.type) {
+                return false;
+            }
+            if (use_weights && std::abs(a.lag) != std::abs(b.lag)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Computes the canonical form of the pairs (see m_key) and returns its hash.
+    u64 canonicalize(array_view<const following_data::pair_data> pairs, bool use_weights)
+    {
+        m_key.clear();
+        for (const auto &pair : pairs) {
+            following_data::pair_data edge = pair;
+            if (edge.type == following_type::leading) {
+                std::swap(edge.left, edge.right);
+                edge.type = following_type::following;
+            } else if (edge.type == following_type::co_leading && edge.right < edge.left) {
+                std::swap(edge.left, edge.right);
+            }
+            edge.lag = use_weights ? std::abs(edge.lag) : 0.0;
+            m_key.push_back(edge);
+        }
+        std::sort(m_key.begin(), m_key.end(), pair_less);
+
+        size_t hash = 0;
+        for (const auto &edge : m_key) {
+            boost::hash_combine(hash, edge.left);
+            boost::hash_combine(hash, edge.right);
+            boost::hash_combine(hash, static_cast<int>(edge.type));
+            boost::hash_combine(hash, edge.lag);
+        }
+        m_key_hash = hash;
+        return hash;
+    }
+
+    // Returns the cache entry for the current key or null if there is none.
+    const cache_entry *lookup(u64 hash) const
+    {
+        auto range = m_cache_index.equal_range(hash);
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            const auto &entry = m_cache[iter->second];
+            if (entry.key.size() == m_key.size()
+                    && std::equal(m_key.begin(), m_key.end(), entry.key.begin(), pair_equal)) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool pair_less(const following_data::pair_data &a, const following_data::pair_data &b)
+    {
+        return std::make_tuple(a.left, a.right, a.type, a.lag) < std::make_tuple(b.left, b.right, b.type, b.lag);
+    }
+
+    static bool pair_equal(const following_data::pair_data &a, const following_data::pair_data &b)
+    {
+        return a.left == b.left && a.right == b.right && a.type == b.type && a.lag == b.lag;
+    }
+
+private:
+    device_graph      m_graph;
+    component_leaders m_finder;
+    vector<double>    m_ranks;
+    vector<i32>       m_leader_vertices;
+
+    // State of the last timestamp.
+    bool                              m_has_last = false;
+    vector<following_data::pair_data> m_last_pairs;
+    vector<string>                    m_leaders;
+
+    // Leaders of earlier edge sets. The key of an edge set is the sorted list of its pairs,
+    // where "leading" is turned into "following", "co-leading" pairs are ordered
+    // and the lag is replaced by the edge weight (or 0 without weights).
+    vector<following_data::pair_data>       m_key;
+    u64                                     m_key_hash = 0;
+    vector<cache_entry>                     m_cache;
+    std::unordered_multimap<u64, size_t>    m_cache_index;
+};
+
+// Returns leader data with the time range of "fd" and empty timestamp slots.
+static leader_data make_leader_data(const following_data &fd)
 {
     leader_data ld;
     ld.begin_timestamp = fd.begin_timestamp;
@@ -244,15 +359,371 @@ leader_data detect_leaders(const following_data &fd, bool use_weights)
     ld.duration = fd.duration;
     ld.devices = fd.devices;
     ld.timestamps.resize(static_cast<size_t>(ld.duration));
+    return ld;
+}
+
+// Splits [0, count) into one block per thread and calls func(block_begin, block_end, stats)
+// for every block. The statistics of all blocks are summed up.
+template<typename Function>
+static void for_each_block(i32 threads, size_t count, leader_detection_stats *stats, Function &&func)
+{
+    if (threads < 1) {
+        throw std::invalid_argument("threads must be at least 1");
+    }
 
-    for (i64 ts = ld.begin_timestamp; ts <= ld.end_timestamp; ++ts) {
-        auto &data = ld.data_at(ts);
-        data.timestamp = ts;
-        data.leaders = detect_leaders(following_graph_at(fd, ts), use_weights);
+    const size_t blocks = std::max(size_t(1), std::min(size_t(threads), count));
+    vector<leader_detection_stats> block_stats(blocks);
+    parallel_for(threads, blocks, [&](size_t block) {
+        const size_t begin = block * count / blocks;
+        const size_t end = (block + 1) * count / blocks;
+        func(begin, end, block_stats[block]);
+    });
+
+    if (stats) {
+        *stats = leader_detection_stats();
+        for (const auto &s : block_stats) {
+            stats->timestamps += s.timestamps;
+            stats->unchanged += s.unchanged;
+            stats->page_rank_iterations += s.page_rank_iterations;
+            stats->cache_hits += s.cache_hits;
+        }
     }
+}
+
+leader_data detect_leaders(const following_data &fd,
+                           const leader_detection_options &options,
+                           leader_detection_stats *stats)
+{
+    leader_data ld = make_leader_data(fd);
+
+    // Every block of timestamps is processed in order by its own detector,
+    // the results are written into the preallocated timestamp slots.
+    for_each_block(options.threads, ld.timestamps.size(), stats,
+                   [&](size_t begin, size_t end, leader_detection_stats &block_stats) {
+        leader_detector detector;
+        for (size_t index = begin; index < end; ++index) {
+            const i64 ts = ld.begin_timestamp + i64(index);
+            auto &data = ld.timestamps[index];
+            data.timestamp = ts;
+            detector.detect(fd.devices, fd.data_at(ts).co_moving, options, data.leaders, block_stats);
+        }
+    });
     return ld;
 }
 
+leader_data detect_leaders(const following_data &fd,
+                           const window_options &window,
+                           const leader_detection_options &options,
+                           leader_detection_stats *stats)
+{
+    if (window.step <= 0) {
+        throw std::invalid_argument("window step must be greater than zero");
+    }
+
+    leader_data ld = make_leader_data(fd);
+
+    // Window i ends at begin_timestamp + i * step, its leaders are used
+    // for all timestamps before the end of the next window.
+    const size_t duration = ld.timestamps.size();
+    const size_t step = static_cast<size_t>(window.step);
+    const size_t windows = (duration + step - 1) / step;
+    for_each_block(options.threads, windows, stats,
+                   [&](size_t begin, size_t end, leader_detection_stats &block_stats) {
+        following_window w(fd, window.size, window.decay);
+        leader_detector detector;
+        vector<string> leaders;
+        for (size_t i = begin; i < end; ++i) {
+            const size_t first = i * step;
+            const size_t last = std::min(first + step, duration);
+
+            w.move_to(ld.begin_timestamp + i64(first));
+            detector.detect(fd.devices, w.edges(), options, leaders, block_stats);
+            for (size_t index = first; index < last; ++index) {
+                auto &data = ld.timestamps[index];
+                data.timestamp = ld.begin_timestamp + i64(index);
+                data.leaders = leaders;
+            }
+        }
+    });
+    return ld;
+}
+
+leader_data detect_leaders(const following_data &fd, bool use_weights)
+{
+    leader_detection_options options;
+    options.use_weights = use_weights;
+    return detect_leaders(fd, options);
+}
+
+// Tracks the groups (components with at least two devices) of consecutive timestamps.
+// The union-find structure is kept between timestamps and only rebuilt
+// if an edge has been removed.
+class group_tracker
+{
+public:
+    group_tracker(group_data &gd)
+        : m_gd(gd)
+        , m_parent(gd.devices.size())
+        , m_is_active(gd.devices.size(), 0)
+        , m_group_of(gd.devices.size(), -1)
+        , m_since(gd.devices.size(), 0)
+        , m_component_of_root(gd.devices.size(), -1)
+    {
+        for (size_t v = 0; v < m_parent.size(); ++v) {
+            m_parent[v] = static_cast<i32>(v);
+        }
+    }
+
+    void update(i64 ts, array_view<const following_data::pair_data> pairs)
+    {
+        // The undirected edges of this timestamp, sorted and without duplicates.
+        m_edges.clear();
+        for (const auto &pair : pairs) {
+            if (pair.left != pair.right) {
+                m_edges.push_back(edge_key(std::min(pair.left, pair.right),
+                                           std::max(pair.left, pair.right)));
+            }
+        }
+        std::sort(m_edges.begin(), m_edges.end());
+        m_edges.erase(std::unique(m_edges.begin(), m_edges.end()), m_edges.end());
+
+        if (m_edges == m_last_edges) {
+            // Same components, the groups and memberships simply continue.
+            return;
+        }
+
+        m_changed.clear();
+        std::set_difference(m_last_edges.begin(), m_last_edges.end(),
+                            m_edges.begin(), m_edges.end(),
+                            std::back_inserter(m_changed));
+        if (m_changed.empty()) {
+            // Edges have only been added.
+            std::set_difference(m_edges.begin(), m_edges.end(),
+                                m_last_edges.begin(), m_last_edges.end(),
+                                std::back_inserter(m_changed));
+        } else {
+            // Edges have been removed, start from scratch.
+            for (i32 v : m_active) {
+                m_parent[v] = v;
+                m_is_active[v] = 0;
+            }
+            m_active.clear();
+            m_changed = m_edges;
+        }
+        for (u64 key : m_changed) {
+            unite(i32(key >> 32), i32(key & 0xffffffff));
+        }
+        std::swap(m_edges, m_last_edges);
+
+        assign_groups(ts);
+    }
+
+    // Closes all open membership intervals.
+    void finish()
+    {
+        for (i32 v : m_members) {
+            close(v, m_group_of[v], m_gd.end_timestamp);
+        }
+        for (auto &group : m_gd.groups) {
+            std::sort(group.members.begin(), group.members.end(),
+                      [](const group_data::membership &a, const group_data::membership &b) {
+                return std::tie(a.begin, a.device) < std::tie(b.begin, b.device);
+            });
+        }
+    }
+
+private:
+    static u64 edge_key(i32 a, i32 b)
+    {
+        return (u64(u32(a)) << 32) | u64(u32(b));
+    }
+
+    i32 find(i32 v)
+    {
+        // Path halving.
+        while (m_parent[v] != v) {
+            m_parent[v] = m_parent[m_parent[v]];
+            v = m_parent[v];
+        }
+        return v;
+    }
+
+    void unite(i32 a, i32 b)
+    {
+        for (i32 v : {a, b}) {
+            if (!m_is_active[v]) {
+                m_is_active[v] = 1;
+                m_active.push_back(v);
+            }
+        }
+        a = find(a);
+        b = find(b);
+        if (a < b) {
+            m_parent[b] = a;
+        } else if (b < a) {
+            m_parent[a] = b;
+        }
+    }
+
+    void close(i32 device, i64 group, i64 end)
+    {
+        auto &g = m_gd.groups[static_cast<size_t>(group)];
+        group_data::membership m;
+        m.device = device;
+        m.begin = m_since[device];
+        m.end = end;
+        g.members.push_back(m);
+        g.end = std::max(g.end, end);
+    }
+
+    // Every active device (i.e. every device with at least one edge)
+    // is part of a group. Computes the groups of the active devices and
+    // matches them with the groups of the previous timestamp.
+    void assign_groups(i64 ts)
+    {
+        std::sort(m_active.begin(), m_active.end());
+
+        // Number the components of this timestamp.
+        i32 components = 0;
+        m_component.resize(m_active.size());
+        for (size_t i = 0; i < m_active.size(); ++i) {
+            const i32 root = find(m_active[i]);
+            if (m_component_of_root[root] == -1) {
+                m_component_of_root[root] = components++;
+            }
+            m_component[i] = m_component_of_root[root];
+        }
+        for (i32 v : m_active) {
+            m_component_of_root[find(v)] = -1;
+        }
+
+        // Overlap between current components and previous groups:
+        // (component, previous group) for every device in both.
+        m_overlaps.clear();
+        for (size_t i = 0; i < m_active.size(); ++i) {
+            const i64 previous = m_group_of[m_active[i]];
+            if (previous != -1) {
+                m_overlaps.push_back(std::make_tuple(0, previous, m_component[i]));
+            }
+        }
+        std::sort(m_overlaps.begin(), m_overlaps.end(),
+                  [](const overlap &a, const overlap &b) {
+            return std::tie(std::get<2>(a), std::get<1>(a)) < std::tie(std::get<2>(b), std::get<1>(b));
+        });
+        m_candidates.clear();
+        for (const auto &o : m_overlaps) {
+            if (!m_candidates.empty()
+                    && std::get<1>(m_candidates.back()) == std::get<1>(o)
+                    && std::get<2>(m_candidates.back()) == std::get<2>(o)) {
+                std::get<0>(m_candidates.back()) -= 1;
+            } else {
+                m_candidates.push_back(std::make_tuple(-1, std::get<1>(o), std::get<2>(o)));
+            }
+        }
+
+        // Largest overlap first (counts are negated), then the oldest group.
+        std::sort(m_candidates.begin(), m_candidates.end());
+        m_component_group.assign(static_cast<size_t>(components), -1);
+        m_claimed.resize(m_gd.groups.size(), 0);
+        for (const auto &c : m_candidates) {
+            const i64 previous = std::get<1>(c);
+            const i32 component = std::get<2>(c);
+            if (m_component_group[component] == -1 && !m_claimed[previous]) {
+                m_component_group[component] = previous;
+                m_claimed[previous] = 1;
+            }
+        }
+        for (i64 group : m_component_group) {
+            if (group != -1) {
+                m_claimed[group] = 0;
+            }
+        }
+        for (auto &group : m_component_group) {
+            if (group == -1) {
+                group = static_cast<i64>(m_gd.groups.size());
+                group_data::group g;
+                g.id = group;
+                g.begin = ts;
+                g.end = ts;
+                m_gd.groups.push_back(std::move(g));
+            }
+        }
+
+        // Close the memberships of devices that left their group
+        // and open memberships for devices that joined a group.
+        m_is_member.resize(m_gd.devices.size());
+        for (size_t i = 0; i < m_active.size(); ++i) {
+            m_is_member[m_active[i]] = 1;
+        }
+        for (i32 v : m_members) {
+            if (!m_is_member[v]) {
+                close(v, m_group_of[v], ts - 1);
+                m_group_of[v] = -1;
+            }
+        }
+        for (size_t i = 0; i < m_active.size(); ++i) {
+            const i32 v = m_active[i];
+            const i64 group = m_component_group[m_component[i]];
+            if (m_group_of[v] != group) {
+                if (m_group_of[v] != -1) {
+                    close(v, m_group_of[v], ts - 1);
+                }
+                m_group_of[v] = group;
+                m_since[v] = ts;
+            }
+            m_gd.groups[static_cast<size_t>(group)].end = ts;
+            m_is_member[v] = 0;
+        }
+        m_members = m_active;
+    }
+
+private:
+    // (negative overlap, previous group, current component)
+    using overlap = tuple<i32, i64, i32>;
+
+    group_data &m_gd;
+
+    // Union-find forest. Only active devices (those with at least one edge)
+    // can have a different parent.
+    vector<i32>  m_parent;
+    vector<char> m_is_active;
+    vector<i32>  m_active;
+
+    vector<u64>  m_edges;
+    vector<u64>  m_last_edges;
+    vector<u64>  m_changed;
+
+    // Group membership of every device since the last change.
+    vector<i64>  m_group_of;    // -1 if not in any group.
+    vector<i64>  m_since;       // Begin of the current membership interval.
+    vector<i32>  m_members;     // Devices with m_group_of != -1.
+    vector<char> m_is_member;
+
+    // Scratch space for assign_groups().
+    vector<i32>     m_component_of_root;
+    vector<i32>     m_component;        // Component of m_active[i].
+    vector<i64>     m_component_group;  // Group ID of every component.
+    vector<overlap> m_overlaps;
+    vector<overlap> m_candidates;
+    vector<char>    m_claimed;          // Indexed by group ID, all 0 between calls.
+};
+
+group_data detect_groups(const following_data &fd)
+{
+    group_data gd;
+    gd.begin_timestamp = fd.begin_timestamp;
+    gd.end_timestamp = fd.end_timestamp;
+    gd.duration = fd.duration;
+    gd.devices = fd.devices;
+
+    group_tracker tracker(gd);
+    for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+        tracker.update(ts, fd.data_at(ts).co_moving);
+    }
+    tracker.finish();
+    return gd;
+}
+
 void to_graphml(const following_graph &g, std::ostream &o)
 {
     using namespace pugi;
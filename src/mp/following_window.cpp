@@ -0,0 +1,130 @@
+#include "mp/following_window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace mp {
+
+following_window::following_window(const following_data &fd, i64 size, double decay)
+    : m_data(&fd)
+    , m_size(size)
+    , m_decay(decay)
+{
+    if (size <= 0) {
+        throw std::invalid_argument("window size must be greater than zero");
+    }
+    if (!(decay > 0 && decay <= 1)) {
+        throw std::invalid_argument("decay must be in (0, 1]");
+    }
+    clear();
+}
+
+void following_window::move_to(i64 timestamp)
+{
+    const following_data &fd = *m_data;
+    if (timestamp < fd.begin_timestamp || timestamp > fd.end_timestamp) {
+        throw std::logic_error("timestamp is not in range: " + std::to_string(timestamp));
+    }
+
+    const i64 begin = std::max(fd.begin_timestamp, timestamp - m_size + 1);
+    const i64 end = timestamp;
+    auto factor = [&](i64 ts) {
+        return m_decay == 1.0 ? 1.0 : std::pow(m_decay, double(end - ts));
+    };
+
+    if (m_end < m_begin || end < m_end || begin > m_end) {
+        // The window is empty, moves backwards or does not overlap the new window.
+        clear();
+        for (i64 ts = begin; ts <= end; ++ts) {
+            add(ts, factor(ts), 1);
+        }
+    } else {
+        // The existing contributions get older.
+        if (m_decay != 1.0 && end != m_end) {
+            const double aging = std::pow(m_decay, double(end - m_end));
+            for (auto &edge : m_edges) {
+                edge.lag *= aging;
+            }
+        }
+        for (i64 ts = m_begin; ts < begin; ++ts) {
+            add(ts, factor(ts), -1);
+        }
+        for (i64 ts = m_end + 1; ts <= end; ++ts) {
+            add(ts, factor(ts), 1);
+        }
+    }
+    m_begin = begin;
+    m_end = end;
+}
+
+void following_window::clear()
+{
+    m_begin = m_data->begin_timestamp;
+    m_end = m_begin - 1;
+    m_edges.clear();
+    m_counts.clear();
+    m_index.clear();
+}
+
+void following_window::add(i64 timestamp, double factor, int sign)
+{
+    // Same edges as in following_graph_at().
+    for (const auto &pair : m_data->data_at(timestamp).co_moving) {
+        const double weight = std::abs(pair.lag) * factor;
+        switch (pair.type) {
+        case following_type::following:
+            add_edge(pair.left, pair.right, weight, sign);
+            break;
+        case following_type::leading:
+            add_edge(pair.right, pair.left, weight, sign);
+            break;
+        case following_type::co_leading:
+            add_edge(pair.left, pair.right, weight, sign);
+            add_edge(pair.right, pair.left, weight, sign);
+            break;
+        }
+    }
+}
+
+void following_window::add_edge(i32 source, i32 target, double weight, int sign)
+{
+    const u64 key = (u64(u32(source)) << 32) | u64(u32(target));
+    auto iter = m_index.find(key);
+
+    if (sign > 0) {
+        size_t index;
+        if (iter == m_index.end()) {
+            index = m_edges.size();
+            m_edges.push_back({source, target, 0.0, following_type::following});
+            m_counts.push_back(0);
+            m_index.emplace(key, index);
+        } else {
+            index = iter->second;
+        }
+        m_edges[index].lag += weight;
+        m_counts[index] += 1;
+        return;
+    }
+
+    assert(iter != m_index.end() && "Removed edge must exist");
+    const size_t index = iter->second;
+    if (--m_counts[index] > 0) {
+        m_edges[index].lag = std::max(0.0, m_edges[index].lag - weight);
+        return;
+    }
+
+    // The edge has left the window, move the last edge into its slot.
+    m_index.erase(iter);
+    const size_t last = m_edges.size() - 1;
+    if (index != last) {
+        const auto &moved = m_edges[last];
+        m_index[(u64(u32(moved.left)) << 32) | u64(u32(moved.right))] = index;
+        m_edges[index] = moved;
+        m_counts[index] = m_counts[last];
+    }
+    m_edges.pop_back();
+    m_counts.pop_back();
+}
+
+} // namespace mp
@@ -1,6 +1,8 @@
 #include "mp/ground_truth.hpp"
 
 #include <algorithm>
+#include <set>
+#include <unordered_map>
 
 namespace mp {
 
@@ -56,4 +58,216 @@ bool ground_truth::co_moving_at(i64 timestamp,
     return relation_at(timestamp, device_a, device_b) != ground_truth_relation::none;
 }
 
+i32 interval_ground_truth::device_index(const string &name) const
+{
+    auto iter = device_ids.find(name);
+    return iter == device_ids.end() ? -1 : iter->second;
+}
+
+const interval_ground_truth::membership *
+interval_ground_truth::membership_at(i32 device, i64 timestamp) const
+{
+    if (device < 0 || size_t(device) >= memberships.size()) {
+        return nullptr;
+    }
+
+    // Find the first interval that ends at or after the timestamp.
+    const vector<membership> &list = memberships[device];
+    auto iter = std::lower_bound(list.begin(), list.end(), timestamp,
+                                 [](const membership &m, i64 ts) {
+        return m.end < ts;
+    });
+    if (iter == list.end() || iter->begin > timestamp) {
+        return nullptr;
+    }
+    return &*iter;
+}
+
+ground_truth_relation interval_ground_truth::relation_at(i64 timestamp,
+                                                         i32 device_a,
+                                                         i32 device_b) const
+{
+    const membership *found_a = membership_at(device_a, timestamp);
+    const membership *found_b = membership_at(device_b, timestamp);
+    if (!(found_a && found_b && found_a->group == found_b->group)) {
+        return ground_truth_relation::none;
+    }
+    return found_a->order <= found_b->order ? ground_truth_relation::leading
+                                            : ground_truth_relation::following;
+}
+
+ground_truth_relation interval_ground_truth::relation_at(i64 timestamp,
+                                                         const string &device_a,
+                                                         const string &device_b) const
+{
+    return relation_at(timestamp, device_index(device_a), device_index(device_b));
+}
+
+bool interval_ground_truth::co_moving_at(i64 timestamp, i32 device_a, i32 device_b) const
+{
+    return relation_at(timestamp, device_a, device_b) != ground_truth_relation::none;
+}
+
+bool interval_ground_truth::co_moving_at(i64 timestamp,
+                                         const string &device_a,
+                                         const string &device_b) const
+{
+    return relation_at(timestamp, device_a, device_b) != ground_truth_relation::none;
+}
+
+void interval_ground_truth::update_index()
+{
+    device_ids.clear();
+    device_ids.reserve(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        device_ids.emplace(devices[i], i32(i));
+    }
+}
+
+// Appends the membership to the (sorted) list of a device.
+// Merges it with the previous interval if they are adjacent and equal.
+static void append_membership(vector<interval_ground_truth::membership> &list,
+                              i64 begin, i64 end, i32 group, i32 order)
+{
+    if (!list.empty()) {
+        auto &last = list.back();
+        if (last.end + 1 == begin && last.group == group && last.order == order) {
+            last.end = end;
+            return;
+        }
+    }
+    list.push_back({begin, end, group, order});
+}
+
+static void update_bounds(interval_ground_truth &igt)
+{
+    bool first = true;
+    for (auto &list : igt.memberships) {
+        if (list.empty()) {
+            continue;
+        }
+        if (first) {
+            igt.begin_timestamp = list.front().begin;
+            igt.end_timestamp = list.back().end;
+            first = false;
+        } else {
+            igt.begin_timestamp = std::min(igt.begin_timestamp, list.front().begin);
+            igt.end_timestamp = std::max(igt.end_timestamp, list.back().end);
+        }
+    }
+}
+
+void ground_truth_builder::add(const string &device, i64 begin, i64 end, i32 group, i32 order)
+{
+    if (begin > end) {
+        return;
+    }
+
+    auto iter = m_device_ids.find(device);
+    if (iter == m_device_ids.end()) {
+        iter = m_device_ids.emplace(device, i32(m_devices.size())).first;
+        m_devices.push_back(device);
+    }
+    m_entries.push_back({iter->second, begin, end, group, order});
+}
+
+ground_truth ground_truth_builder::to_ground_truth() const
+{
+    ground_truth gt;
+    for (const entry &e : m_entries) {
+        for (i64 ts = e.begin; ts <= e.end; ++ts) {
+            gt.timestamps[ts].push_back({m_devices[e.device], e.group, e.order});
+        }
+    }
+    return gt;
+}
+
+interval_ground_truth ground_truth_builder::to_intervals() const
+{
+    interval_ground_truth igt;
+    igt.devices = m_devices;
+    igt.memberships.resize(m_devices.size());
+
+    // Entry indices grouped by device, in insertion order.
+    vector<vector<size_t>> by_device(m_devices.size());
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        by_device[m_entries[i].device].push_back(i);
+    }
+
+    // Boundary events of the entries of a single device:
+    // (timestamp, entry index, true for the begin of the entry).
+    vector<tuple<i64, size_t, bool>> events;
+
+    // The entries covering the current timestamp, ordered by (group, entry index).
+    // Highest group wins, ties are won by the latest entry, i.e. the maximum.
+    std::set<std::pair<i32, size_t>> covering;
+
+    for (size_t device = 0; device < by_device.size(); ++device) {
+        events.clear();
+        for (size_t i : by_device[device]) {
+            events.push_back(std::make_tuple(m_entries[i].begin, i, true));
+            events.push_back(std::make_tuple(m_entries[i].end + 1, i, false));
+        }
+        std::sort(events.begin(), events.end());
+
+        // Sweep over the time line. Between two consecutive event timestamps,
+        // the set of covering entries is constant.
+        auto &list = igt.memberships[device];
+        covering.clear();
+        for (size_t k = 0; k < events.size();) {
+            const i64 begin = get<0>(events[k]);
+            for (; k < events.size() && get<0>(events[k]) == begin; ++k) {
+                const size_t i = get<1>(events[k]);
+                if (get<2>(events[k])) {
+                    covering.insert(std::make_pair(m_entries[i].group, i));
+                } else {
+                    covering.erase(std::make_pair(m_entries[i].group, i));
+                }
+            }
+
+            if (k < events.size() && !covering.empty()) {
+                const entry &found = m_entries[covering.rbegin()->second];
+                append_membership(list, begin, get<0>(events[k]) - 1, found.group, found.order);
+            }
+        }
+    }
+
+    update_bounds(igt);
+    igt.update_index();
+    return igt;
+}
+
+interval_ground_truth make_interval_ground_truth(const ground_truth &gt)
+{
+    interval_ground_truth igt;
+
+    // Resolves duplicate entries the same way as ground_truth::relation_at.
+    std::unordered_map<i32, const ground_truth::device *> found;
+    for (auto &pair : gt.timestamps) {
+        const i64 ts = pair.first;
+
+        found.clear();
+        for (const ground_truth::device &dev : pair.second) {
+            auto id = igt.device_ids.find(dev.name);
+            if (id == igt.device_ids.end()) {
+                id = igt.device_ids.emplace(dev.name, i32(igt.devices.size())).first;
+                igt.devices.push_back(dev.name);
+                igt.memberships.emplace_back();
+            }
+
+            const ground_truth::device *&entry = found[id->second];
+            if (!entry || dev.group >= entry->group) {
+                entry = &dev;
+            }
+        }
+
+        for (auto &f : found) {
+            append_membership(igt.memberships[f.first], ts, ts, f.second->group, f.second->order);
+        }
+    }
+
+    update_bounds(igt);
+    return igt;
+}
+
 } // namespace mp
@@ -0,0 +1,126 @@
+#include "mp/ground_truth_labels.hpp"
+
+#include <algorithm>
+
+#include "mp/feature_computation.hpp"
+
+namespace mp {
+
+// Sets the codes for the timestamps [begin, end] (relative to the first timestamp).
+static void fill_codes(u64 *row, i64 begin, i64 end, ground_truth_relation rel)
+{
+    const u64 code = static_cast<u64>(rel);
+    for (i64 i = begin; i <= end; ++i) {
+        u64 &word = row[i / ground_truth_labels::codes_per_word];
+        const i64 shift = 2 * (i % ground_truth_labels::codes_per_word);
+        word = (word & ~(u64(3) << shift)) | (code << shift);
+    }
+}
+
+// Calls f(begin, end, relation) for every interval in [begin, end]
+// in which the devices with the given memberships are in the same group.
+template<typename Func>
+static void for_each_co_moving_interval(const vector<interval_ground_truth::membership> &left,
+                                        const vector<interval_ground_truth::membership> &right,
+                                        i64 begin, i64 end, Func &&f)
+{
+    // Both lists are sorted and non-overlapping, walk them in parallel.
+    auto l = left.begin(), r = right.begin();
+    while (l != left.end() && r != right.end()) {
+        const i64 overlap_begin = std::max({l->begin, r->begin, begin});
+        const i64 overlap_end = std::min({l->end, r->end, end});
+        if (overlap_begin <= overlap_end && l->group == r->group) {
+            ground_truth_relation rel = l->order <= r->order
+                    ? ground_truth_relation::leading
+                    : ground_truth_relation::following;
+            f(overlap_begin, overlap_end, rel);
+        }
+
+        if (l->end < r->end) {
+            ++l;
+        } else {
+            ++r;
+        }
+    }
+}
+
+// Returns the memberships of every device in "devices" (empty for unknown devices).
+static vector<const vector<interval_ground_truth::membership> *>
+memberships_of(const interval_ground_truth &gt, const vector<string> &devices)
+{
+    static const vector<interval_ground_truth::membership> empty;
+
+    vector<const vector<interval_ground_truth::membership> *> result;
+    result.reserve(devices.size());
+    for (const string &name : devices) {
+        i32 id = gt.device_index(name);
+        result.push_back(id == -1 ? &empty : &gt.memberships[id]);
+    }
+    return result;
+}
+
+ground_truth_labels make_ground_truth_labels(const interval_ground_truth &gt,
+                                             const vector<string> &devices,
+                                             const vector<tuple<i32, i32>> &pairs,
+                                             i64 begin, i64 end)
+{
+    ground_truth_labels labels;
+    labels.begin_timestamp = begin;
+    labels.end_timestamp = end;
+    labels.num_pairs = pairs.size();
+    if (begin > end) {
+        return labels;
+    }
+
+    const i64 duration = end - begin + 1;
+    const i64 per_word = ground_truth_labels::codes_per_word;
+    labels.words_per_pair = size_t((duration + per_word - 1) / per_word);
+
+    // Every code is initialized to "none" (binary 10 in every position).
+    static_assert(static_cast<u64>(ground_truth_relation::none) == 2,
+                  "Initialization pattern must match the code of 'none'");
+    labels.codes.assign(labels.num_pairs * labels.words_per_pair, 0xAAAAAAAAAAAAAAAAull);
+
+    // Resolve device names once.
+    const auto memberships = memberships_of(gt, devices);
+
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        u64 *row = labels.codes.data() + p * labels.words_per_pair;
+        for_each_co_moving_interval(*memberships[get<0>(pairs[p])], *memberships[get<1>(pairs[p])],
+                                    begin, end, [&](i64 b, i64 e, ground_truth_relation rel) {
+            fill_codes(row, b - begin, e - begin, rel);
+        });
+    }
+    return labels;
+}
+
+i64 count_co_moving(const interval_ground_truth &gt,
+                    const vector<string> &devices,
+                    const vector<tuple<i32, i32>> &pairs,
+                    i64 begin, i64 end)
+{
+    const auto memberships = memberships_of(gt, devices);
+
+    i64 count = 0;
+    for (const auto &pair : pairs) {
+        for_each_co_moving_interval(*memberships[get<0>(pair)], *memberships[get<1>(pair)],
+                                    begin, end, [&](i64 b, i64 e, ground_truth_relation) {
+            count += e - b + 1;
+        });
+    }
+    return count;
+}
+
+ground_truth_labels make_ground_truth_labels(const interval_ground_truth &gt,
+                                             const similarity_data &data)
+{
+    vector<tuple<i32, i32>> pairs;
+    pairs.reserve(data.pairs.size());
+    for (auto &pair : data.pairs) {
+        pairs.push_back(make_tuple(pair.left, pair.right));
+    }
+    return make_ground_truth_labels(gt, data.devices, pairs,
+                                    data.begin_timestamp, data.end_timestamp);
+}
+
+} // namespace mp
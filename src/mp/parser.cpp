@@ -1,11 +1,23 @@
 #include "mp/parser.hpp"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <unordered_map>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mp/tools/array_view.hpp"
+#include "mp/tools/parallel.hpp"
+
 namespace mp {
 
 namespace {
@@ -27,30 +39,35 @@ i32 get_access_point_index(access_points_map &aps, const string &bssid, vector<s
     return it->second;
 }
 
-// Finds or creates a new device_data instance and returns a reference to it (signal data).
-signal_data::device_data& get_device(devices_map &devs, const string &name, vector<signal_data::device_data> &devices)
+// Finds or creates a new device_data instance and returns its index.
+template<typename Device>
+i32 get_device_index(devices_map &devs, const string &name, vector<Device> &devices)
 {
     auto it = devs.find(name);
     if (it == devs.end()) {
         i32 index = devices.size();
         devs.emplace(name, index);
         devices.emplace_back(name);
-        return devices.back();
+        return index;
     }
-    return devices[it->second];
+    return it->second;
 }
 
-// Finds or creates a new device_data instance and returns a reference to it (location data).
-location_data::device_data& get_device(devices_map &devs, const string &name, vector<location_data::device_data> &devices)
+// Finds or creates a new device_data instance and returns a reference to it
+// (signal or location data).
+template<typename Device>
+Device& get_device(devices_map &devs, const string &name, vector<Device> &devices)
 {
-    auto it = devs.find(name);
-    if (it == devs.end()) {
-        i32 index = devices.size();
-        devs.emplace(name, index);
-        devices.emplace_back(name);
-        return devices.back();
-    }
-    return devices[it->second];
+    return devices[get_device_index(devs, name, devices)];
+}
+
+// Make sure that the entries are sorted by time.
+template<typename Device>
+void sort_measurements(Device &dev)
+{
+    using measure = typename decltype(dev.data)::value_type;
+    std::sort(dev.data.begin(), dev.data.end(),
+              [](const measure &a, const measure &b) { return a.timestamp < b.timestamp; });
 }
 
 // Split on "delim", output into "token".
@@ -177,7 +194,452 @@ void parse_location_stream(std::istream &file, location_data &result, devices_ma
     }
 }
 
-void parse_ground_truth_stream(std::istream &input, ground_truth &result)
+// A read-only memory mapping of an entire file.
+class mapped_file
+{
+public:
+    explicit mapped_file(const string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw_error("failed to open", path);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == -1) {
+            ::close(fd);
+            throw_error("failed to stat", path);
+        }
+
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size > 0) {
+            void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw_error("failed to map", path);
+            }
+            m_data = static_cast<const char *>(data);
+            ::madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file()
+    {
+        if (m_data) {
+            ::munmap(const_cast<char *>(m_data), m_size);
+        }
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file& operator=(const mapped_file &) = delete;
+
+    const char *begin() const { return m_data; }
+    const char *end() const { return m_data + m_size; }
+
+private:
+    static void throw_error(const char *what, const string &path)
+    {
+        throw std::runtime_error(string(what) + " \"" + path + "\": " + std::strerror(errno));
+    }
+
+private:
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+using char_view = array_view<const char>;
+
+// Same as next_token() above, but operates on character ranges
+// and does not copy the token.
+bool next_token(char_view input, const char *&pos, char delim, char_view &token)
+{
+    if (pos == input.end()) {
+        return false;
+    }
+
+    const char *first = pos;
+    const char *last = static_cast<const char *>(std::memchr(pos, delim, input.end() - pos));
+    if (last) {
+        pos = last + 1;
+    } else {
+        last = pos = input.end();
+    }
+    token = char_view(first, last);
+    return true;
+}
+
+char_view must_next_token(char_view input, const char *&pos, char delim, const char *context)
+{
+    char_view token;
+    if (!next_token(input, pos, delim, token)) {
+        std::string message = "invalid data (expected a token)";
+        if (context) {
+            message += " in context `";
+            message += context;
+            message += "`";
+        }
+        throw std::runtime_error(message);
+    }
+    return token;
+}
+
+bool equals(char_view token, const char *str)
+{
+    size_t size = std::strlen(str);
+    return token.size() == size && std::equal(token.begin(), token.end(), str);
+}
+
+[[noreturn]] void invalid_number(char_view token, const char *context)
+{
+    throw std::runtime_error("invalid number `" + string(token.begin(), token.end())
+                             + "` in context `" + context + "`");
+}
+
+bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Parses a decimal integer, similar to std::stoll().
+// Leading whitespace and trailing characters are ignored.
+i64 parse_integer(char_view token, const char *context)
+{
+    const char *pos = token.begin();
+    const char *end = token.end();
+    while (pos != end && (*pos == ' ' || *pos == '\t')) {
+        ++pos;
+    }
+
+    bool negative = false;
+    if (pos != end && (*pos == '-' || *pos == '+')) {
+        negative = *pos == '-';
+        ++pos;
+    }
+    if (pos == end || !is_digit(*pos)) {
+        invalid_number(token, context);
+    }
+
+    u64 value = 0;
+    for (; pos != end && is_digit(*pos); ++pos) {
+        u64 digit = u64(*pos - '0');
+        if (value > (u64(std::numeric_limits<i64>::max()) - digit) / 10) {
+            invalid_number(token, context);
+        }
+        value = value * 10 + digit;
+    }
+    return negative ? -i64(value) : i64(value);
+}
+
+// Same as parse_integer(), but the result must fit into an i32.
+i32 parse_i32(char_view token, const char *context)
+{
+    i64 value = parse_integer(token, context);
+    if (value < std::numeric_limits<i32>::min() || value > std::numeric_limits<i32>::max()) {
+        invalid_number(token, context);
+    }
+    return i32(value);
+}
+
+// Parses a decimal floating point number, similar to std::stod().
+// Numbers with at most 15 significant digits and a small decimal exponent
+// are converted exactly by a single multiplication or division (both operands are
+// exactly representable). All other numbers are passed to strtod().
+double parse_double(char_view token, const char *context)
+{
+    static const double powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *pos = token.begin();
+    const char *end = token.end();
+    while (pos != end && (*pos == ' ' || *pos == '\t')) {
+        ++pos;
+    }
+    const char *number_begin = pos;
+
+    bool negative = false;
+    if (pos != end && (*pos == '-' || *pos == '+')) {
+        negative = *pos == '-';
+        ++pos;
+    }
+
+    u64 mantissa = 0;
+    i32 digits = 0;     // significant digits in mantissa
+    i32 exponent = 0;
+    bool any_digits = false;
+    for (; pos != end && is_digit(*pos); ++pos) {
+        any_digits = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + u64(*pos - '0');
+            digits += mantissa != 0;
+        } else {
+            ++exponent;
+            ++digits;
+        }
+    }
+    if (pos != end && *pos == '.') {
+        ++pos;
+        for (; pos != end && is_digit(*pos); ++pos) {
+            any_digits = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + u64(*pos - '0');
+                digits += mantissa != 0;
+                --exponent;
+            } else {
+                ++digits;
+            }
+        }
+    }
+    if (any_digits && pos != end && (*pos == 'e' || *pos == 'E')) {
+        const char *exp_pos = pos + 1;
+        bool exp_negative = false;
+        if (exp_pos != end && (*exp_pos == '-' || *exp_pos == '+')) {
+            exp_negative = *exp_pos == '-';
+            ++exp_pos;
+        }
+        if (exp_pos != end && is_digit(*exp_pos)) {
+            i32 exp_value = 0;
+            for (; exp_pos != end && is_digit(*exp_pos); ++exp_pos) {
+                if (exp_value < 10000) {
+                    exp_value = exp_value * 10 + (*exp_pos - '0');
+                }
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+    }
+
+    if (any_digits && digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = double(mantissa);
+        value = exponent < 0 ? value / powers_of_ten[-exponent]
+                             : value * powers_of_ten[exponent];
+        return negative ? -value : value;
+    }
+
+    // Slow path: many digits, huge exponents, "inf", "nan" etc.
+    string buffer(number_begin, end);
+    char *parsed_end = nullptr;
+    double value = std::strtod(buffer.c_str(), &parsed_end);
+    if (parsed_end == buffer.c_str()) {
+        invalid_number(token, context);
+    }
+    return value;
+}
+
+// Calls "func" for every line in [begin, end).
+// Trailing carriage returns are removed and empty lines are skipped.
+template<typename Function>
+void for_each_line(const char *begin, const char *end, Function &&func)
+{
+    const char *pos = begin;
+    while (pos != end) {
+        const char *line_end = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        const char *next = line_end ? line_end + 1 : end;
+        if (!line_end) {
+            line_end = end;
+        }
+        if (line_end != pos && line_end[-1] == '\r') {
+            --line_end;
+        }
+        if (line_end != pos) {
+            func(char_view(pos, line_end));
+        }
+        pos = next;
+    }
+}
+
+// Same as parse_signal_stream(), but parses the character range [begin, end).
+// The measurements are not sorted.
+void parse_signal_lines(const char *begin, const char *end,
+                        signal_data &result, access_points_map &aps, devices_map &devs)
+{
+    string key; // reused for map lookups, avoids allocations
+
+    for_each_line(begin, end, [&](char_view line) {
+        const char *pos = line.begin();
+
+        i64 timestamp = parse_integer(must_next_token(line, pos, ';', "TIMESTAMP"), "TIMESTAMP");
+
+        char_view device_id = must_next_token(line, pos, ';', "DEVICE_ID");
+        key.assign(device_id.begin(), device_id.end());
+        auto &device = get_device(devs, key, result.devices);
+
+        char_view token;
+        while (next_token(line, pos, ';', token)) {
+            if (equals(token, "pos=") || equals(token, "id=")) {
+                continue;
+            }
+
+            // bssid=dbm,frequency,...
+            const char *inner_pos = token.begin();
+            char_view bssid = must_next_token(token, inner_pos, '=', "BSSID");
+            char_view dbm = must_next_token(token, inner_pos, ',', "DBM");
+
+            key.assign(bssid.begin(), bssid.end());
+            i32 ap_index = get_access_point_index(aps, key, result.bssids);
+            device.data.push_back({timestamp, ap_index, parse_i32(dbm, "DBM")});
+        }
+    });
+}
+
+// Same as parse_location_stream(), but parses the character range [begin, end).
+// Only the columns used by the tracing data transformation (timestamp, device,
+// lat, lng and alt) are parsed, all other fields are set to zero.
+// The measurements are not sorted.
+void parse_location_lines(const char *begin, const char *end,
+                          location_data &result, devices_map &devs)
+{
+    string key; // reused for map lookups, avoids allocations
+
+    location_data::measurement next{};
+    for_each_line(begin, end, [&](char_view line) {
+        const char *pos = line.begin();
+
+        next.timestamp = parse_integer(must_next_token(line, pos, ';', "TIMESTAMP"), "TIMESTAMP");
+
+        char_view device_id = must_next_token(line, pos, ';', "DEVICE_ID");
+        key.assign(device_id.begin(), device_id.end());
+        auto &dev = get_device(devs, key, result.devices);
+
+        next.lat = parse_double(must_next_token(line, pos, ';', "LAT"), "LAT");
+        next.lng = parse_double(must_next_token(line, pos, ';', "LNG"), "LNG");
+        next.alt = parse_double(must_next_token(line, pos, ';', "ALT"), "ALT");
+        // Remaining columns are ignored.
+
+        dev.data.push_back(next);
+    });
+}
+
+// Splits [begin, end) into at most "n" chunks of (approx.) equal size.
+// Chunks always end at line boundaries.
+vector<char_view> split_lines(const char *begin, const char *end, size_t n)
+{
+    assert(n > 0);
+
+    vector<char_view> chunks;
+    const size_t size = end - begin;
+    const char *pos = begin;
+    for (size_t i = 1; i <= n && pos != end; ++i) {
+        const char *chunk_end = end;
+        if (i < n) {
+            const char *target = std::max(pos, begin + size / n * i);
+            chunk_end = static_cast<const char *>(std::memchr(target, '\n', end - target));
+            chunk_end = chunk_end ? chunk_end + 1 : end;
+        }
+        chunks.push_back(char_view(pos, chunk_end));
+        pos = chunk_end;
+    }
+    return chunks;
+}
+
+// Concatenates the measurements of the local devices listed in "sources"
+// (in chunk order) into "dev" and sorts them.
+// The local measurements are freed.
+template<typename Data>
+void merge_device(const vector<tuple<i32, i32>> &sources, vector<Data> &parts,
+                  typename decltype(Data::devices)::value_type &dev)
+{
+    size_t total = 0;
+    for (auto &src : sources) {
+        total += parts[get<0>(src)].devices[get<1>(src)].data.size();
+    }
+
+    dev.data.reserve(total);
+    for (auto &src : sources) {
+        auto &local = parts[get<0>(src)].devices[get<1>(src)].data;
+        dev.data.insert(dev.data.end(), local.begin(), local.end());
+        decltype(dev.data)().swap(local);
+    }
+    sort_measurements(dev);
+}
+
+// Parses signal data using up to "threads" threads.
+// Every thread parses a chunk of lines with its own dictionaries.
+// The dictionaries are merged in chunk order, which assigns the same
+// indices as a sequential parse would.
+void parse_signal_parallel(const char *begin, const char *end, i32 threads, signal_data &result)
+{
+    access_points_map aps;    // bssid => index
+    devices_map       devs;   // name  => index
+
+    vector<char_view> chunks = split_lines(begin, end, size_t(std::max(threads, 1)));
+    if (chunks.size() <= 1) {
+        parse_signal_lines(begin, end, result, aps, devs);
+        for (auto &dev : result.devices) {
+            sort_measurements(dev);
+        }
+        return;
+    }
+
+    vector<signal_data> parts(chunks.size());
+    parallel_for(threads, chunks.size(), [&](size_t i) {
+        access_points_map local_aps;
+        devices_map local_devs;
+        parse_signal_lines(chunks[i].begin(), chunks[i].end(), parts[i], local_aps, local_devs);
+    });
+
+    // Map the chunk local indices to global ones.
+    vector<vector<i32>> ap_index(parts.size());
+    vector<vector<tuple<i32, i32>>> sources; // global device => (chunk, local device)
+    for (size_t i = 0; i < parts.size(); ++i) {
+        for (auto &bssid : parts[i].bssids) {
+            ap_index[i].push_back(get_access_point_index(aps, bssid, result.bssids));
+        }
+        for (size_t d = 0; d < parts[i].devices.size(); ++d) {
+            i32 index = get_device_index(devs, parts[i].devices[d].name, result.devices);
+            sources.resize(result.devices.size());
+            sources[index].push_back(make_tuple(i32(i), i32(d)));
+        }
+    }
+
+    parallel_for(threads, parts.size(), [&](size_t i) {
+        for (auto &dev : parts[i].devices) {
+            for (auto &m : dev.data) {
+                m.access_point_id = ap_index[i][m.access_point_id];
+            }
+        }
+    });
+    parallel_for(threads, result.devices.size(), [&](size_t d) {
+        merge_device(sources[d], parts, result.devices[d]);
+    });
+}
+
+// Same as parse_signal_parallel(), but for location data.
+void parse_location_parallel(const char *begin, const char *end, i32 threads, location_data &result)
+{
+    devices_map devs; // name => index
+
+    vector<char_view> chunks = split_lines(begin, end, size_t(std::max(threads, 1)));
+    if (chunks.size() <= 1) {
+        parse_location_lines(begin, end, result, devs);
+        for (auto &dev : result.devices) {
+            sort_measurements(dev);
+        }
+        return;
+    }
+
+    vector<location_data> parts(chunks.size());
+    parallel_for(threads, chunks.size(), [&](size_t i) {
+        devices_map local_devs;
+        parse_location_lines(chunks[i].begin(), chunks[i].end(), parts[i], local_devs);
+    });
+
+    vector<vector<tuple<i32, i32>>> sources; // global device => (chunk, local device)
+    for (size_t i = 0; i < parts.size(); ++i) {
+        for (size_t d = 0; d < parts[i].devices.size(); ++d) {
+            i32 index = get_device_index(devs, parts[i].devices[d].name, result.devices);
+            sources.resize(result.devices.size());
+            sources[index].push_back(make_tuple(i32(i), i32(d)));
+        }
+    }
+
+    parallel_for(threads, result.devices.size(), [&](size_t d) {
+        merge_device(sources[d], parts, result.devices[d]);
+    });
+}
+
+void parse_ground_truth_stream(std::istream &input, ground_truth_builder &result)
 {
     using device_list = vector<ground_truth::device>;
 
@@ -234,15 +696,10 @@ void parse_ground_truth_stream(std::istream &input, ground_truth &result)
             ++order;
         }
 
-        for (i64 ts = start; ts <= end; ++ts) {
-            device_list &target = result.timestamps[ts];
-            target.reserve(target.size() + devices.size());
-
-            std::copy(devices.begin(), devices.end(),
-                      std::back_inserter(target));
+        for (const ground_truth::device &dev : devices) {
+            result.add(dev.name, start, end, dev.group, dev.order);
         }
 
-
         devices.clear();
         ++group;
     }
@@ -274,16 +731,58 @@ location_data parse_location_data(std::istream &input)
     return result;
 }
 
+signal_data parse_signal_data(const char *begin, const char *end, i32 threads)
+{
+    signal_data result;
+    parse_signal_parallel(begin, end, threads, result);
+    return result;
+}
+
+signal_data parse_signal_file(const string &path, i32 threads)
+{
+    mapped_file file(path);
+    return parse_signal_data(file.begin(), file.end(), threads);
+}
+
+location_data parse_location_data(const char *begin, const char *end, i32 threads)
+{
+    location_data result;
+    parse_location_parallel(begin, end, threads, result);
+    return result;
+}
+
+location_data parse_location_file(const string &path, i32 threads)
+{
+    mapped_file file(path);
+    return parse_location_data(file.begin(), file.end(), threads);
+}
+
 ground_truth parse_ground_truth_data(std::istream &input)
 {
-    ground_truth result;
+    ground_truth_builder result;
     parse_ground_truth_stream(input, result);
-    return result;
+    return result.to_ground_truth();
+}
+
+interval_ground_truth parse_ground_truth_intervals(std::istream &input)
+{
+    ground_truth_builder result;
+    parse_ground_truth_stream(input, result);
+    return result.to_intervals();
 }
 
 void game_signal_data_parser::parse(const string &device_id, std::istream &input)
 {
-    auto &device = get_device(m_devices, device_id, m_result.devices);
+    merge(parse_partial(device_id, input));
+}
+
+game_signal_data_parser::partial_result
+game_signal_data_parser::parse_partial(const string &device_id, std::istream &input) const
+{
+    partial_result result;
+    result.device_id = device_id;
+
+    access_points_map aps; // local to this file
 
     string line, token;
     string::const_iterator line_pos, token_pos;
@@ -310,10 +809,28 @@ void game_signal_data_parser::parse(const string &device_id, std::istream &input
             must_next_token(token, token_pos, ',', dbm, "DBM");
             // ignore rest of token
 
-            i32 ap_index = get_access_point_index(m_aps, bssid, m_result.bssids);
-            device.data.push_back({timestamp, ap_index, std::stoi(dbm)});
+            i32 ap_index = get_access_point_index(aps, bssid, result.bssids);
+            result.data.push_back({timestamp, ap_index, std::stoi(dbm)});
         }
     }
+    return result;
+}
+
+void game_signal_data_parser::merge(partial_result &&partial)
+{
+    auto &device = get_device(m_devices, partial.device_id, m_result.devices);
+
+    // Map file local access point indices to global ones.
+    vector<i32> ap_index;
+    ap_index.reserve(partial.bssids.size());
+    for (auto &bssid : partial.bssids) {
+        ap_index.push_back(get_access_point_index(m_aps, bssid, m_result.bssids));
+    }
+
+    device.data.reserve(device.data.size() + partial.data.size());
+    for (auto &m : partial.data) {
+        device.data.push_back({m.timestamp, ap_index[m.access_point_id], m.signal_strength});
+    }
 }
 
 signal_data game_signal_data_parser::take()
@@ -358,22 +875,25 @@ game_ground_truth_parser::game_ground_truth_parser(const evader_map &evaders,
         m_next_id = std::max(m_next_id, evader_id + 1);
 
         // Use evader index as group index.
-        ground_truth::device dev{device_id, evader_id, 0};
-        for (i64 ts = m_begin; ts <= m_end; ++ts) {
-            m_gt.timestamps[ts].push_back(dev);
-        }
+        m_gt.add(device_id, m_begin, m_end, evader_id, 0);
     }
 }
 
 void game_ground_truth_parser::parse(const string &device_id, std::istream &input)
 {
-    using device = ground_truth::device;
+    merge(parse_partial(device_id, input));
+}
 
-    i32 unique_id = m_next_id++;
+game_ground_truth_parser::partial_result
+game_ground_truth_parser::parse_partial(const string &device_id, std::istream &input) const
+{
+    partial_result result;
+    result.device_id = device_id;
 
     if (m_evaders.count(device_id)) {
         // device is evader, we already know its ground truth (see constructor).
-        return;
+        result.is_evader = true;
+        return result;
     }
 
     string line, token;
@@ -403,31 +923,51 @@ void game_ground_truth_parser::parse(const string &device_id, std::istream &inpu
             throw std::runtime_error("timestamps must be sorted (ascending)");
         }
 
-        // Unique group if not following an evader,
-        // otherwise at order 1 in evader's group.
-        i32 group_id = last_evader_id != -1 ? last_evader_id : unique_id;
-        i32 group_order = last_evader_id != -1 ? 1 : 0;
-        device d{device_id, group_id, group_order};
-        for (i64 ts = last_timestamp; ts < timestamp; ++ts) {
-            m_gt.timestamps[ts].push_back(d);
+        if (last_timestamp < timestamp) {
+            result.segments.push_back(make_tuple(last_timestamp, timestamp - 1, last_evader_id));
         }
 
         last_timestamp = timestamp;
         last_evader_id = evader_id;
     }
 
-    i32 group_id = last_evader_id != -1 ? last_evader_id : unique_id;
-    i32 group_order = last_evader_id != -1 ? 1 : 0;
-    device d{device_id, group_id, group_order};
-    for (i64 ts = last_timestamp; ts <= m_end; ++ts) {
-        m_gt.timestamps[ts].push_back(d);
+    if (last_timestamp <= m_end) {
+        result.segments.push_back(make_tuple(last_timestamp, m_end, last_evader_id));
+    }
+    return result;
+}
+
+void game_ground_truth_parser::merge(partial_result &&partial)
+{
+    // Every file gets an id, even evaders, so that ids
+    // only depend on the merge order.
+    i32 unique_id = m_next_id++;
+
+    if (partial.is_evader) {
+        return;
+    }
+
+    for (auto &seg : partial.segments) {
+        // Unique group if not following an evader,
+        // otherwise at order 1 in evader's group.
+        i32 evader_id = get<2>(seg);
+        i32 group_id = evader_id != -1 ? evader_id : unique_id;
+        i32 group_order = evader_id != -1 ? 1 : 0;
+        m_gt.add(partial.device_id, get<0>(seg), get<1>(seg), group_id, group_order);
     }
 }
 
 ground_truth game_ground_truth_parser::take()
 {
-    auto data = std::move(m_gt);
-    m_gt = ground_truth();
+    auto data = m_gt.to_ground_truth();
+    m_gt = ground_truth_builder();
+    return data;
+}
+
+interval_ground_truth game_ground_truth_parser::take_intervals()
+{
+    auto data = m_gt.to_intervals();
+    m_gt = ground_truth_builder();
     return data;
 }
 
@@ -1,5 +1,6 @@
 #include "mp/tracing_data.hpp"
 
+#include <algorithm>
 #include <limits>
 
 #include "mp/parser.hpp"
@@ -8,14 +9,50 @@ namespace mp {
 
 namespace {
 
+// Returns the subrange of the (sorted) measurements "entries"
+// with timestamps in [begin, end].
+template<typename Measurement>
+tuple<const Measurement *, const Measurement *>
+entries_in_range(const vector<Measurement> &entries, i64 begin, i64 end)
+{
+    const Measurement *first = entries.data();
+    const Measurement *last = entries.data() + entries.size();
+    first = std::lower_bound(first, last, begin,
+                             [](const Measurement &m, i64 ts) { return m.timestamp < ts; });
+    last = std::upper_bound(first, last, end,
+                            [](i64 ts, const Measurement &m) { return ts < m.timestamp; });
+    return make_tuple(first, last);
+}
+
+// Computes the active span of a device from its (sorted) measurements.
+// Devices without any measurements get an empty span.
+template<typename Measurement>
+void init_span(const Measurement *first, const Measurement *last,
+               i64 min_timestamp, tracing_data::device_data &dev)
+{
+    if (first == last) {
+        dev.begin_timestamp = min_timestamp;
+        dev.end_timestamp = min_timestamp - 1;
+    } else {
+        dev.begin_timestamp = first->timestamp;
+        dev.end_timestamp = (last - 1)->timestamp;
+    }
+}
+
 // Transforms a struct of type signal_data into valid tracing_data.
 struct signal_data_transform
 {
 public:
+    // The measurements of a single device.
+    using entry_range = tuple<const signal_data::measurement *, const signal_data::measurement *>;
+
     signal_data_transform(const signal_data &sd, i32 default_signal_strength,
+                          i64 range_begin, i64 range_end,
                           tracing_data &result)
         : sd(sd)
         , default_signal_strength(default_signal_strength)
+        , range_begin(range_begin)
+        , range_end(range_end)
         , result(result)
     {}
 
@@ -23,7 +60,7 @@ public:
     {
         init();
         for (i32 i = 0; i < num_devices; ++i) {
-            device_step(sd.devices[i], result.devices[i]);
+            device_step(entries[i], result.devices[i]);
         }
     }
 
@@ -39,30 +76,39 @@ private:
             throw std::runtime_error("no access points");
         }
 
-        // Must iterate over every single entry
-        // to find min/max timestamp.
+        // Entries are sorted by timestamp, thus the min/max timestamp
+        // can be found at the boundaries of every device's entries.
+        // Entries outside of [range_begin, range_end] are ignored.
         min_timestamp = std::numeric_limits<i64>::max();
         max_timestamp = std::numeric_limits<i64>::min();
-        for (auto &dev : sd.devices) {
-            for (auto &entry : dev.data) {
-                min_timestamp = std::min(min_timestamp, entry.timestamp);
-                max_timestamp = std::max(max_timestamp, entry.timestamp);
+        entries.resize(num_devices);
+        for (i32 i = 0; i < num_devices; ++i) {
+            const signal_data::measurement *first, *last;
+            std::tie(first, last) = entries_in_range(sd.devices[i].data, range_begin, range_end);
+            if (first != last) {
+                min_timestamp = std::min(min_timestamp, first->timestamp);
+                max_timestamp = std::max(max_timestamp, (last - 1)->timestamp);
             }
+            entries[i] = make_tuple(first, last);
         }
         if (max_timestamp < min_timestamp) {
             throw std::runtime_error("requries at least one measurement");
         }
         duration = max_timestamp - min_timestamp + 1;
 
-        // Prepare memory for every device
+        // Prepare memory for every device.
+        // Only the device's active span is stored.
         access_point_seen.resize(num_access_points, 0);
         result.devices.resize(num_devices);
         for (size_t i = 0; i < sd.devices.size(); ++i) {
             auto &dev = result.devices[i];
 
             dev.name = sd.devices[i].name;
-            dev.data.resize(duration, num_access_points, 0.0);
-            dev.has_data.resize(duration, num_access_points, 0);
+            init_span(get<0>(entries[i]), get<1>(entries[i]), min_timestamp, dev);
+            dev.data.resize(dev.end_timestamp - dev.begin_timestamp + 1, num_access_points, 0.0);
+            dev.has_data.resize(dev.end_timestamp - dev.begin_timestamp + 1, num_access_points, 0);
+            dev.padding.assign(num_access_points, default_signal_strength);
+            dev.padding_has_data.assign(num_access_points, 0);
         }
 
         result.data_dimension = num_access_points;
@@ -72,16 +118,15 @@ private:
     }
 
     // Compute the data matrix for the given device.
-    void device_step(const signal_data::device_data &in, tracing_data::device_data &out)
+    void device_step(const entry_range &in, tracing_data::device_data &out)
     {
         array_view<double> row;         // one row <=> one time step
         array_view<char>   has_data;    // 1 iff was assigned actual measurement data instead of default value
 
-        auto entry_begin = in.data.begin();
-        auto entry_end   = in.data.end();
-        auto entry_iter  = entry_begin;
+        auto entry_end   = get<1>(in);
+        auto entry_iter  = get<0>(in);
 
-        for (i64 ts = min_timestamp; ts <= max_timestamp; ++ts) {
+        for (i64 ts = out.begin_timestamp; ts <= out.end_timestamp; ++ts) {
             row = result.data_at(out, ts);
             has_data = result.has_data_at(out, ts);
 
@@ -115,7 +160,7 @@ private:
                 // Assume that the device has not moved.
                 // Copy the data from the last timestamp, or take the default
                 // value if at first timestamp.
-                if (ts > min_timestamp) {
+                if (ts > out.begin_timestamp) {
                     auto last_data = result.data_at(out, ts - 1);
                     auto last_has_data = result.has_data_at(out, ts - 1);
 
@@ -154,8 +199,11 @@ private:
 private:
     const signal_data &sd;
     const i32          default_signal_strength;
+    const i64          range_begin;
+    const i64          range_end;
     tracing_data      &result;
 
+    vector<entry_range> entries;    // entries in range, for every device
     vector<i32> access_point_seen;
     i32 num_devices = 0;
     i32 num_access_points = 0;
@@ -168,9 +216,15 @@ private:
 struct location_data_transform
 {
 public:
+    // The measurements of a single device.
+    using entry_range = tuple<const location_data::measurement *, const location_data::measurement *>;
+
     location_data_transform(const location_data &ld,
+                            i64 range_begin, i64 range_end,
                             tracing_data &result)
         : ld(ld)
+        , range_begin(range_begin)
+        , range_end(range_end)
         , result(result)
     {}
 
@@ -178,7 +232,7 @@ public:
     {
         init();
         for (i32 i = 0; i < num_devices; ++i) {
-            device_step(ld.devices[i], result.devices[i]);
+            device_step(entries[i], result.devices[i]);
         }
     }
 
@@ -192,27 +246,37 @@ private:
 
         min_timestamp = std::numeric_limits<i64>::max();
         max_timestamp = std::numeric_limits<i64>::min();
-        for (auto &dev : ld.devices) {
-            for (auto &entry : dev.data) {
-                min_timestamp = std::min(min_timestamp, entry.timestamp);
-                max_timestamp = std::max(max_timestamp, entry.timestamp);
+        entries.resize(num_devices);
+        for (i32 i = 0; i < num_devices; ++i) {
+            const location_data::measurement *first, *last;
+            std::tie(first, last) = entries_in_range(ld.devices[i].data, range_begin, range_end);
+            if (first != last) {
+                min_timestamp = std::min(min_timestamp, first->timestamp);
+                max_timestamp = std::max(max_timestamp, (last - 1)->timestamp);
             }
+            entries[i] = make_tuple(first, last);
         }
         if (max_timestamp < min_timestamp) {
             throw std::runtime_error("requries at least one measurement");
         }
         duration = max_timestamp - min_timestamp + 1;
 
-        // Prepare memory for every device
+        // Prepare memory for every device.
+        // Only the device's active span is stored.
         result.devices.resize(num_devices);
         for (size_t i = 0; i < ld.devices.size(); ++i) {
             auto &dev = result.devices[i];
 
             dev.name = ld.devices[i].name;
-            dev.data.resize(duration, 3, 0.0);
+            init_span(get<0>(entries[i]), get<1>(entries[i]), min_timestamp, dev);
+            dev.data.resize(dev.end_timestamp - dev.begin_timestamp + 1, 3, 0.0);
             // has_data is always true since no spatial dimensions
-            // are missing in any measurement.
-            dev.has_data.resize(duration, 3, 1);
+            // are missing in any measurement. This includes the padding
+            // before the first measurement, as in the dense representation.
+            dev.has_data.resize(dev.end_timestamp - dev.begin_timestamp + 1, 3, 1);
+            // Silly default for spatial coordinates ...
+            dev.padding.assign(3, 0.0);
+            dev.padding_has_data.assign(3, 1);
         }
 
         result.data_dimension = 3; // Spatial dimension
@@ -224,17 +288,16 @@ private:
     // Very similar to the device_step in signal_data_transform,
     // but this time we don't have to worry about missing access points,
     // since all coordinates are always given.
-    void device_step(const location_data::device_data &in, tracing_data::device_data &out)
+    void device_step(const entry_range &in, tracing_data::device_data &out)
     {
         array_view<double> row;         // one row <=> one time step
         array_view<double> last_row;    // last row (if any)
         bool have_last_row = false;
 
-        auto entry_begin = in.data.begin();
-        auto entry_end   = in.data.end();
-        auto entry_iter  = entry_begin;
+        auto entry_end   = get<1>(in);
+        auto entry_iter  = get<0>(in);
 
-        for (i64 ts = min_timestamp; ts <= max_timestamp; ++ts) {
+        for (i64 ts = out.begin_timestamp; ts <= out.end_timestamp; ++ts) {
             row = result.data_at(out, ts);
 
             i32 entries = 0;
@@ -277,8 +340,12 @@ private:
 
 private:
     const location_data &ld;
+    const i64 range_begin;
+    const i64 range_end;
     tracing_data &result;
 
+    vector<entry_range> entries;    // entries in range, for every device
+
     i32 num_devices = 0;
     i64 min_timestamp = 0;
     i64 max_timestamp = 0;
@@ -286,54 +353,31 @@ private:
 
 };
 
-void moving_average(const array_2d<double> &in,
-                    array_2d<double> &out, i32 n)
-{
-    assert(in.rows() == out.rows());
-    assert(in.columns() == out.columns());
-    assert(n > 0);
-
-    // Computes the moving average value around "row"
-    // in "column".
-    // Adjusts the index if it would go out of bounds.
-    // Could be optimized by not recomputing all values everytime.
-    auto avg_around = [&](i32 row, i32 column) {
-        i32 first_row = row - n + 1;
-        if (first_row < 0) {
-            first_row = 0;
-        }
-
-        const i32 num = row - first_row + 1;
-        double acc = 0.0;
-        for (i32 i = first_row; i <= row; ++i) {
-            acc += in.cell(i, column);
-        }
-        return acc / num;
-    };
-
-    const i32 cols = numeric_cast<i32>(in.columns());
-    const i32 rows = numeric_cast<i32>(in.rows());
-
-    for (i32 i = 0; i < rows; ++i) {
-        for (i32 j = 0; j < cols; ++j) {
-            out.cell(i, j) = avg_around(i, j);
-        }
-    }
-}
-
 } // namespace
 
 tracing_data transform(const signal_data &sd, i32 default_signal_strength)
+{
+    return transform(sd, default_signal_strength,
+                     std::numeric_limits<i64>::min(), std::numeric_limits<i64>::max());
+}
+
+tracing_data transform(const signal_data &sd, i32 default_signal_strength,
+                       i64 begin, i64 end)
 {
     tracing_data result;
-    signal_data_transform(sd, default_signal_strength, result).run();
+    signal_data_transform(sd, default_signal_strength, begin, end, result).run();
     return result;
 }
 
 tracing_data transform(const location_data &ld)
+{
+    return transform(ld, std::numeric_limits<i64>::min(), std::numeric_limits<i64>::max());
+}
+
+tracing_data transform(const location_data &ld, i64 begin, i64 end)
 {
     tracing_data result;
-    location_data_transform(ld, result).run();
+    location_data_transform(ld, begin, end, result).run();
     return result;
 }
 
@@ -341,9 +385,28 @@ void moving_average(tracing_data &td, i32 n)
 {
     assert(n > 0);
 
+    // Computes the moving average of the n values up to (and including) "ts"
+    // in "column". Timestamps before min_timestamp are skipped, timestamps before
+    // the device's span contribute the padding value.
+    // Could be optimized by not recomputing all values everytime.
+    auto avg_around = [&](const tracing_data::device_data &dev, i64 ts, i32 column) {
+        const i64 first_ts = std::max(td.min_timestamp, ts - n + 1);
+
+        double acc = 0.0;
+        for (i64 i = first_ts; i <= ts; ++i) {
+            acc += td.data_at(dev, i)[column];
+        }
+        return acc / double(ts - first_ts + 1);
+    };
+
     for (auto &dev : td.devices) {
-        array_2d<double> result(td.duration, td.data_dimension, 0.0);
-        moving_average(dev.data, result, n);
+        array_2d<double> result(dev.data.rows(), td.data_dimension, 0.0);
+        for (i64 ts = dev.begin_timestamp; ts <= dev.end_timestamp; ++ts) {
+            auto row = result.row(ts - dev.begin_timestamp);
+            for (i32 j = 0; j < td.data_dimension; ++j) {
+                row[j] = avg_around(dev, ts, j);
+            }
+        }
         dev.data = std::move(result);
     }
 }
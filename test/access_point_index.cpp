@@ -0,0 +1,154 @@
+#include "catch.hpp"
+
+#include "mp/access_point_index.hpp"
+#include "mp/feature_computation.hpp"
+#include "mp/signal_data.hpp"
+#include "mp/tracing_data.hpp"
+
+using namespace mp;
+
+namespace {
+
+signal_data index_test_data()
+{
+    return signal_data{
+        // Access points
+        {"AP_1", "AP_2", "AP_3", "AP_4"},
+        // Devices
+        {
+            {
+                "DEV_1",
+                {
+                    {1, 0, -50},
+                    {1, 1, -60},
+                    {2, 0, -50},
+                    {2, 1, -60},
+                    {3, 0, -50},
+                    {4, 0, -50},
+                    {5, 0, -50},
+                    {5, 1, -50},
+                    {5, 2, -50},
+                    {5, 3, -50},
+                    // 6: carried over from 5
+                },
+            },
+            {
+                "DEV_2",
+                {
+                    {1, 0, -40},
+                    {1, 1, -40},
+                    // 2: carried over from 1
+                    {3, 0, -40},
+                    {4, 2, -40},
+                    {5, 2, -40},
+                    {6, 2, -40},
+                }
+            },
+            {
+                "DEV_3",
+                {
+                    {4, 3, -40},
+                    {5, 3, -40},
+                }
+            },
+        },
+    };
+}
+
+} // namespace
+
+TEST_CASE("builds the access point index", "[access-point-index]")
+{
+    tracing_data td = transform(index_test_data(), -90);
+    access_point_index index = make_access_point_index(td, 2);
+
+    REQUIRE(index.begin_timestamp == 1);
+    REQUIRE(index.end_timestamp == 6);
+    REQUIRE(index.blocks.size() == 3);
+    REQUIRE(index.block_range(0) == make_tuple(i64(1), i64(2)));
+    REQUIRE(index.block_range(2) == make_tuple(i64(5), i64(6)));
+
+    auto devices = [&](size_t block, i32 ap) {
+        auto view = index.devices_at(index.blocks[block], ap);
+        return vector<i32>(view.begin(), view.end());
+    };
+
+    // Block [1, 2]
+    REQUIRE(devices(0, 0) == (vector<i32>{0, 1}));
+    REQUIRE(devices(0, 1) == (vector<i32>{0, 1}));
+    REQUIRE(devices(0, 2).empty());
+    REQUIRE(devices(0, 3).empty());
+    REQUIRE(index.blocks[0].access_point_counts == (vector<i32>{2, 2, 0}));
+
+    // Block [3, 4]
+    REQUIRE(devices(1, 0) == (vector<i32>{0, 1}));
+    REQUIRE(devices(1, 1).empty());
+    REQUIRE(devices(1, 2) == (vector<i32>{1}));
+    REQUIRE(devices(1, 3) == (vector<i32>{2}));
+    REQUIRE(index.blocks[1].access_point_counts == (vector<i32>{1, 2, 1}));
+
+    // Block [5, 6]
+    REQUIRE(devices(2, 2) == (vector<i32>{0, 1}));
+    REQUIRE(devices(2, 3) == (vector<i32>{0, 2}));
+    REQUIRE(index.blocks[2].access_point_counts == (vector<i32>{4, 1, 1}));
+}
+
+TEST_CASE("computes candidate pairs from the access point index", "[access-point-index]")
+{
+    tracing_data td = transform(index_test_data(), -90);
+    access_point_index index = make_access_point_index(td, 2);
+
+    SECTION("shared access points") {
+        auto candidates = candidate_pairs(index, td.unique_pairs(), 1);
+        REQUIRE(candidates.size() == 2);
+
+        // DEV_1 and DEV_2 share access points in all blocks.
+        REQUIRE(candidates[0].left == 0);
+        REQUIRE(candidates[0].right == 1);
+        REQUIRE(candidates[0].ranges == (vector<tuple<i64, i64>>{make_tuple(1, 6)}));
+
+        // DEV_1 and DEV_3 share AP_4 in the last block.
+        REQUIRE(candidates[1].left == 0);
+        REQUIRE(candidates[1].right == 2);
+        REQUIRE(candidates[1].ranges == (vector<tuple<i64, i64>>{make_tuple(5, 6)}));
+
+        // DEV_2 and DEV_3 never share an access point.
+    }
+
+    SECTION("minimum number of shared access points") {
+        auto candidates = candidate_pairs(index, td.unique_pairs(), 2);
+        REQUIRE(candidates.size() == 1);
+        REQUIRE(candidates[0].ranges == (vector<tuple<i64, i64>>{make_tuple(1, 2)}));
+    }
+
+    SECTION("minimum jaccard index") {
+        // Jaccard index of DEV_1 and DEV_2: 1.0, 0.5 and 0.25.
+        // Jaccard index of DEV_1 and DEV_3 in the last block: 0.25.
+        auto candidates = candidate_pairs(index, td.unique_pairs(), 1, 0.5);
+        REQUIRE(candidates.size() == 1);
+        REQUIRE(candidates[0].ranges == (vector<tuple<i64, i64>>{make_tuple(1, 4)}));
+
+        candidates = candidate_pairs(index, {make_tuple(2, 0)}, 1, 0.25);
+        REQUIRE(candidates.size() == 1);
+        REQUIRE(candidates[0].left == 2);
+        REQUIRE(candidates[0].right == 0);
+    }
+
+    SECTION("feature computation only covers candidate ranges") {
+        feature_computation fc;
+        fc.window_size = 1;
+        fc.time_lag = 0;
+        fc.begin_timestamp = td.min_timestamp;
+        fc.end_timestamp = td.max_timestamp;
+
+        auto candidates = candidate_pairs(index, td.unique_pairs(), 1);
+        similarity_data sim = fc.compute_euclid(td, candidates);
+        REQUIRE(sim.pairs.size() == 2);
+
+        // The candidate range is [5, 6], but DEV_3 has no measurements after 5.
+        const auto &pair = sim.pairs[1];
+        REQUIRE_FALSE(sim.has_feature_at(pair, 4));
+        REQUIRE(sim.has_feature_at(pair, 5));
+        REQUIRE_FALSE(sim.has_feature_at(pair, 6));
+    }
+}
@@ -0,0 +1,460 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+#include <dlib/svm.h>
+
+#include "mp/co_moving_detection.hpp"
+#include "mp/feature_computation.hpp"
+#include "mp/following_detection.hpp"
+#include "mp/ground_truth.hpp"
+
+using namespace mp;
+
+// Two pairs with 3-dimensional features. The first pair is co-moving
+// during the first half of the time range, the second pair is never co-moving.
+static similarity_data make_training_data(interval_ground_truth &gt)
+{
+    const i64 duration = 100;
+
+    similarity_data sim;
+    sim.begin_timestamp = 0;
+    sim.end_timestamp = duration - 1;
+    sim.duration = duration;
+    sim.feature_dimension = 3;
+    sim.devices = {"DEVICE_A", "DEVICE_B", "DEVICE_C"};
+
+    for (i32 p = 0; p < 2; ++p) {
+        similarity_data::pair_data pair;
+        pair.left = 0;
+        pair.right = p + 1;
+        pair.features.resize(duration, 3);
+        for (i64 ts = 0; ts < duration; ++ts) {
+            bool co_moving = p == 0 && ts < duration / 2;
+            double noise = std::sin(double(ts * (p + 1)));
+            pair.features.cell(ts, 0) = (co_moving ? 0.8 : 0.2) + 0.1 * noise;
+            pair.features.cell(ts, 1) = (co_moving ? 0.7 : 0.3) - 0.1 * noise;
+            pair.features.cell(ts, 2) = 0.5 + 0.3 * noise;
+        }
+        sim.pairs.push_back(std::move(pair));
+    }
+
+    ground_truth_builder builder;
+    builder.add("DEVICE_A", 0, duration - 1, 0, 0);
+    builder.add("DEVICE_B", 0, duration / 2 - 1, 0, 1);
+    builder.add("DEVICE_B", duration / 2, duration - 1, 1, 0);
+    builder.add("DEVICE_C", 0, duration - 1, 2, 0);
+    gt = builder.to_intervals();
+    return sim;
+}
+
+// Same labels as make_training_data(), but the features of both classes
+// are drawn from overlapping normal distributions, i.e. the data is not separable.
+static similarity_data make_noisy_training_data(interval_ground_truth &gt, u32 seed)
+{
+    similarity_data sim = make_training_data(gt);
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 0.2);
+    for (i32 p = 0; p < 2; ++p) {
+        auto &features = sim.pairs[p].features;
+        for (i64 ts = 0; ts < sim.duration; ++ts) {
+            bool co_moving = p == 0 && ts < sim.duration / 2;
+            features.cell(ts, 0) = (co_moving ? 0.6 : 0.4) + noise(rng);
+            features.cell(ts, 1) = (co_moving ? 0.4 : 0.5) + noise(rng);
+            features.cell(ts, 2) = 0.5 + noise(rng);
+        }
+    }
+    return sim;
+}
+
+// The training samples of the data returned by make_training_data()
+// or make_noisy_training_data() in the format used by dlib.
+using dlib_sample = dlib::matrix<double, 0, 1>;
+using dlib_function = dlib::normalized_function<dlib::decision_function<dlib::linear_kernel<dlib_sample>>>;
+
+static void dlib_samples(const similarity_data &sim, vector<dlib_sample> &samples, vector<double> &labels)
+{
+    samples.clear();
+    labels.clear();
+    for (i32 p = 0; p < 2; ++p) {
+        for (i64 ts = 0; ts < sim.duration; ++ts) {
+            dlib_sample sample(sim.feature_dimension);
+            for (i32 j = 0; j < sim.feature_dimension; ++j) {
+                sample(j) = sim.pairs[p].features.cell(ts, j);
+            }
+            samples.push_back(sample);
+            labels.push_back(p == 0 && ts < sim.duration / 2 ? 1.0 : -1.0);
+        }
+    }
+}
+
+// Trains a classifier with dlib's linear svm trainer (as done by version 3 classifiers).
+static dlib_function dlib_train(const vector<dlib_sample> &samples, const vector<double> &labels, double C)
+{
+    dlib_function func;
+    func.normalizer.train(samples);
+
+    vector<dlib_sample> normalized;
+    for (const auto &sample : samples) {
+        normalized.push_back(func.normalizer(sample));
+    }
+
+    dlib::svm_c_linear_trainer<dlib::linear_kernel<dlib_sample>> trainer;
+    trainer.set_c(C);
+    func.function = trainer.train(normalized, labels);
+    return func;
+}
+
+TEST_CASE("batch classification equals single classification", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    co_moving_classifier c;
+    c.learn(sim, gt);
+
+    vector<char> out;
+    for (auto &pair : sim.pairs) {
+        c.co_moving_batch(pair.features, out);
+        REQUIRE(out.size() == pair.features.rows());
+        for (size_t row = 0; row < pair.features.rows(); ++row) {
+            REQUIRE(bool(out[row]) == c.co_moving(pair.features.row(row)));
+        }
+    }
+
+    // The data is separable.
+    c.co_moving_batch(sim.pairs[0].features, out);
+    REQUIRE(out[0]);
+    REQUIRE_FALSE(out[99]);
+}
+
+TEST_CASE("parallel classification is deterministic", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    co_moving_classifier c;
+    c.learn(sim, gt);
+
+    following_data expected = classify(c, sim, 1);
+    following_data actual = classify(c, sim, 4);
+
+    REQUIRE(actual.offsets == expected.offsets);
+    for (i64 ts = expected.begin_timestamp; ts <= expected.end_timestamp; ++ts) {
+        auto e = expected.data_at(ts);
+        auto a = actual.data_at(ts);
+        REQUIRE(a.timestamp == e.timestamp);
+        REQUIRE(a.co_moving.size() == e.co_moving.size());
+        for (size_t j = 0; j < e.co_moving.size(); ++j) {
+            REQUIRE(a.co_moving[j].left == e.co_moving[j].left);
+            REQUIRE(a.co_moving[j].right == e.co_moving[j].right);
+            REQUIRE(a.co_moving[j].lag == e.co_moving[j].lag);
+            REQUIRE(a.co_moving[j].type == e.co_moving[j].type);
+        }
+    }
+    REQUIRE(expected.data_at(0).co_moving.size() == 1);
+}
+
+TEST_CASE("classifier serialization", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    co_moving_classifier c;
+    c.learn(sim, gt);
+
+    std::stringstream buffer;
+    c.save(buffer);
+
+    co_moving_classifier loaded;
+    loaded.load(buffer);
+
+    vector<char> expected, actual;
+    for (auto &pair : sim.pairs) {
+        c.co_moving_batch(pair.features, expected);
+        loaded.co_moving_batch(pair.features, actual);
+        REQUIRE(expected == actual);
+    }
+}
+
+TEST_CASE("classifiers of version 3 can be loaded", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_noisy_training_data(gt, 3);
+
+    vector<dlib_sample> samples;
+    vector<double> labels;
+    dlib_samples(sim, samples, labels);
+    dlib_function func = dlib_train(samples, labels, 1.0);
+
+    // Version 3 stored the dlib function object and the training dimension.
+    std::stringstream buffer;
+    dlib::serialize(i32(3), buffer);
+    dlib::serialize(true, buffer);
+    dlib::serialize(func, buffer);
+    dlib::serialize(size_t(sim.feature_dimension), buffer);
+
+    co_moving_classifier c;
+    c.load(buffer);
+
+    for (i32 p = 0; p < 2; ++p) {
+        for (i64 ts = 0; ts < sim.duration; ++ts) {
+            const double value = func(samples[p * sim.duration + ts]);
+            if (std::abs(value) > 1e-9) {
+                REQUIRE(c.co_moving(sim.pairs[p].features.row(ts)) == (value >= 0));
+            }
+        }
+    }
+}
+
+TEST_CASE("svm solver agrees with dlib's linear svm trainer", "[co-moving-detection]")
+{
+    for (u32 seed : {1, 2, 3}) {
+        interval_ground_truth gt;
+        similarity_data sim = make_noisy_training_data(gt, seed);
+
+        vector<dlib_sample> samples;
+        vector<double> labels;
+        dlib_samples(sim, samples, labels);
+
+        for (double C : {0.1, 1.0, 10.0}) {
+            co_moving_training_options options;
+            options.C = C;
+
+            co_moving_classifier c;
+            c.learn(sim, gt, options);
+            dlib_function func = dlib_train(samples, labels, C);
+
+            // Both solve the same optimization problem (up to the solver's tolerance
+            // and the normalization), so they classify (nearly) all samples equally.
+            size_t agree = 0, correct = 0, dlib_correct = 0;
+            for (size_t i = 0; i < samples.size(); ++i) {
+                const i32 p = i32(i / size_t(sim.duration));
+                const i64 ts = i64(i % size_t(sim.duration));
+                const bool ours = c.co_moving(sim.pairs[p].features.row(ts));
+                const bool theirs = func(samples[i]) >= 0;
+                agree += ours == theirs;
+                correct += ours == (labels[i] > 0);
+                dlib_correct += theirs == (labels[i] > 0);
+            }
+            REQUIRE(agree >= samples.size() * 97 / 100);
+            REQUIRE(std::abs(double(correct) - double(dlib_correct)) <= samples.size() * 0.02);
+        }
+    }
+}
+
+TEST_CASE("classification counts include pruned pairs", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    co_moving_classifier c;
+    c.learn(sim, gt);
+
+    // Every unique pair (A-B, A-C and B-C, which has no features) is counted
+    // for every timestamp. The data is separable.
+    classification_counts counts = count_classifications(c, sim, gt);
+    REQUIRE(counts.true_positive == 50);
+    REQUIRE(counts.false_negative == 0);
+    REQUIRE(counts.false_positive == 0);
+    REQUIRE(counts.true_negative == 250);
+
+    // Pruning the co-moving pair turns its co-moving seconds into false negatives.
+    sim.pairs.erase(sim.pairs.begin());
+    counts = count_classifications(c, sim, gt);
+    REQUIRE(counts.true_positive == 0);
+    REQUIRE(counts.false_negative == 50);
+    REQUIRE(counts.false_positive == 0);
+    REQUIRE(counts.true_negative == 250);
+
+    // Same for a pair that is only pruned for some timestamps.
+    sim = make_training_data(gt);
+    sim.pairs[0].features.resize(10, 3);
+    sim.pairs[0].segments.push_back(similarity_data::segment{0, 9, 0});
+    counts = count_classifications(c, sim, gt);
+    REQUIRE(counts.true_positive == 10);
+    REQUIRE(counts.false_negative == 40);
+    REQUIRE(counts.true_negative == 250);
+}
+
+TEST_CASE("learning from a subset of samples", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    // A stationary period: the last 20 samples of the second pair are identical.
+    auto &features = sim.pairs[1].features;
+    for (size_t row = 80; row < 100; ++row) {
+        for (size_t col = 0; col < 3; ++col) {
+            features.cell(row, col) = features.cell(79, col);
+        }
+    }
+
+    co_moving_training_options options;
+    options.max_negatives = 40;
+    options.duplicate_tolerance = 0;
+
+    co_moving_classifier a, b;
+    a.learn(sim, gt, options);
+    b.learn(sim, gt, options);
+
+    // Same seed, same result.
+    std::stringstream sa, sb;
+    a.save(sa);
+    b.save(sb);
+    REQUIRE(sa.str() == sb.str());
+
+    vector<char> out;
+    a.co_moving_batch(sim.pairs[0].features, out);
+    REQUIRE(std::count(out.begin(), out.begin() + 50, 1) >= 48);
+    REQUIRE(std::count(out.begin() + 50, out.end(), 0) >= 48);
+
+    options.max_negatives = -1;
+    REQUIRE_THROWS(a.learn(sim, gt, options));
+}
+
+TEST_CASE("parallel cross validation", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    const vector<double> C_values{0.01, 1, 100};
+    vector<cross_validation_result> expected = co_moving_classifier::cross_validate(sim, gt, C_values, 3, 1);
+    vector<cross_validation_result> actual = co_moving_classifier::cross_validate(sim, gt, C_values, 3, 4);
+
+    REQUIRE(expected.size() == 3);
+    REQUIRE(actual.size() == 3);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(actual[i].C == C_values[i]);
+        REQUIRE(actual[i].positives == expected[i].positives);
+        REQUIRE(actual[i].correct_positives == expected[i].correct_positives);
+        REQUIRE(actual[i].negatives == expected[i].negatives);
+        REQUIRE(actual[i].correct_negatives == expected[i].correct_negatives);
+
+        // Every sample is tested exactly once.
+        REQUIRE(actual[i].positives == 50);
+        REQUIRE(actual[i].negatives == 150);
+    }
+
+    // The data is separable.
+    const cross_validation_result &best = best_result(actual);
+    REQUIRE(best.balanced_accuracy() > 0.95);
+
+    REQUIRE_THROWS(co_moving_classifier::cross_validate(sim, gt, C_values, 1, 1));
+    REQUIRE_THROWS(co_moving_classifier::cross_validate(sim, gt, {0.0}, 3, 1));
+}
+
+TEST_CASE("best cross validation result", "[co-moving-detection]")
+{
+    vector<cross_validation_result> results(3);
+    results[0].C = 1;
+    results[1].C = 5;
+    results[2].C = 25;
+    for (auto &r : results) {
+        r.positives = r.negatives = 10;
+        r.correct_negatives = 10;
+    }
+    results[0].correct_positives = 5;
+    results[1].correct_positives = 8;
+    results[2].correct_positives = 8;
+
+    // Ties are resolved in favor of the smaller C.
+    REQUIRE(best_result(results).C == 5);
+}
+
+TEST_CASE("warm start", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    co_moving_classifier c;
+    c.learn(sim, gt);
+
+    vector<char> expected, actual;
+    auto require_same = [&](const co_moving_classifier &other) {
+        for (auto &pair : sim.pairs) {
+            c.co_moving_batch(pair.features, expected);
+            other.co_moving_batch(pair.features, actual);
+            REQUIRE(expected == actual);
+        }
+    };
+
+    SECTION("update without new samples keeps the classifier") {
+        similarity_data empty = sim;
+        empty.pairs.clear();
+
+        co_moving_classifier updated;
+        updated.learn(sim, gt);
+        updated.update(empty, gt);
+        require_same(updated);
+    }
+
+    SECTION("update with new samples") {
+        co_moving_classifier updated;
+        updated.learn(sim, gt);
+        updated.update(sim, gt);
+        require_same(updated);
+
+        similarity_data other = sim;
+        other.feature_dimension = 4;
+        REQUIRE_THROWS(updated.update(other, gt));
+    }
+
+    SECTION("the online trainer keeps the initial model after renormalization") {
+        co_moving_online_trainer trainer(c);
+        REQUIRE(trainer.observed() == 200);
+
+        // Changes the normalization statistics, but not the function
+        // computed by the model.
+        for (auto &pair : sim.pairs) {
+            trainer.observe(pair);
+        }
+        REQUIRE(trainer.observed() == 400);
+        require_same(trainer.classifier());
+
+        for (auto &pair : sim.pairs) {
+            trainer.train(sim, pair, gt);
+        }
+        trainer.flush();
+        require_same(trainer.classifier());
+    }
+}
+
+TEST_CASE("online training", "[co-moving-detection]")
+{
+    interval_ground_truth gt;
+    similarity_data sim = make_training_data(gt);
+
+    // Smaller than a single pair: samples are evicted from the buffer during train().
+    co_moving_online_trainer trainer(sim.feature_dimension, 1.0, 42, 50);
+    for (auto &pair : sim.pairs) {
+        trainer.observe(pair);
+    }
+    REQUIRE(trainer.observed() == 200);
+
+    for (i32 epoch = 0; epoch < 5; ++epoch) {
+        for (auto &pair : sim.pairs) {
+            trainer.train(sim, pair, gt);
+        }
+        trainer.flush();
+    }
+    REQUIRE_THROWS(trainer.observe(sim.pairs[0]));
+
+    co_moving_classifier c = trainer.classifier();
+
+    i64 correct = 0;
+    vector<char> out;
+    for (size_t p = 0; p < sim.pairs.size(); ++p) {
+        c.co_moving_batch(sim.pairs[p].features, out);
+        for (i64 ts = sim.begin_timestamp; ts <= sim.end_timestamp; ++ts) {
+            bool expected = gt.co_moving_at(ts, sim.devices[sim.pairs[p].left],
+                                                sim.devices[sim.pairs[p].right]);
+            correct += bool(out[size_t(ts)]) == expected;
+        }
+    }
+    REQUIRE(correct >= 190);
+}
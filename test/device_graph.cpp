@@ -0,0 +1,534 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "mp/device_graph.hpp"
+#include "mp/following_detection.hpp"
+#include "mp/following_graph.hpp"
+#include "mp/page_rank.hpp"
+
+using namespace mp;
+
+// Random following data for "devices" devices. Every timestamp contains
+// a few random pairs, some of them with a lag of 0.
+static following_data make_random_following_data(i32 devices, i64 duration, u32 seed)
+{
+    following_data fd;
+    for (i32 i = 0; i < devices; ++i) {
+        fd.devices.push_back("D" + std::to_string(i));
+    }
+    fd.begin_timestamp = 100;
+    fd.end_timestamp = 100 + duration - 1;
+    fd.duration = duration;
+    fd.clear();
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<i32> device_dist(0, devices - 1);
+    std::uniform_int_distribution<i32> count_dist(0, devices);
+    std::uniform_int_distribution<i32> type_dist(0, 2);
+    std::uniform_int_distribution<i32> lag_dist(-3, 3);
+    for (size_t i = 0; i < size_t(duration); ++i) {
+        i32 count = count_dist(rng);
+        for (i32 j = 0; j < count; ++j) {
+            i32 left = device_dist(rng);
+            i32 right = device_dist(rng);
+            if (left == right) {
+                continue;
+            }
+            following_type type = static_cast<following_type>(type_dist(rng));
+            fd.pairs.push_back({left, right, double(lag_dist(rng)) + 0.5, type});
+        }
+        fd.offsets[i + 1] = fd.pairs.size();
+    }
+    return fd;
+}
+
+// Computes the PageRank of the entire graph "fg" with the generic implementation.
+static vector<double> generic_page_rank(const following_graph &fg, bool use_weights,
+                                        double error, i32 max_iterations)
+{
+    vector<double> ranks(num_vertices(fg));
+    auto rank_map = boost::make_iterator_property_map(ranks.begin(), get(boost::vertex_index, fg));
+    vector<double> last(ranks.size());
+    auto last_map = boost::make_iterator_property_map(last.begin(), get(boost::vertex_index, fg));
+    i32 counter = 0;
+    auto stop = [&](decltype(rank_map) r, const following_graph &graph) {
+        if (++counter >= max_iterations) {
+            return true;
+        }
+        double err = 0;
+        for (auto v : make_iter_range(vertices(graph))) {
+            double diff = get(r, v) - get(last_map, v);
+            err += diff * diff;
+            put(last_map, v, get(r, v));
+        }
+        return std::sqrt(err) <= error;
+    };
+    if (use_weights) {
+        page_rank(fg, rank_map, 0.85, get(&edge_data::weight, fg), stop);
+    } else {
+        page_rank(fg, rank_map, 0.85,
+                  boost::make_static_property_map<following_graph::edge_descriptor, double>(1.0), stop);
+    }
+    return ranks;
+}
+
+TEST_CASE("device graph construction", "[device-graph]")
+{
+    vector<following_data::pair_data> pairs{
+        {0, 1, -5, following_type::following},
+        {2, 0,  2, following_type::leading},
+        {3, 1,  0, following_type::co_leading},
+    };
+
+    device_graph g;
+    g.assign(5, pairs);
+    REQUIRE(g.num_vertices() == 5);
+    REQUIRE(g.num_edges() == 4);
+
+    // Edges: 0 -> 1, 0 -> 2, 3 -> 1, 1 -> 3
+    REQUIRE(vector<i32>(g.out_targets(0).begin(), g.out_targets(0).end()) == vector<i32>({1, 2}));
+    REQUIRE(vector<double>(g.out_weights(0).begin(), g.out_weights(0).end()) == vector<double>({5, 2}));
+    REQUIRE(vector<i32>(g.out_targets(1).begin(), g.out_targets(1).end()) == vector<i32>({3}));
+    REQUIRE(g.out_degree(2) == 0);
+    REQUIRE(g.out_degree(4) == 0);
+    REQUIRE(vector<i32>(g.in_sources(1).begin(), g.in_sources(1).end()) == vector<i32>({0, 3}));
+    REQUIRE(vector<i32>(g.in_sources(2).begin(), g.in_sources(2).end()) == vector<i32>({0}));
+    REQUIRE(g.in_sources(4).empty());
+
+    vector<i32> components, stack;
+    REQUIRE(connected_components(g, components, stack) == 2);
+    REQUIRE(components == vector<i32>({0, 0, 0, 0, 1}));
+
+    // Buffers are reused.
+    g.assign(2, array_view<const following_data::pair_data>());
+    REQUIRE(g.num_vertices() == 2);
+    REQUIRE(g.num_edges() == 0);
+    REQUIRE(connected_components(g, components, stack) == 2);
+    REQUIRE(components == vector<i32>({0, 1}));
+}
+
+TEST_CASE("device graph page rank equals generic page rank", "[device-graph]")
+{
+    following_data fd = make_random_following_data(8, 50, 1);
+
+    device_graph g;
+    vector<double> ranks;
+    for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+        following_graph fg = following_graph_at(fd, ts);
+        g.assign(8, fd.data_at(ts).co_moving);
+
+        for (bool use_weights : {true, false}) {
+            page_rank(g, use_weights, 0.85, 1e-6, 500, ranks);
+            vector<double> expected = generic_page_rank(fg, use_weights, 1e-6, 500);
+
+            REQUIRE(ranks.size() == expected.size());
+            for (size_t v = 0; v < ranks.size(); ++v) {
+                REQUIRE(ranks[v] == Approx(expected[v]));
+            }
+        }
+    }
+}
+
+TEST_CASE("leader detection on device graphs", "[device-graph]")
+{
+    SECTION("hand computed leaders") {
+        following_data fd;
+        fd.devices = {"A", "B", "C", "D", "E", "F", "G", "H", "I"};
+        fd.begin_timestamp = 0;
+        fd.end_timestamp = 2;
+        fd.duration = 3;
+        fd.clear();
+
+        // A follows B, D follows C, E and F move together, H leads I. G is alone.
+        fd.pairs.push_back({0, 1, 1, following_type::following});
+        fd.pairs.push_back({3, 2, 1, following_type::following});
+        fd.pairs.push_back({4, 5, 0, following_type::co_leading});
+        fd.pairs.push_back({7, 8, 2, following_type::leading});
+        fd.offsets[1] = fd.pairs.size();
+
+        // A chain: A follows B, B follows C and D leads C.
+        fd.pairs.push_back({0, 1, 1, following_type::following});
+        fd.pairs.push_back({1, 2, 1, following_type::following});
+        fd.pairs.push_back({3, 2, 1, following_type::leading});
+        fd.offsets[2] = fd.pairs.size();
+
+        // No edges at all.
+        fd.offsets[3] = fd.pairs.size();
+
+        for (bool use_weights : {true, false}) {
+            leader_data ld = detect_leaders(fd, use_weights);
+            REQUIRE(ld.timestamps.size() == 3);
+            REQUIRE(ld.data_at(0).leaders == vector<string>({"B", "C", "F", "G", "H"}));
+            REQUIRE(ld.data_at(1).leaders == vector<string>({"D", "E", "F", "G", "H", "I"}));
+            REQUIRE(ld.data_at(2).leaders == fd.devices);
+        }
+    }
+
+    SECTION("same leaders as page rank over the entire graph") {
+        following_data fd = make_random_following_data(10, 200, 2);
+
+        for (bool use_weights : {true, false}) {
+            leader_data ld = detect_leaders(fd, use_weights);
+            REQUIRE(ld.timestamps.size() == 200);
+            for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+                REQUIRE(ld.data_at(ts).timestamp == ts);
+
+                following_graph fg = following_graph_at(fd, ts);
+                vector<double> ranks = generic_page_rank(fg, use_weights, 1e-10, 1000);
+                vector<vector<string>> groups = detect_groups(fg);
+                auto rank_of = [&](const string &name) {
+                    auto pos = std::find(fd.devices.begin(), fd.devices.end(), name);
+                    return ranks[pos - fd.devices.begin()];
+                };
+
+                // Every group has exactly one leader, which has the highest
+                // rank in its group (up to the error of the computation).
+                const vector<string> &leaders = ld.data_at(ts).leaders;
+                REQUIRE(leaders.size() == groups.size());
+                for (const auto &group : groups) {
+                    auto leader = std::find_first_of(group.begin(), group.end(),
+                                                     leaders.begin(), leaders.end());
+                    REQUIRE(leader != group.end());
+                    for (const string &member : group) {
+                        REQUIRE(rank_of(member) <= rank_of(*leader) + 1e-5);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("page rank engine", "[device-graph]")
+{
+    following_data fd = make_random_following_data(20, 30, 7);
+
+    // A single engine for all graphs produces the same ranks as
+    // a new engine for every graph.
+    device_graph g;
+    page_rank_engine engine;
+    vector<double> ranks, expected;
+    for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+        g.assign(20, fd.data_at(ts).co_moving);
+        for (bool use_weights : {true, false}) {
+            engine.assign(g, use_weights);
+            REQUIRE(engine.num_vertices() == 20);
+            const i32 iterations = engine.run(0.85, 1e-6, 500, ranks);
+            REQUIRE(page_rank(g, use_weights, 0.85, 1e-6, 500, expected) == iterations);
+            REQUIRE(ranks == expected);
+
+            double sum = 0;
+            for (double r : ranks) {
+                sum += r;
+            }
+            REQUIRE(sum == Approx(1.0));
+        }
+    }
+
+    // Only sinks: every vertex keeps its start rank.
+    g.assign(4, array_view<const following_data::pair_data>());
+    engine.assign(g, true);
+    engine.run(0.85, 1e-6, 500, ranks);
+    for (double r : ranks) {
+        REQUIRE(r == Approx(0.25));
+    }
+}
+
+TEST_CASE("page rank methods", "[device-graph]")
+{
+    // A long chain of followers (power iteration needs many steps on it)
+    // with some random shortcuts.
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<i32> device_dist(0, 299);
+    std::uniform_real_distribution<double> lag_dist(0.5, 5.0);
+    vector<following_data::pair_data> pairs;
+    for (i32 i = 0; i + 1 < 300; ++i) {
+        following_type type = i % 3 ? following_type::following : following_type::co_leading;
+        pairs.push_back({i, i + 1, lag_dist(rng), type});
+    }
+    for (i32 i = 0; i < 100; ++i) {
+        i32 left = device_dist(rng);
+        i32 right = device_dist(rng);
+        if (left != right) {
+            pairs.push_back({left, right, lag_dist(rng), following_type::leading});
+        }
+    }
+
+    device_graph g;
+    g.assign(300, pairs);
+
+    page_rank_engine engine;
+    for (bool use_weights : {true, false}) {
+        engine.assign(g, use_weights);
+
+        vector<double> expected;
+        const i32 power_iterations = engine.run(0.85, 1e-9, 1000, expected, false, page_rank_method::power);
+        REQUIRE(power_iterations < 999);
+
+        for (auto method : {page_rank_method::gauss_seidel, page_rank_method::extrapolation}) {
+            vector<double> ranks;
+            const i32 iterations = engine.run(0.85, 1e-9, 1000, ranks, false, method);
+            REQUIRE(iterations < power_iterations);
+
+            REQUIRE(ranks.size() == expected.size());
+            double sum = 0;
+            for (size_t v = 0; v < ranks.size(); ++v) {
+                REQUIRE(ranks[v] == Approx(expected[v]).epsilon(1e-5));
+                sum += ranks[v];
+            }
+            REQUIRE(sum == Approx(1.0));
+        }
+    }
+}
+
+TEST_CASE("warm started page rank", "[device-graph]")
+{
+    following_data fd = make_random_following_data(8, 50, 3);
+
+    device_graph g;
+    vector<double> cold, warm;
+    for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+        g.assign(8, fd.data_at(ts).co_moving);
+
+        page_rank(g, false, 0.85, 1e-6, 500, cold);
+        const i32 warm_iterations = page_rank(g, false, 0.85, 1e-6, 500, warm, true);
+        REQUIRE(warm.size() == cold.size());
+        for (size_t v = 0; v < cold.size(); ++v) {
+            REQUIRE(warm[v] == Approx(cold[v]).epsilon(1e-4));
+        }
+
+        // Starting from the converged ranks of the same graph.
+        vector<double> again = cold;
+        REQUIRE(page_rank(g, false, 0.85, 1e-6, 500, again, true) == 1);
+        REQUIRE(warm_iterations >= 1);
+    }
+
+    // Unusable start vectors are replaced by the uniform distribution.
+    g.assign(8, fd.data_at(fd.begin_timestamp).co_moving);
+    page_rank(g, false, 0.85, 1e-6, 500, cold);
+    for (vector<double> start : {vector<double>(8, NAN), vector<double>(3, 1.0), vector<double>(8, 0.0)}) {
+        const i32 iterations = page_rank(g, false, 0.85, 1e-6, 500, start, true);
+        vector<double> expected;
+        REQUIRE(page_rank(g, false, 0.85, 1e-6, 500, expected) == iterations);
+        REQUIRE(start == expected);
+    }
+}
+
+TEST_CASE("leader detection reuses unchanged timestamps", "[device-graph]")
+{
+    // Every timestamp of the random data is repeated 5 times.
+    following_data random = make_random_following_data(10, 40, 4);
+    following_data fd;
+    fd.devices = random.devices;
+    fd.begin_timestamp = 0;
+    fd.end_timestamp = 199;
+    fd.duration = 200;
+    fd.clear();
+    for (size_t i = 0; i < 200; ++i) {
+        auto data = random.data_at(random.begin_timestamp + i64(i / 5));
+        fd.pairs.insert(fd.pairs.end(), data.co_moving.begin(), data.co_moving.end());
+        fd.offsets[i + 1] = fd.pairs.size();
+    }
+
+    for (bool use_weights : {true, false}) {
+        leader_detection_options options;
+        options.use_weights = use_weights;
+
+        leader_detection_stats stats;
+        leader_data ld = detect_leaders(fd, options, &stats);
+        REQUIRE(stats.timestamps == 200);
+        REQUIRE(stats.unchanged >= 160);
+        for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+            vector<string> expected = detect_leaders(following_graph_at(fd, ts), use_weights);
+            REQUIRE(ld.data_at(ts).leaders == expected);
+        }
+
+        options.warm_start = true;
+        leader_detection_stats warm_stats;
+        leader_data warm = detect_leaders(fd, options, &warm_stats);
+        REQUIRE(warm_stats.timestamps == 200);
+        REQUIRE(warm_stats.unchanged == stats.unchanged);
+        for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+            REQUIRE(warm.data_at(ts).timestamp == ts);
+        }
+    }
+}
+
+TEST_CASE("leader detection caches recurring edge sets", "[device-graph]")
+{
+    // 8 configurations that recur in a fixed cycle. Every other occurrence lists
+    // the same edges in reverse order, with "following" written as "leading".
+    following_data random = make_random_following_data(10, 8, 6);
+    following_data fd;
+    fd.devices = random.devices;
+    fd.begin_timestamp = 0;
+    fd.end_timestamp = 79;
+    fd.duration = 80;
+    fd.clear();
+    for (size_t i = 0; i < 80; ++i) {
+        auto data = random.data_at(random.begin_timestamp + i64(i % 8));
+        vector<following_data::pair_data> pairs(data.co_moving.begin(), data.co_moving.end());
+        if ((i / 8) % 2 == 1) {
+            std::reverse(pairs.begin(), pairs.end());
+            for (auto &pair : pairs) {
+                if (pair.type == following_type::following) {
+                    std::swap(pair.left, pair.right);
+                    pair.type = following_type::leading;
+                    pair.lag = -pair.lag;
+                }
+            }
+        }
+        fd.pairs.insert(fd.pairs.end(), pairs.begin(), pairs.end());
+        fd.offsets[i + 1] = fd.pairs.size();
+    }
+
+    for (bool use_weights : {true, false}) {
+        leader_detection_options options;
+        options.use_weights = use_weights;
+        options.cache_size = 0;
+
+        leader_detection_stats uncached_stats;
+        leader_data uncached = detect_leaders(fd, options, &uncached_stats);
+        REQUIRE(uncached_stats.cache_hits == 0);
+
+        options.cache_size = 100;
+        leader_detection_stats stats;
+        leader_data ld = detect_leaders(fd, options, &stats);
+        REQUIRE(stats.timestamps == 80);
+        REQUIRE(stats.unchanged == 0);
+        REQUIRE(stats.cache_hits == 72);
+        REQUIRE(stats.page_rank_iterations < uncached_stats.page_rank_iterations);
+        for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+            REQUIRE(ld.data_at(ts).leaders == uncached.data_at(ts).leaders);
+        }
+
+        // Only the first 3 configurations fit into the cache.
+        options.cache_size = 3;
+        leader_detection_stats small_stats;
+        detect_leaders(fd, options, &small_stats);
+        REQUIRE(small_stats.cache_hits == 27);
+    }
+}
+
+TEST_CASE("warm start converges faster on slowly changing graphs", "[device-graph]")
+{
+    // A chain of followers; at every timestamp one of the pairs is missing.
+    vector<following_data::pair_data> chain;
+    for (i32 i = 0; i + 1 < 20; ++i) {
+        chain.push_back({i, i + 1, 1.0, following_type::following});
+    }
+
+    following_data fd;
+    for (i32 i = 0; i < 20; ++i) {
+        fd.devices.push_back("D" + std::to_string(i));
+    }
+    fd.begin_timestamp = 0;
+    fd.end_timestamp = 99;
+    fd.duration = 100;
+    fd.clear();
+    for (size_t i = 0; i < 100; ++i) {
+        for (size_t j = 0; j < chain.size(); ++j) {
+            if (j != (i / 10) % chain.size()) {
+                fd.pairs.push_back(chain[j]);
+            }
+        }
+        fd.offsets[i + 1] = fd.pairs.size();
+    }
+
+    leader_detection_options options;
+    options.use_weights = false;
+
+    leader_detection_stats cold_stats;
+    leader_data cold = detect_leaders(fd, options, &cold_stats);
+
+    options.warm_start = true;
+    leader_detection_stats warm_stats;
+    leader_data warm = detect_leaders(fd, options, &warm_stats);
+
+    REQUIRE(cold_stats.unchanged == 90);
+    REQUIRE(warm_stats.unchanged == 90);
+    REQUIRE(warm_stats.page_rank_iterations < cold_stats.page_rank_iterations);
+    for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+        REQUIRE(warm.data_at(ts).leaders == cold.data_at(ts).leaders);
+    }
+}
+
+TEST_CASE("parallel leader detection", "[device-graph]")
+{
+    following_data fd = make_random_following_data(10, 300, 5);
+
+    leader_detection_options options;
+    leader_data expected = detect_leaders(fd, options);
+    for (i32 threads : {2, 3, 8, 1000}) {
+        options.threads = threads;
+
+        leader_detection_stats stats;
+        leader_data ld = detect_leaders(fd, options, &stats);
+        REQUIRE(stats.timestamps == 300);
+        REQUIRE(ld.timestamps.size() == expected.timestamps.size());
+        for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+            REQUIRE(ld.data_at(ts).timestamp == ts);
+            REQUIRE(ld.data_at(ts).leaders == expected.data_at(ts).leaders);
+        }
+    }
+
+    options.threads = 0;
+    REQUIRE_THROWS_AS(detect_leaders(fd, options), std::invalid_argument);
+}
+
+TEST_CASE("component leaders", "[device-graph]")
+{
+    SECTION("small components in closed form") {
+        vector<following_data::pair_data> pairs{
+            {0, 1, 1, following_type::following},   // 0 -> 1
+            {3, 2, 1, following_type::following},   // 3 -> 2
+            {4, 5, 0, following_type::co_leading},  // 4 <-> 5
+            {7, 8, 2, following_type::leading},     // 8 -> 7
+        };
+        device_graph g;
+        g.assign(9, pairs);
+
+        component_leaders finder;
+        vector<double> ranks;
+        vector<i32> leaders;
+        REQUIRE(finder.find(g, true, 0.85, 1e-6, 500, ranks, leaders) == 0);
+        REQUIRE(leaders == vector<i32>({1, 2, 5, 6, 7}));
+        REQUIRE(ranks[0] == Approx(1 / 2.85));
+        REQUIRE(ranks[1] == Approx(1.85 / 2.85));
+        REQUIRE(ranks[4] == 0.5);
+        REQUIRE(ranks[5] == 0.5);
+        REQUIRE(ranks[6] == 1.0);
+    }
+
+    SECTION("same leaders as page rank over the entire graph") {
+        following_data fd = make_random_following_data(12, 200, 6);
+
+        device_graph g;
+        component_leaders finder;
+        vector<double> ranks, global_ranks;
+        vector<i32> leaders, components, stack;
+        for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+            g.assign(12, fd.data_at(ts).co_moving);
+
+            for (bool use_weights : {true, false}) {
+                finder.find(g, use_weights, 0.85, 1e-10, 1000, ranks, leaders);
+                page_rank(g, use_weights, 0.85, 1e-10, 1000, global_ranks);
+                const i32 count = connected_components(g, components, stack);
+                REQUIRE(leaders.size() == size_t(count));
+
+                // The leader has the highest global rank within its component
+                // (up to rounding errors, which may decide between equal ranks).
+                for (i32 c = 0; c < count; ++c) {
+                    REQUIRE(components[leaders[c]] == c);
+                    for (i32 v = 0; v < 12; ++v) {
+                        if (components[v] == c) {
+                            REQUIRE(global_ranks[v] <= global_ranks[leaders[c]] + 1e-8);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,286 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+#include "../src/cmd/common/feature_file.hpp"
+
+using namespace mp;
+
+namespace {
+
+// Removes the file when the test is done.
+struct temp_file
+{
+    string path;
+
+    explicit temp_file(string path): path(std::move(path)) {}
+    ~temp_file() { std::remove(path.c_str()); }
+};
+
+feature_parameters test_params()
+{
+    feature_parameters p;
+    p.data_source = "wifi";
+    p.algorithm = "dtw";
+    p.window_size = 10;
+    p.time_lag = 1;
+    return p;
+}
+
+similarity_data test_data()
+{
+    similarity_data sim;
+    sim.begin_timestamp = 5;
+    sim.end_timestamp = 9;
+    sim.duration = 5;
+    sim.feature_dimension = 3;
+    sim.devices = {"A", "B", "C"};
+
+    similarity_data::pair_data p1;
+    p1.left = 0;
+    p1.right = 1;
+    p1.features = array_2d<double>(5, 3);
+    for (i32 t = 0; t < 5; ++t) {
+        for (i32 f = 0; f < 3; ++f) {
+            p1.features.cell(t, f) = t * 10 + f;
+        }
+    }
+    p1.segments.push_back(similarity_data::segment{5, 9, 0});
+
+    similarity_data::pair_data p2;
+    p2.left = 2;
+    p2.right = 0;
+    p2.features = array_2d<double>(4, 3);
+    for (i32 t = 0; t < 4; ++t) {
+        for (i32 f = 0; f < 3; ++f) {
+            p2.features.cell(t, f) = -t - f;
+        }
+    }
+    p2.segments.push_back(similarity_data::segment{5, 6, 0});
+    p2.segments.push_back(similarity_data::segment{8, 9, 2});
+
+    sim.pairs.push_back(std::move(p1));
+    sim.pairs.push_back(std::move(p2));
+    return sim;
+}
+
+// Writes the feature file layout that was used before the format had a version.
+template<typename Archive>
+void save_legacy_feature_file(Archive &ar, const similarity_data &sim,
+                              const feature_parameters &p)
+{
+    ar(cereal::make_nvp("params", p));
+    ar.setNextName("feature_data");
+    ar.startNode();
+    ar(cereal::make_nvp("begin_timestamp", sim.begin_timestamp),
+       cereal::make_nvp("end_timestamp", sim.end_timestamp),
+       cereal::make_nvp("duration", sim.duration),
+       cereal::make_nvp("feature_dimension", sim.feature_dimension),
+       cereal::make_nvp("devices", sim.devices));
+    ar.setNextName("pairs");
+    ar.startNode();
+    ar.makeArray();
+    ar(cereal::make_size_tag(static_cast<cereal::size_type>(sim.pairs.size())));
+    for (const auto &pair : sim.pairs) {
+        ar.startNode();
+        ar(cereal::make_nvp("left", pair.left),
+           cereal::make_nvp("right", pair.right),
+           cereal::make_nvp("features", pair.features));
+        ar.finishNode();
+    }
+    ar.finishNode();
+    ar.finishNode();
+}
+
+void save_legacy_feature_file(cereal::PortableBinaryOutputArchive &ar,
+                              const similarity_data &sim,
+                              const feature_parameters &p)
+{
+    ar(p);
+    ar(sim.begin_timestamp, sim.end_timestamp, sim.duration,
+       sim.feature_dimension, sim.devices);
+    ar(cereal::make_size_tag(static_cast<cereal::size_type>(sim.pairs.size())));
+    for (const auto &pair : sim.pairs) {
+        ar(pair.left, pair.right, pair.features);
+    }
+}
+
+bool same_segments(const vector<similarity_data::segment> &a,
+                   const vector<similarity_data::segment> &b)
+{
+    return a.size() == b.size()
+            && std::equal(a.begin(), a.end(), b.begin(),
+                          [](const similarity_data::segment &x, const similarity_data::segment &y) {
+                              return x.begin == y.begin && x.end == y.end && x.row == y.row;
+                          });
+}
+
+void require_same_header(const similarity_data &a, const similarity_data &b)
+{
+    REQUIRE(a.begin_timestamp == b.begin_timestamp);
+    REQUIRE(a.end_timestamp == b.end_timestamp);
+    REQUIRE(a.duration == b.duration);
+    REQUIRE(a.feature_dimension == b.feature_dimension);
+    REQUIRE(a.devices == b.devices);
+}
+
+void require_same_params(const feature_parameters &a, const feature_parameters &b)
+{
+    REQUIRE(a.data_source == b.data_source);
+    REQUIRE(a.algorithm == b.algorithm);
+    REQUIRE(a.window_size == b.window_size);
+    REQUIRE(a.time_lag == b.time_lag);
+}
+
+} // namespace
+
+TEST_CASE("feature files without a version can be loaded", "[feature-file]")
+{
+    // Old feature files only contain dense pairs.
+    similarity_data sim = test_data();
+    sim.pairs[1].features.resize(5, 3, 0.0);
+    const feature_parameters params = test_params();
+
+    for (string type : {"json", "binary"}) {
+        SECTION(type) {
+            temp_file file("mp-test-legacy-features." + type);
+            {
+                std::ofstream out(file.path, std::ios_base::out | std::ios_base::binary);
+                if (type == "json") {
+                    cereal::JSONOutputArchive ar(out);
+                    save_legacy_feature_file(ar, sim, params);
+                } else {
+                    cereal::PortableBinaryOutputArchive ar(out);
+                    save_legacy_feature_file(ar, sim, params);
+                }
+            }
+
+            similarity_data loaded;
+            feature_parameters loaded_params;
+            read_feature_file(file.path, type, loaded, loaded_params);
+
+            require_same_params(loaded_params, params);
+            require_same_header(loaded, sim);
+            REQUIRE(loaded.pairs.size() == sim.pairs.size());
+            for (size_t i = 0; i < sim.pairs.size(); ++i) {
+                REQUIRE(loaded.pairs[i].left == sim.pairs[i].left);
+                REQUIRE(loaded.pairs[i].right == sim.pairs[i].right);
+                REQUIRE(loaded.pairs[i].features == sim.pairs[i].features);
+                REQUIRE(loaded.pairs[i].segments.empty());
+            }
+        }
+    }
+}
+
+TEST_CASE("feature files can be written and read", "[feature-file]")
+{
+    const similarity_data sim = test_data();
+    const feature_parameters params = test_params();
+
+    for (string type : {"json", "compact-json", "binary"}) {
+        SECTION(type) {
+            temp_file file("mp-test-features." + type);
+            write_feature_file(file.path, type, sim, params);
+
+            similarity_data loaded;
+            feature_parameters loaded_params;
+            read_feature_file(file.path, type == "binary" ? "binary" : "json",
+                              loaded, loaded_params);
+
+            require_same_params(loaded_params, params);
+            require_same_header(loaded, sim);
+            REQUIRE(loaded.pairs.size() == sim.pairs.size());
+            for (size_t i = 0; i < sim.pairs.size(); ++i) {
+                REQUIRE(loaded.pairs[i].left == sim.pairs[i].left);
+                REQUIRE(loaded.pairs[i].right == sim.pairs[i].right);
+                REQUIRE(loaded.pairs[i].features == sim.pairs[i].features);
+                REQUIRE(same_segments(loaded.pairs[i].segments, sim.pairs[i].segments));
+            }
+        }
+    }
+}
+
+TEST_CASE("binary feature streams read the pairs of a feature file", "[feature-file]")
+{
+    const similarity_data sim = test_data();
+    const feature_parameters params = test_params();
+
+    temp_file file("mp-test-feature-stream.binary");
+    write_feature_file(file.path, "binary", sim, params);
+
+    binary_feature_stream stream(file.path);
+    require_same_params(stream.params(), params);
+    require_same_header(stream.header(), sim);
+    REQUIRE(stream.header().pairs.empty());
+
+    similarity_data::pair_data pair;
+    for (const auto &expected : sim.pairs) {
+        REQUIRE(stream.next(pair));
+        REQUIRE(pair.left == expected.left);
+        REQUIRE(pair.right == expected.right);
+        REQUIRE(pair.features == expected.features);
+        REQUIRE(same_segments(pair.segments, expected.segments));
+    }
+    REQUIRE(!stream.next(pair));
+}
+
+TEST_CASE("binary feature streams reject malformed files", "[feature-file]")
+{
+    const feature_parameters params = test_params();
+
+    SECTION("device index out of range") {
+        similarity_data sim = test_data();
+        sim.pairs[1].left = 3;
+
+        temp_file file("mp-test-bad-device.binary");
+        write_feature_file(file.path, "binary", sim, params);
+
+        binary_feature_stream stream(file.path);
+        similarity_data::pair_data pair;
+        REQUIRE(stream.next(pair));
+        REQUIRE_THROWS_AS(stream.next(pair), const std::runtime_error &);
+    }
+
+    SECTION("segment outside of the time range") {
+        similarity_data sim = test_data();
+        sim.pairs[0].segments[0].end = 10;
+
+        temp_file file("mp-test-bad-segment.binary");
+        write_feature_file(file.path, "binary", sim, params);
+
+        binary_feature_stream stream(file.path);
+        similarity_data::pair_data pair;
+        REQUIRE_THROWS_AS(stream.next(pair), const std::runtime_error &);
+    }
+
+    SECTION("mismatched parameters") {
+        feature_parameters bad_params = params;
+        bad_params.time_lag = 2;
+
+        temp_file file("mp-test-bad-params.binary");
+        write_feature_file(file.path, "binary", test_data(), bad_params);
+
+        REQUIRE_THROWS_AS(binary_feature_stream stream(file.path), const std::runtime_error &);
+    }
+
+    SECTION("truncated file") {
+        temp_file file("mp-test-truncated.binary");
+        write_feature_file(file.path, "binary", test_data(), params);
+
+        string contents;
+        {
+            std::ifstream in(file.path, std::ios_base::in | std::ios_base::binary);
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        {
+            std::ofstream out(file.path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            out.write(contents.data(), contents.size() - 8);
+        }
+
+        binary_feature_stream stream(file.path);
+        similarity_data::pair_data pair;
+        REQUIRE(stream.next(pair));
+        REQUIRE_THROWS(stream.next(pair));
+    }
+}
@@ -1,6 +1,9 @@
 #include "catch.hpp"
 
 #include <iostream>
+#include <sstream>
+
+#include <cereal/archives/json.hpp>
 
 #include "mp/following_detection.hpp"
 #include "mp/tools/array_2d.hpp"
@@ -32,3 +35,78 @@ TEST_CASE("estimates time lag correctly", "[following-detection]")
     REQUIRE(est3 == 2.0);
     REQUIRE(est.get_following_type(est3) == following_type::leading);
 }
+
+TEST_CASE("following data serialization", "[following-detection]")
+{
+    following_data data;
+    data.devices = {"A", "B", "C"};
+    data.begin_timestamp = 10;
+    data.end_timestamp = 12;
+    data.duration = 3;
+    data.offsets = {0, 2, 2, 3};
+    data.pairs = {
+        {0, 1, -1.5, following_type::following},
+        {2, 0,  2.0, following_type::leading},
+        {1, 2,  0.0, following_type::co_leading},
+    };
+
+    std::stringstream buffer;
+    {
+        cereal::JSONOutputArchive ar(buffer);
+        ar(cereal::make_nvp("followers", data));
+    }
+
+    // One object per timestamp.
+    REQUIRE(buffer.str().find("\"timestamp\": 11") != string::npos);
+
+    following_data loaded;
+    {
+        cereal::JSONInputArchive ar(buffer);
+        ar(cereal::make_nvp("followers", loaded));
+    }
+
+    REQUIRE(loaded.devices == data.devices);
+    REQUIRE(loaded.offsets == data.offsets);
+    REQUIRE(loaded.pairs.size() == data.pairs.size());
+    for (i64 ts = 10; ts <= 12; ++ts) {
+        auto expected = data.data_at(ts);
+        auto actual = loaded.data_at(ts);
+        REQUIRE(actual.timestamp == ts);
+        REQUIRE(actual.co_moving.size() == expected.co_moving.size());
+        for (size_t i = 0; i < expected.co_moving.size(); ++i) {
+            REQUIRE(actual.co_moving[i].left == expected.co_moving[i].left);
+            REQUIRE(actual.co_moving[i].right == expected.co_moving[i].right);
+            REQUIRE(actual.co_moving[i].lag == expected.co_moving[i].lag);
+            REQUIRE(actual.co_moving[i].type == expected.co_moving[i].type);
+        }
+    }
+    REQUIRE(loaded.data_at(11).co_moving.size() == 0);
+}
+
+TEST_CASE("serialization of following data without offsets", "[following-detection]")
+{
+    // clear() has never been called.
+    following_data data;
+    data.devices = {"A", "B"};
+    data.begin_timestamp = 5;
+    data.end_timestamp = 6;
+    data.duration = 2;
+
+    std::stringstream buffer;
+    {
+        cereal::JSONOutputArchive ar(buffer);
+        ar(cereal::make_nvp("followers", data));
+    }
+
+    following_data loaded;
+    {
+        cereal::JSONInputArchive ar(buffer);
+        ar(cereal::make_nvp("followers", loaded));
+    }
+
+    REQUIRE(loaded.devices == data.devices);
+    REQUIRE(loaded.offsets == vector<size_t>({0, 0, 0}));
+    REQUIRE(loaded.pairs.empty());
+    REQUIRE(loaded.data_at(5).co_moving.size() == 0);
+    REQUIRE(loaded.data_at(6).co_moving.size() == 0);
+}
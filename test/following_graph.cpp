@@ -6,6 +6,10 @@
 #include <boost/functional/hash.hpp>
 #include <cereal/archives/json.hpp>
 
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
 #include <unordered_set>
 
 using namespace mp;
@@ -41,15 +45,11 @@ TEST_CASE("graph construction", "[following-graph]")
     data.begin_timestamp = 0;
     data.end_timestamp = 0;
     data.duration = 0;
-    data.timestamps = {
-        {
-            // Timestamp 0
-            0,
-            {
-                {0, 1, -5, following_type::following},
-                {2, 0,  2, following_type::leading},
-            }
-        }
+    data.offsets = {0, 2};
+    data.pairs = {
+        // Timestamp 0
+        {0, 1, -5, following_type::following},
+        {2, 0,  2, following_type::leading},
     };
 
     // Out of range:
@@ -98,3 +98,140 @@ TEST_CASE("graph serialization", "[following-graph]")
     REQUIRE(get_name_set(test) == get_name_set(g));
     REQUIRE(get_edge_set(test) == get_edge_set(g));
 }
+
+// The groups of every device at the given timestamp, according to the membership intervals.
+// Checks that no device is a member of two groups at the same time.
+static map<i32, i64> groups_at(const group_data &gd, i64 ts)
+{
+    map<i32, i64> result;
+    for (const auto &group : gd.groups) {
+        for (const auto &m : group.members) {
+            if (m.begin <= ts && ts <= m.end) {
+                REQUIRE(group.begin <= m.begin);
+                REQUIRE(m.end <= group.end);
+                REQUIRE(result.count(m.device) == 0);
+                result[m.device] = group.id;
+            }
+        }
+    }
+    return result;
+}
+
+TEST_CASE("group detection over time", "[following-graph]")
+{
+    following_data fd;
+    fd.devices = {"A", "B", "C", "D", "E"};
+    fd.begin_timestamp = 0;
+    fd.end_timestamp = 5;
+    fd.duration = 6;
+    fd.clear();
+
+    auto add = [&](i64 ts, vector<following_data::pair_data> pairs) {
+        for (i64 t = ts; t <= fd.end_timestamp; ++t) {
+            fd.offsets[t + 1] += pairs.size();
+        }
+        auto pos = fd.pairs.begin() + fd.offsets[ts];
+        fd.pairs.insert(pos, pairs.begin(), pairs.end());
+    };
+    add(0, {{0, 1, 1, following_type::following}});                                     // AB
+    add(1, {{0, 1, 1, following_type::following}});                                     // AB
+    add(2, {{0, 1, 1, following_type::following}, {2, 1, 1, following_type::leading},
+            {3, 4, 1, following_type::co_leading}});                                    // ABC DE
+    add(3, {{0, 1, 1, following_type::following}, {1, 2, 1, following_type::following},
+            {2, 3, 1, following_type::following}, {3, 4, 1, following_type::following}}); // ABCDE
+    add(4, {{0, 1, 1, following_type::following}, {3, 4, 1, following_type::following}}); // AB DE
+    // No edges at 5.
+
+    group_data gd = detect_groups(fd);
+    REQUIRE(gd.devices == fd.devices);
+    REQUIRE(gd.groups.size() == 3);
+
+    // AB keeps its ID while C, D and E join and leave.
+    // DE merges into it (the larger group keeps its ID) and is split off again with a new ID.
+    const auto &g0 = gd.groups[0];
+    REQUIRE(g0.id == 0);
+    REQUIRE(g0.begin == 0);
+    REQUIRE(g0.end == 4);
+    REQUIRE(g0.members.size() == 5);
+    auto check = [](const group_data::membership &m, i32 device, i64 begin, i64 end) {
+        REQUIRE(m.device == device);
+        REQUIRE(m.begin == begin);
+        REQUIRE(m.end == end);
+    };
+    check(g0.members[0], 0, 0, 4);
+    check(g0.members[1], 1, 0, 4);
+    check(g0.members[2], 2, 2, 3);
+    check(g0.members[3], 3, 3, 3);
+    check(g0.members[4], 4, 3, 3);
+
+    const auto &g1 = gd.groups[1];
+    REQUIRE(g1.id == 1);
+    REQUIRE(g1.begin == 2);
+    REQUIRE(g1.end == 2);
+    REQUIRE(g1.members.size() == 2);
+    check(g1.members[0], 3, 2, 2);
+    check(g1.members[1], 4, 2, 2);
+
+    const auto &g2 = gd.groups[2];
+    REQUIRE(g2.id == 2);
+    REQUIRE(g2.begin == 4);
+    REQUIRE(g2.end == 4);
+    REQUIRE(g2.members.size() == 2);
+    check(g2.members[0], 3, 4, 4);
+    check(g2.members[1], 4, 4, 4);
+
+    REQUIRE(groups_at(gd, 5).empty());
+}
+
+TEST_CASE("group detection matches per-timestamp components", "[following-graph]")
+{
+    following_data fd;
+    for (i32 i = 0; i < 12; ++i) {
+        fd.devices.push_back("D" + to_string(i));
+    }
+    fd.begin_timestamp = 100;
+    fd.end_timestamp = 499;
+    fd.duration = 400;
+    fd.clear();
+
+    // Edges appear and disappear slowly, like in real recordings.
+    mt19937 rng(7);
+    uniform_int_distribution<i32> device_dist(0, 11);
+    bernoulli_distribution change_dist(0.4);
+    vector<following_data::pair_data> current;
+    for (size_t i = 0; i < 400; ++i) {
+        if (change_dist(rng) && !current.empty()) {
+            current.erase(current.begin() + i32(rng() % current.size()));
+        }
+        if (change_dist(rng)) {
+            current.push_back({device_dist(rng), device_dist(rng), 1, following_type::following});
+        }
+        fd.pairs.insert(fd.pairs.end(), current.begin(), current.end());
+        fd.offsets[i + 1] = fd.pairs.size();
+    }
+
+    group_data gd = detect_groups(fd);
+    for (size_t i = 0; i < gd.groups.size(); ++i) {
+        REQUIRE(gd.groups[i].id == i64(i));
+        REQUIRE(!gd.groups[i].members.empty());
+    }
+
+    for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+        set<set<string>> expected;
+        for (const auto &group : detect_groups(following_graph_at(fd, ts))) {
+            if (group.size() >= 2) {
+                expected.emplace(group.begin(), group.end());
+            }
+        }
+
+        map<i64, set<string>> members;
+        for (const auto &entry : groups_at(gd, ts)) {
+            members[entry.second].insert(fd.devices[entry.first]);
+        }
+        set<set<string>> actual;
+        for (const auto &entry : members) {
+            actual.insert(entry.second);
+        }
+        REQUIRE(actual == expected);
+    }
+}
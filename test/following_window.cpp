@@ -0,0 +1,164 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+
+#include "mp/following_graph.hpp"
+#include "mp/following_window.hpp"
+
+using namespace mp;
+
+// Random following data where every pair of devices keeps its relation
+// for a few seconds, like devices that move together for a while.
+// There is at most one relation per pair of devices, thus the per-second
+// graphs have no parallel edges.
+static following_data make_following_data(i32 devices, i64 duration, u32 seed)
+{
+    following_data fd;
+    for (i32 i = 0; i < devices; ++i) {
+        fd.devices.push_back("D" + std::to_string(i));
+    }
+    fd.begin_timestamp = 1000;
+    fd.end_timestamp = 1000 + duration - 1;
+    fd.duration = duration;
+    fd.clear();
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<i32> device_dist(0, devices - 1);
+    std::uniform_int_distribution<i32> type_dist(0, 2);
+    std::uniform_int_distribution<i32> lag_dist(-4, 4);
+    std::bernoulli_distribution change_dist(0.3);
+
+    vector<following_data::pair_data> current;
+    for (size_t i = 0; i < size_t(duration); ++i) {
+        if (change_dist(rng)) {
+            if (!current.empty() && change_dist(rng)) {
+                current.erase(current.begin() + i32(rng() % current.size()));
+            }
+            i32 left = device_dist(rng);
+            i32 right = device_dist(rng);
+            bool known = left == right;
+            for (const auto &pair : current) {
+                known = known || (std::min(left, right) == std::min(pair.left, pair.right)
+                                  && std::max(left, right) == std::max(pair.left, pair.right));
+            }
+            if (!known) {
+                following_type type = static_cast<following_type>(type_dist(rng));
+                current.push_back({left, right, double(lag_dist(rng)), type});
+            }
+        }
+        fd.pairs.insert(fd.pairs.end(), current.begin(), current.end());
+        fd.offsets[i + 1] = fd.pairs.size();
+    }
+    return fd;
+}
+
+// Sums the edges of all timestamps in [begin, end] using the per-timestamp graphs.
+static std::map<std::pair<i32, i32>, double>
+aggregate(const following_data &fd, i64 begin, i64 end, double decay)
+{
+    std::map<std::pair<i32, i32>, double> result;
+    for (i64 ts = begin; ts <= end; ++ts) {
+        following_graph g = following_graph_at(fd, ts);
+        for (auto e : make_iter_range(edges(g))) {
+            auto key = std::make_pair(i32(source(e, g)), i32(target(e, g)));
+            result[key] += g[e].weight * std::pow(decay, double(end - ts));
+        }
+    }
+    return result;
+}
+
+TEST_CASE("following window aggregation", "[following-window]")
+{
+    following_data fd = make_following_data(8, 300, 1);
+
+    for (double decay : {1.0, 0.9}) {
+        following_window w(fd, 20, decay);
+        REQUIRE(w.edges().empty());
+
+        // Forward in small and large steps, then backwards.
+        vector<i64> ends{1000, 1001, 1005, 1019, 1020, 1030, 1100, 1101, 1299, 1050, 1060};
+        for (i64 end : ends) {
+            w.move_to(end);
+            REQUIRE(w.end_timestamp() == end);
+            REQUIRE(w.begin_timestamp() == std::max(i64(1000), end - 19));
+
+            auto expected = aggregate(fd, w.begin_timestamp(), end, decay);
+            REQUIRE(w.edges().size() == expected.size());
+            for (const auto &edge : w.edges()) {
+                REQUIRE(edge.type == following_type::following);
+                auto iter = expected.find(std::make_pair(edge.left, edge.right));
+                REQUIRE(iter != expected.end());
+                REQUIRE(edge.lag == Approx(iter->second));
+            }
+        }
+    }
+
+    REQUIRE_THROWS_AS(following_window(fd, 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(following_window(fd, 10, 0.0), std::invalid_argument);
+    REQUIRE_THROWS_AS(following_window(fd, 10, 1.5), std::invalid_argument);
+
+    following_window w(fd, 10);
+    REQUIRE_THROWS_AS(w.move_to(999), std::logic_error);
+    REQUIRE_THROWS_AS(w.move_to(1300), std::logic_error);
+}
+
+TEST_CASE("leader detection on sliding windows", "[following-window]")
+{
+    following_data fd = make_following_data(10, 205, 2);
+
+    SECTION("windows of a single second are the per-second graphs") {
+        window_options window;
+        window.size = 1;
+        window.step = 1;
+
+        leader_detection_options options;
+        options.use_weights = false;
+
+        leader_data expected = detect_leaders(fd, options);
+        leader_data ld = detect_leaders(fd, window, options);
+        REQUIRE(ld.timestamps.size() == expected.timestamps.size());
+        for (i64 ts = fd.begin_timestamp; ts <= fd.end_timestamp; ++ts) {
+            REQUIRE(ld.data_at(ts).timestamp == ts);
+            REQUIRE(ld.data_at(ts).leaders == expected.data_at(ts).leaders);
+        }
+    }
+
+    SECTION("leaders are reported for every step") {
+        window_options window;
+        window.size = 60;
+        window.step = 10;
+        window.decay = 0.95;
+
+        for (i32 threads : {1, 3}) {
+            leader_detection_options options;
+            options.threads = threads;
+
+            leader_detection_stats stats;
+            leader_data ld = detect_leaders(fd, window, options, &stats);
+            REQUIRE(stats.timestamps == 21);
+            REQUIRE(ld.timestamps.size() == 205);
+
+            following_window w(fd, window.size, window.decay);
+            for (i64 end = fd.begin_timestamp; end <= fd.end_timestamp; end += window.step) {
+                w.move_to(end);
+                following_graph g = following_graph_at(w);
+                vector<string> expected = detect_leaders(g, true);
+                for (i64 ts = end; ts < end + window.step && ts <= fd.end_timestamp; ++ts) {
+                    REQUIRE(ld.data_at(ts).timestamp == ts);
+                    REQUIRE(ld.data_at(ts).leaders == expected);
+                }
+
+                // Groups of the aggregated graph.
+                vector<vector<string>> groups = detect_groups(g);
+                REQUIRE(groups.size() == expected.size());
+            }
+        }
+    }
+
+    window_options invalid;
+    invalid.step = 0;
+    REQUIRE_THROWS_AS(detect_leaders(fd, invalid, leader_detection_options()), std::invalid_argument);
+}
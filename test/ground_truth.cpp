@@ -1,6 +1,15 @@
 #include "catch.hpp"
 
+#include <functional>
+#include <random>
+#include <sstream>
+
+#include <cereal/archives/json.hpp>
+
 #include "mp/ground_truth.hpp"
+#include "mp/ground_truth_labels.hpp"
+
+#include "../src/cmd/common/ground_truth_file.hpp"
 
 using namespace mp;
 
@@ -36,3 +45,220 @@ TEST_CASE("ground truth co-moving detection", "[ground-truth]")
     REQUIRE_FALSE(g.co_moving_at(2, "DEVICE_A", "DEVICE_B")); // second group overrides
     REQUIRE_FALSE(g.co_moving_at(2, "DEVICE_C", "DEVICE_B"));
 }
+
+TEST_CASE("interval ground truth matches the dense ground truth", "[ground-truth]")
+{
+    ground_truth_builder builder;
+    builder.add("DEVICE_A", 0, 9, 1, 0);
+    builder.add("DEVICE_B", 0, 9, 1, 1);
+    builder.add("DEVICE_A", 3, 5, 2, 0);    // overrides group 1
+    builder.add("DEVICE_C", 3, 5, 2, 1);
+    builder.add("DEVICE_C", 7, 12, 0, 0);   // lower group, but DEVICE_C has no other entry
+
+    ground_truth dense = builder.to_ground_truth();
+    interval_ground_truth intervals = builder.to_intervals();
+    interval_ground_truth converted = make_interval_ground_truth(dense);
+
+    REQUIRE(intervals.begin_timestamp == 0);
+    REQUIRE(intervals.end_timestamp == 12);
+    REQUIRE(intervals.devices.size() == 3);
+
+    i32 a = intervals.device_index("DEVICE_A");
+    REQUIRE(a != -1);
+    REQUIRE(intervals.memberships[a].size() == 3);
+    REQUIRE(intervals.device_index("DEVICE_D") == -1);
+
+    const vector<string> names{"DEVICE_A", "DEVICE_B", "DEVICE_C", "DEVICE_D"};
+    for (i64 ts = -1; ts <= 13; ++ts) {
+        for (auto &left : names) {
+            for (auto &right : names) {
+                ground_truth_relation expected = dense.relation_at(ts, left, right);
+                REQUIRE(intervals.relation_at(ts, left, right) == expected);
+                REQUIRE(converted.relation_at(ts, left, right) == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("interval ground truth resolves many overlapping entries", "[ground-truth]")
+{
+    // Many overlapping entries per device, with equal groups
+    // (the latest entry wins) and gaps.
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<i64> begin_dist(0, 300);
+    std::uniform_int_distribution<i64> length_dist(0, 40);
+    std::uniform_int_distribution<i32> group_dist(0, 3);
+    std::uniform_int_distribution<i32> order_dist(0, 5);
+
+    const vector<string> names{"DEVICE_A", "DEVICE_B", "DEVICE_C"};
+    ground_truth_builder builder;
+    for (i32 i = 0; i < 300; ++i) {
+        const i64 begin = begin_dist(rng);
+        builder.add(names[size_t(i) % names.size()], begin, begin + length_dist(rng),
+                    group_dist(rng), order_dist(rng));
+    }
+
+    interval_ground_truth intervals = builder.to_intervals();
+    interval_ground_truth expected = make_interval_ground_truth(builder.to_ground_truth());
+    for (const string &name : names) {
+        const i32 device = intervals.device_index(name);
+        const i32 expected_device = expected.device_index(name);
+        for (i64 ts = -1; ts <= 342; ++ts) {
+            const auto *m = intervals.membership_at(device, ts);
+            const auto *e = expected.membership_at(expected_device, ts);
+            REQUIRE(bool(m) == bool(e));
+            if (m) {
+                REQUIRE(m->group == e->group);
+                REQUIRE(m->order == e->order);
+            }
+        }
+    }
+}
+
+TEST_CASE("interval ground truth merges adjacent intervals", "[ground-truth]")
+{
+    ground_truth_builder builder;
+    builder.add("DEVICE_A", 0, 4, 1, 0);
+    builder.add("DEVICE_A", 5, 9, 1, 0);
+    builder.add("DEVICE_A", 12, 14, 1, 0);
+
+    interval_ground_truth gt = builder.to_intervals();
+    REQUIRE(gt.memberships.size() == 1);
+
+    auto &list = gt.memberships[0];
+    REQUIRE(list.size() == 2);
+    REQUIRE(list[0].begin == 0);
+    REQUIRE(list[0].end == 9);
+    REQUIRE(list[1].begin == 12);
+    REQUIRE(list[1].end == 14);
+
+    REQUIRE(gt.membership_at(0, 10) == nullptr);
+    REQUIRE(gt.membership_at(0, 12) == &list[1]);
+}
+
+TEST_CASE("interval ground truth <-> text archive", "[ground-truth]")
+{
+    ground_truth_builder builder;
+    builder.add("DEVICE_A", 0, 9, 1, 0);
+    builder.add("DEVICE_B", 2, 9, 1, 1);
+    builder.add("DEVICE_B", 3, 4, 2, 0);
+    interval_ground_truth gt = builder.to_intervals();
+
+    string serialized;
+    {
+        std::ostringstream out;
+        {
+            cereal::JSONOutputArchive ar(out);
+            ar(cereal::make_nvp("interval_ground_truth", gt));
+        }
+        serialized = out.str();
+    }
+
+    interval_ground_truth deserialized;
+    {
+        std::istringstream in(serialized);
+        cereal::JSONInputArchive ar(in);
+        ar(cereal::make_nvp("interval_ground_truth", deserialized));
+    }
+
+    REQUIRE(deserialized.begin_timestamp == 0);
+    REQUIRE(deserialized.end_timestamp == 9);
+    REQUIRE(deserialized.devices == gt.devices);
+    REQUIRE(deserialized.memberships.size() == gt.memberships.size());
+    for (i64 ts = 0; ts <= 9; ++ts) {
+        REQUIRE(deserialized.relation_at(ts, "DEVICE_A", "DEVICE_B") == gt.relation_at(ts, "DEVICE_A", "DEVICE_B"));
+    }
+    REQUIRE(deserialized.relation_at(5, "DEVICE_A", "DEVICE_B") == ground_truth_relation::leading);
+    REQUIRE(deserialized.relation_at(3, "DEVICE_A", "DEVICE_B") == ground_truth_relation::none);
+}
+
+TEST_CASE("ground truth labels match the interval lookup", "[ground-truth]")
+{
+    ground_truth_builder builder;
+    builder.add("DEVICE_A", 0, 99, 1, 0);
+    builder.add("DEVICE_B", 10, 79, 1, 1);
+    builder.add("DEVICE_C", 30, 39, 1, 0);
+    builder.add("DEVICE_C", 40, 120, 2, 0);
+    builder.add("DEVICE_B", 50, 59, 2, 1);
+    interval_ground_truth gt = builder.to_intervals();
+
+    const vector<string> devices{"DEVICE_A", "DEVICE_B", "DEVICE_C", "DEVICE_D"};
+    vector<tuple<i32, i32>> pairs;
+    for (i32 i = 0; i < 4; ++i) {
+        for (i32 j = 0; j < 4; ++j) {
+            pairs.push_back(make_tuple(i, j));
+        }
+    }
+
+    ground_truth_labels labels = make_ground_truth_labels(gt, devices, pairs, 5, 105);
+    REQUIRE(labels.num_pairs == pairs.size());
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        const string &left = devices[get<0>(pairs[p])];
+        const string &right = devices[get<1>(pairs[p])];
+        for (i64 ts = 5; ts <= 105; ++ts) {
+            REQUIRE(labels.relation_at(p, ts) == gt.relation_at(ts, left, right));
+        }
+    }
+}
+
+TEST_CASE("ground truth files are read according to their format", "[ground-truth]")
+{
+    ground_truth_builder builder;
+    builder.add("DEVICE_A", 0, 9, 1, 0);
+    builder.add("DEVICE_B", 2, 9, 1, 1);
+    builder.add("DEVICE_B", 3, 4, 2, 0);
+    const ground_truth dense = builder.to_ground_truth();
+    const interval_ground_truth intervals = builder.to_intervals();
+
+    auto require_expected = [&](const string &json) {
+        std::istringstream in(json);
+        interval_ground_truth gt;
+        read_ground_truth_json(in, gt);
+
+        REQUIRE(gt.begin_timestamp == 0);
+        REQUIRE(gt.end_timestamp == 9);
+        for (i64 ts = 0; ts <= 9; ++ts) {
+            REQUIRE(gt.relation_at(ts, "DEVICE_A", "DEVICE_B") == intervals.relation_at(ts, "DEVICE_A", "DEVICE_B"));
+        }
+    };
+    auto write = [](const std::function<void (cereal::JSONOutputArchive &)> &f) {
+        std::ostringstream out;
+        {
+            cereal::JSONOutputArchive ar(out);
+            f(ar);
+        }
+        return out.str();
+    };
+
+    SECTION("files with a format marker") {
+        require_expected(write([&](cereal::JSONOutputArchive &ar) { save_ground_truth_file(ar, dense); }));
+        require_expected(write([&](cereal::JSONOutputArchive &ar) { save_ground_truth_file(ar, intervals); }));
+    }
+
+    SECTION("the marker wins over the first key") {
+        require_expected(write([&](cereal::JSONOutputArchive &ar) {
+            ar(cereal::make_nvp("source", string("test")),
+               cereal::make_nvp("format", string(dense_ground_truth_marker)),
+               cereal::make_nvp("ground_truth", dense));
+        }));
+    }
+
+    SECTION("files without a format marker") {
+        require_expected(write([&](cereal::JSONOutputArchive &ar) {
+            ar(cereal::make_nvp("ground_truth", dense));
+        }));
+        require_expected(write([&](cereal::JSONOutputArchive &ar) {
+            ar(cereal::make_nvp("interval_ground_truth", intervals));
+        }));
+    }
+
+    SECTION("unknown formats") {
+        const string json = write([&](cereal::JSONOutputArchive &ar) {
+            ar(cereal::make_nvp("format", string("something else")),
+               cereal::make_nvp("interval_ground_truth", intervals));
+        });
+        std::istringstream in(json);
+        interval_ground_truth gt;
+        REQUIRE_THROWS_AS(read_ground_truth_json(in, gt), const std::runtime_error &);
+    }
+}
@@ -28,6 +28,16 @@ bool container_equal(const ContainerA &a, const ContainerB &b)
     return std::equal(a.begin(), a.end(), b.begin());
 }
 
+std::ostream& operator<<(std::ostream &o, const signal_data::measurement &data)
+{
+    o << "{"
+      << data.timestamp << ","
+      << data.access_point_id << ","
+      << data.signal_strength
+      << "}";
+    return o;
+}
+
 template<typename Container>
 string to_string(const Container &a)
 {
@@ -44,16 +54,6 @@ string to_string(const Container &a)
     return out.str();
 }
 
-std::ostream& operator<<(std::ostream &o, const signal_data::measurement &data)
-{
-    o << "{"
-      << data.timestamp << ","
-      << data.access_point_id << ","
-      << data.signal_strength
-      << "}";
-    return o;
-}
-
 TEST_CASE("parses signal strength lines correctly", "[parser]")
 {
     string input = "123456;DEVICE_1;AP_1=-50,2400,ignore,ignore;AP_2=-60,2442,ignore,ignore\n"
@@ -190,6 +190,111 @@ TEST_CASE("parses location files", "[parser]")
     }
 }
 
+TEST_CASE("signal data buffer parser matches the stream parser", "[parser]")
+{
+    string input = "123456;DEVICE_1;AP_1=-50,2400,ignore,ignore;AP_2=-60,2442,ignore,ignore\r\n"
+                   "123457;DEVICE_1;pos=;id=\n"
+                   "123457;DEVICE_1;AP_1=-50,2400,ignore,ignore;AP_3=-80,2442,ignore,ignore\n"
+                   "123457;DEVICE_2;AP_1=-55,2400,ignore,ignore;\n"
+                   "123454;DEVICE_2;AP_1=-54,2400,ignore,ignore";
+
+    std::stringstream str(input);
+    signal_data expected = parse_signal_data(str);
+    signal_data got = parse_signal_data(input.data(), input.data() + input.size());
+
+    REQUIRE(container_equal(got.bssids, expected.bssids));
+    REQUIRE(got.devices.size() == expected.devices.size());
+    for (size_t i = 0; i < got.devices.size(); ++i) {
+        REQUIRE(got.devices[i].name == expected.devices[i].name);
+
+        INFO("Device: " << got.devices[i].name);
+        INFO("The actual measurements are: " << to_string(got.devices[i].data));
+        INFO("Expected: " << to_string(expected.devices[i].data));
+
+        using measurement = signal_data::measurement;
+        bool eq = container_equal(got.devices[i].data, expected.devices[i].data,
+                                  [](const measurement &a, const measurement &b) {
+            return a.timestamp == b.timestamp
+                    && a.access_point_id == b.access_point_id
+                    && a.signal_strength == b.signal_strength;
+        });
+        REQUIRE(eq);
+    }
+
+    string invalid = "123456;DEVICE_1;AP_1=x50,2400\n";
+    REQUIRE_THROWS(parse_signal_data(invalid.data(), invalid.data() + invalid.size()));
+}
+
+TEST_CASE("parallel signal data parser is deterministic", "[parser]")
+{
+    // Devices and access points are introduced throughout the input,
+    // so every chunk has its own dictionary.
+    std::ostringstream out;
+    for (i32 i = 0; i < 200; ++i) {
+        out << (1000 - i % 17) << ";DEVICE_" << (i * 7) % 13 << ";"
+            << "AP_" << (i * 3) % 29 << "=" << -(40 + i % 50) << ",2400,,;"
+            << "AP_" << (i * 5) % 31 << "=" << -(50 + i % 40) << ",2400,,\n";
+    }
+    string input = out.str();
+
+    signal_data expected = parse_signal_data(input.data(), input.data() + input.size(), 1);
+    for (i32 threads : {2, 3, 8}) {
+        INFO("Threads: " << threads);
+        signal_data got = parse_signal_data(input.data(), input.data() + input.size(), threads);
+
+        REQUIRE(container_equal(got.bssids, expected.bssids));
+        REQUIRE(got.devices.size() == expected.devices.size());
+        for (size_t i = 0; i < got.devices.size(); ++i) {
+            REQUIRE(got.devices[i].name == expected.devices[i].name);
+
+            using measurement = signal_data::measurement;
+            bool eq = container_equal(got.devices[i].data, expected.devices[i].data,
+                                      [](const measurement &a, const measurement &b) {
+                return a.timestamp == b.timestamp
+                        && a.access_point_id == b.access_point_id
+                        && a.signal_strength == b.signal_strength;
+            });
+            REQUIRE(eq);
+        }
+    }
+}
+
+TEST_CASE("location data buffer parser matches the stream parser", "[parser]")
+{
+    // Numbers that are converted exactly and numbers that need
+    // the slow path (many digits, exponents).
+    string input =  "100;DEVICE_A;52.5200066;13.404954;34.5;1;2;3;4\n"
+                    "101;DEVICE_B;-0.000123;1e3;2.5E-2;2;3;4;5\n"
+                    "100;DEVICE_B;0.1;12345678901234567890;1.7976931348623157e308;6;7;8;9\n"
+                    "102;DEVICE_A;49.01234567890123456789;+7;-0;6;7;8;9\n";
+    std::stringstream str(input);
+    location_data expected = parse_location_data(str);
+    location_data got = parse_location_data(input.data(), input.data() + input.size(), 2);
+
+    REQUIRE(got.devices.size() == expected.devices.size());
+    for (size_t i = 0; i < got.devices.size(); ++i) {
+        auto &got_dev = got.devices[i];
+        auto &expected_dev = expected.devices[i];
+
+        REQUIRE(got_dev.name == expected_dev.name);
+        REQUIRE(got_dev.data.size() == expected_dev.data.size());
+
+        INFO("Device name is " << got_dev.name);
+        for (size_t j = 0; j < got_dev.data.size(); ++j) {
+            INFO("Measurement index is " << j);
+            auto &g = got_dev.data[j];
+            auto &e = expected_dev.data[j];
+
+            REQUIRE(g.timestamp == e.timestamp);
+            REQUIRE(g.lat == e.lat);
+            REQUIRE(g.lng == e.lng);
+            REQUIRE(g.alt == e.alt);
+            // Other columns are not parsed.
+            REQUIRE(g.uncertainty == 0);
+        }
+    }
+}
+
 TEST_CASE("parses ground truth files", "[parser]")
 {
     using device = ground_truth::device;
@@ -393,3 +498,63 @@ TEST_CASE("parses game ground truth files", "[parser]")
         REQUIRE(set_equals(expected[ts], gt.timestamps[ts]));
     }
 }
+
+TEST_CASE("merging partial game results is equivalent to parsing", "[parser]")
+{
+    string input1 = "1000;1\n"
+                    "5000;2\n"
+                    "6000;-1\n";
+    string input2 = "2000;2\n"
+                    "3000;-1\n"
+                    "4000;1\n";
+
+    std::unordered_map<string, i32> evaders{
+        {"EV_1", 1}, {"EV_2", 2},
+    };
+
+    game_ground_truth_parser expected_parser(evaders, 1, 6);
+    {
+        std::istringstream in1(input1), in2(input2), in3("");
+        expected_parser.parse("EV_1", in3);
+        expected_parser.parse("DEV_1", in1);
+        expected_parser.parse("DEV_2", in2);
+    }
+    ground_truth expected = expected_parser.take();
+
+    // Partial results may be computed in any order,
+    // only the merge order matters.
+    game_ground_truth_parser parser(evaders, 1, 6);
+    std::istringstream in1(input1), in2(input2), in3("");
+    auto p2 = parser.parse_partial("DEV_2", in2);
+    auto p1 = parser.parse_partial("DEV_1", in1);
+    auto p3 = parser.parse_partial("EV_1", in3);
+    parser.merge(std::move(p3));
+    parser.merge(std::move(p1));
+    parser.merge(std::move(p2));
+    ground_truth gt = parser.take();
+
+    REQUIRE(gt.timestamps.size() == expected.timestamps.size());
+    for (i64 ts = 1; ts <= 6; ++ts) {
+        INFO("timestamp " << ts);
+        REQUIRE(set_equals(expected.timestamps[ts], gt.timestamps[ts]));
+    }
+
+    // Same for signal data.
+    string signal1 = "1331133709724;DEV_1;AP_1=-80,2412,,;AP_2=-81,2462,,;\n";
+    string signal2 = "1331133630203;DEV_2;AP_2=-47,2412,,;AP_3=-67,2437,,;\n";
+
+    game_signal_data_parser signal_parser;
+    std::istringstream s1(signal1), s2(signal2);
+    auto sp2 = signal_parser.parse_partial("DEV_2", s2);
+    auto sp1 = signal_parser.parse_partial("DEV_1", s1);
+    signal_parser.merge(std::move(sp1));
+    signal_parser.merge(std::move(sp2));
+    signal_data data = signal_parser.take();
+
+    REQUIRE(container_equal(data.bssids, vector<string>{"AP_1", "AP_2", "AP_3"}));
+    REQUIRE(data.devices.size() == 2);
+    REQUIRE(data.devices[1].name == "DEV_2");
+    REQUIRE(data.devices[1].data.size() == 2);
+    REQUIRE(data.devices[1].data[0].access_point_id == 1);
+    REQUIRE(data.devices[1].data[1].access_point_id == 2);
+}
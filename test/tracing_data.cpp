@@ -1,28 +1,27 @@
 #include "catch.hpp"
 
+#include <limits>
+#include <random>
+
 #include "mp/feature_computation.hpp"
 #include "mp/parser.hpp"
 #include "mp/tracing_data.hpp"
 
 using namespace mp;
 
+template<typename T>
+static vector<typename std::remove_const<T>::type> to_vector(array_view<T> view)
+{
+    return {view.begin(), view.end()};
+}
+
 TEST_CASE("unique pairs returns correct result", "[tracing-data]")
 {
     tracing_data data;
-    data.devices = {
-        {
-            "dev0",
-            {}, {},
-        },
-        {
-            "dev1",
-            {}, {},
-        },
-        {
-            "dev2",
-            {}, {},
-        }
-    };
+    data.devices.resize(3);
+    data.devices[0].name = "dev0";
+    data.devices[1].name = "dev1";
+    data.devices[2].name = "dev2";
 
     auto tup = [](i32 i, i32 j) {
         return make_tuple(i, j);
@@ -75,12 +74,21 @@ TEST_CASE("transforms signal data correctly", "[tracing-data]")
     REQUIRE(result.duration == 2);
     REQUIRE(result.devices.size() == 2);
 
+    // Only the active span of every device is stored.
+    REQUIRE(result.devices[0].begin_timestamp == 1);
+    REQUIRE(result.devices[0].end_timestamp == 1);
+    REQUIRE(result.devices[1].begin_timestamp == 1);
+    REQUIRE(result.devices[1].end_timestamp == 2);
+
+    // Timestamps after the last measurement return the last row.
+    REQUIRE(result.data_at(result.devices[0], 2)[0] == -(50 + 48)/2.0);
+    REQUIRE(result.has_data_at(result.devices[0], 2)[0] == 1);
+
     vector<vector<double>> expect{
         // First device.
         // Row: timestamp, Column: Access Point
         {
             -(50 + 48)/2.0,   -60,    -90,    // first item: average of two values, third item: minimum signal strenght
-            -(50 + 48)/2.0,   -60,    -90,    // copied because no measurement in source data
         },
         // Second device
         {
@@ -93,7 +101,6 @@ TEST_CASE("transforms signal data correctly", "[tracing-data]")
         // First device.
         {
             1, 1, 0,
-            1, 1, 0,
         },
         {
             0, 1, 1,
@@ -193,6 +200,289 @@ TEST_CASE("transforms location data correctly", "[tracing-data]")
     }
 }
 
+TEST_CASE("transform ignores measurements outside of the range", "[tracing-data]")
+{
+    location_data data{
+        // Devices
+        {
+            {
+                "DEV_1",
+                {
+                    {1, 10, 11, 12, 0, 0, 0, 0},
+                    {2, 11,  9, 12, 0, 0, 0, 0},
+                    {3, 12,  8, 11, 0, 0, 0, 0},
+                    {4, 13,  7, 10, 0, 0, 0, 0},
+                },
+            },
+            {
+                "DEV_2",
+                {
+                    {4, 14, 33, 12, 0, 0, 0, 0},
+                    {5, 16, 35, 13, 0, 0, 0, 0},
+                }
+            }
+        },
+    };
+
+    tracing_data result = transform(data, 2, 3);
+
+    REQUIRE(result.min_timestamp == 2);
+    REQUIRE(result.max_timestamp == 3);
+    REQUIRE(result.duration == 2);
+    REQUIRE(result.devices.size() == 2);
+
+    auto &dev_1 = result.devices[0];
+    REQUIRE(dev_1.begin_timestamp == 2);
+    REQUIRE(dev_1.end_timestamp == 3);
+    REQUIRE(dev_1.data == array_2d<double>({11, 9, 12, 12, 8, 11}, 2, 3));
+
+    // No measurements in range.
+    REQUIRE(result.devices[1].empty());
+
+    // Devices are padded before their first measurement.
+    auto &dev_2 = result.devices[1];
+    for (i64 ts = 2; ts <= 3; ++ts) {
+        REQUIRE(result.row_index(dev_2, ts) == -1);
+        REQUIRE(to_vector(result.data_at(dev_2, ts)) == (vector<double>{0, 0, 0}));
+        REQUIRE(to_vector(result.has_data_at(dev_2, ts)) == (vector<char>{1, 1, 1}));
+    }
+}
+
+TEST_CASE("devices have no data before their first measurement", "[tracing-data]")
+{
+    signal_data data{
+        {"AP_1", "AP_2"},
+        {
+            {"DEV_1", {{1, 0, -50}, {3, 1, -60}}},
+            {"DEV_2", {{2, 1, -40}}},
+        },
+    };
+
+    tracing_data result = transform(data, -90);
+    REQUIRE(result.min_timestamp == 1);
+    REQUIRE(result.max_timestamp == 3);
+
+    auto &dev = result.devices[1];
+    REQUIRE(dev.begin_timestamp == 2);
+    REQUIRE(dev.end_timestamp == 2);
+
+    REQUIRE(result.row_index(dev, 1) == -1);
+    REQUIRE(to_vector(result.data_at(dev, 1)) == (vector<double>{-90, -90}));
+    REQUIRE(to_vector(result.has_data_at(dev, 1)) == (vector<char>{0, 0}));
+
+    // The last row is repeated after the last measurement.
+    for (i64 ts = 2; ts <= 3; ++ts) {
+        REQUIRE(result.row_index(dev, ts) == 0);
+        REQUIRE(to_vector(result.data_at(dev, ts)) == (vector<double>{-90, -40}));
+        REQUIRE(to_vector(result.has_data_at(dev, ts)) == (vector<char>{0, 1}));
+    }
+}
+
+TEST_CASE("location rows before the first measurement report data", "[tracing-data]")
+{
+    location_data data;
+    data.devices.emplace_back("DEV_1");
+    data.devices.emplace_back("DEV_2");
+    data.devices[0].data.push_back({1, 1.0, 2.0, 3.0, 0, 0, 0, 0});
+    data.devices[0].data.push_back({3, 4.0, 5.0, 6.0, 0, 0, 0, 0});
+    data.devices[1].data.push_back({2, 7.0, 8.0, 9.0, 0, 0, 0, 0});
+
+    tracing_data result = transform(data);
+    REQUIRE(result.min_timestamp == 1);
+    REQUIRE(result.max_timestamp == 3);
+
+    auto &dev = result.devices[1];
+    REQUIRE(dev.begin_timestamp == 2);
+
+    // Same as the dense representation: zeros, but has_data is always set.
+    REQUIRE(result.row_index(dev, 1) == -1);
+    REQUIRE(to_vector(result.data_at(dev, 1)) == (vector<double>{0, 0, 0}));
+    REQUIRE(to_vector(result.has_data_at(dev, 1)) == (vector<char>{1, 1, 1}));
+
+    for (i64 ts = 2; ts <= 3; ++ts) {
+        REQUIRE(to_vector(result.data_at(dev, ts)) == (vector<double>{7, 8, 9}));
+        REQUIRE(to_vector(result.has_data_at(dev, ts)) == (vector<char>{1, 1, 1}));
+    }
+}
+
+// Transforms the measurements into a matrix with one row for every timestamp in [min, max]
+// (like transform() did before it stored only the active span of every device).
+// "add" accumulates a measurement into a row and its has_data row,
+// "finish" finalizes a row with at least one measurement.
+template<typename Measurement, typename Add, typename Finish>
+static tracing_data dense_transform(const vector<vector<Measurement>> &devices,
+                                    i32 dimension, double default_value, char default_has_data,
+                                    Add &&add, Finish &&finish)
+{
+    tracing_data td;
+    td.data_dimension = dimension;
+    td.min_timestamp = std::numeric_limits<i64>::max();
+    td.max_timestamp = std::numeric_limits<i64>::min();
+    for (auto &entries : devices) {
+        for (auto &entry : entries) {
+            td.min_timestamp = std::min(td.min_timestamp, entry.timestamp);
+            td.max_timestamp = std::max(td.max_timestamp, entry.timestamp);
+        }
+    }
+    td.duration = td.max_timestamp - td.min_timestamp + 1;
+
+    for (auto &entries : devices) {
+        tracing_data::device_data dev;
+        dev.name = "D" + std::to_string(td.devices.size());
+        dev.begin_timestamp = td.min_timestamp;
+        dev.end_timestamp = td.max_timestamp;
+        dev.data.resize(td.duration, dimension, 0.0);
+        dev.has_data.resize(td.duration, dimension, 0);
+        dev.padding.assign(dimension, default_value);
+        dev.padding_has_data.assign(dimension, default_has_data);
+
+        auto iter = entries.begin();
+        for (i64 row = 0; row < td.duration; ++row) {
+            auto data = dev.data.row(row);
+            auto has_data = dev.has_data.row(row);
+
+            i64 ts = td.min_timestamp + row;
+            vector<i32> seen(dimension, 0);
+            bool have_entries = false;
+            for (; iter != entries.end() && iter->timestamp == ts; ++iter) {
+                add(*iter, data, seen);
+                have_entries = true;
+            }
+
+            if (have_entries) {
+                finish(data, has_data, seen);
+            } else if (row > 0) {
+                std::copy(dev.data.row(row - 1).begin(), dev.data.row(row - 1).end(), data.begin());
+                std::copy(dev.has_data.row(row - 1).begin(), dev.has_data.row(row - 1).end(), has_data.begin());
+            } else {
+                std::fill(data.begin(), data.end(), default_value);
+                std::fill(has_data.begin(), has_data.end(), default_has_data);
+            }
+        }
+        td.devices.push_back(std::move(dev));
+    }
+    return td;
+}
+
+// Checks that every feature vector in "actual" equals the feature vector
+// of the same pair and timestamp in "expected".
+static void require_same_features(const similarity_data &expected, const similarity_data &actual)
+{
+    REQUIRE(actual.pairs.size() == expected.pairs.size());
+    for (size_t i = 0; i < actual.pairs.size(); ++i) {
+        auto &a = actual.pairs[i];
+        auto &e = expected.pairs[i];
+        REQUIRE(a.left == e.left);
+        REQUIRE(a.right == e.right);
+
+        i64 rows = 0;
+        for (i64 ts = actual.begin_timestamp; ts <= actual.end_timestamp; ++ts) {
+            if (!actual.has_feature_at(a, ts)) {
+                continue;
+            }
+            ++rows;
+
+            INFO("Pair " << a.left << ", " << a.right << " at " << ts);
+            auto av = actual.feature_at(a, ts);
+            auto ev = expected.feature_at(e, ts);
+            for (size_t j = 0; j < av.size(); ++j) {
+                REQUIRE(av[j] == Approx(ev[j]));
+            }
+        }
+        REQUIRE(rows == i64(a.features.rows()));
+    }
+}
+
+TEST_CASE("features near the edges of device spans", "[tracing-data]")
+{
+    // Devices start and stop at different times, with gaps in between.
+    // Lagged and windowed reads reach outside the other device's span.
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<i32> strength_dist(-80, -30);
+    std::uniform_real_distribution<double> coord_dist(-5.0, 5.0);
+    std::bernoulli_distribution measure_dist(0.6);
+
+    const vector<tuple<i64, i64>> spans{
+        make_tuple(0, 39), make_tuple(8, 39), make_tuple(13, 27), make_tuple(3, 20)
+    };
+
+    signal_data sd;
+    sd.bssids = {"AP_1", "AP_2", "AP_3"};
+    location_data ld;
+    vector<vector<signal_data::measurement>> signal_entries;
+    vector<vector<location_data::measurement>> location_entries;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const string name = "D" + std::to_string(i);
+        sd.devices.emplace_back(name);
+        ld.devices.emplace_back(name);
+
+        i64 begin, end;
+        std::tie(begin, end) = spans[i];
+        for (i64 ts = begin; ts <= end; ++ts) {
+            if (ts != begin && ts != end && !measure_dist(rng)) {
+                continue;
+            }
+            for (i32 ap = 0; ap < 3; ++ap) {
+                if (measure_dist(rng)) {
+                    sd.devices[i].data.push_back({ts, ap, strength_dist(rng)});
+                }
+            }
+            if (sd.devices[i].data.empty() || sd.devices[i].data.back().timestamp != ts) {
+                sd.devices[i].data.push_back({ts, 0, strength_dist(rng)});
+            }
+            ld.devices[i].data.push_back({ts, coord_dist(rng), coord_dist(rng), coord_dist(rng), 0, 0, 0, 0});
+        }
+        signal_entries.push_back(sd.devices[i].data);
+        location_entries.push_back(ld.devices[i].data);
+    }
+
+    tracing_data signal_expected = dense_transform(
+                signal_entries, 3, -90, 0,
+                [](const signal_data::measurement &m, array_view<double> row, vector<i32> &seen) {
+        row[m.access_point_id] += m.signal_strength;
+        ++seen[m.access_point_id];
+    }, [](array_view<double> row, array_view<char> has_data, const vector<i32> &seen) {
+        for (size_t ap = 0; ap < row.size(); ++ap) {
+            row[ap] = seen[ap] ? row[ap] / seen[ap] : -90;
+            has_data[ap] = seen[ap] ? 1 : 0;
+        }
+    });
+    tracing_data location_expected = dense_transform(
+                location_entries, 3, 0.0, 1,
+                [](const location_data::measurement &m, array_view<double> row, vector<i32> &seen) {
+        row[0] += m.lat;
+        row[1] += m.lng;
+        row[2] += m.alt;
+        ++seen[0];
+    }, [](array_view<double> row, array_view<char> has_data, const vector<i32> &seen) {
+        for (size_t c = 0; c < row.size(); ++c) {
+            row[c] /= seen[0];
+            has_data[c] = 1;
+        }
+    });
+
+    vector<tuple<tracing_data, tracing_data>> inputs;
+    inputs.push_back(make_tuple(transform(sd, -90), std::move(signal_expected)));
+    inputs.push_back(make_tuple(transform(ld), std::move(location_expected)));
+    for (auto &input : inputs) {
+        const tracing_data &td = get<0>(input);
+        const tracing_data &expected_td = get<1>(input);
+        REQUIRE(td.min_timestamp == expected_td.min_timestamp);
+        REQUIRE(td.max_timestamp == expected_td.max_timestamp);
+
+        feature_computation fc;
+        fc.time_lag = 4;
+        fc.window_size = 5;
+        fc.begin_timestamp = td.min_timestamp;
+        fc.end_timestamp = td.max_timestamp;
+
+        auto pairs = td.unique_pairs();
+        require_same_features(fc.compute_euclid(expected_td, pairs), fc.compute_euclid(td, pairs));
+        require_same_features(fc.compute_dtw(expected_td, pairs), fc.compute_dtw(td, pairs));
+        require_same_features(fc.compute_multi_dtw(expected_td, pairs), fc.compute_multi_dtw(td, pairs));
+    }
+}
+
 TEST_CASE("moving average", "[tracing-data]")
 {
     // Moving average over 3 data points.
@@ -207,10 +497,28 @@ TEST_CASE("moving average", "[tracing-data]")
     td.min_timestamp = 1;
     td.max_timestamp = 6;
     td.duration = 6;
-    td.devices.push_back({"A", {input_1, 6, 1}, array_2d<char>(6, 1, 1)});
-    td.devices.push_back({"B", {input_2, 6, 1}, array_2d<char>(6, 1, 1)});
+    auto add_device = [&](string name, const vector<double> &input, i64 begin) {
+        tracing_data::device_data dev;
+        dev.name = std::move(name);
+        dev.data = array_2d<double>(input, input.size(), 1);
+        dev.has_data = array_2d<char>(input.size(), 1, 1);
+        dev.begin_timestamp = begin;
+        dev.end_timestamp = begin + i64(input.size()) - 1;
+        dev.padding.assign(1, -6.0);
+        dev.padding_has_data.assign(1, 0);
+        td.devices.push_back(std::move(dev));
+    };
+    add_device("A", input_1, 1);
+    add_device("B", input_2, 1);
+
+    // Starts at timestamp 3, the padding values before that are part of the average.
+    vector<double> input_3 {3.0, 6.0, 9.0, 12.0};
+    vector<double> expect_3{-3.0, 1.0, 6.0, 9.0};
+    add_device("C", input_3, 3);
+
     moving_average(td, 3);
 
     REQUIRE(td.devices[0].data == array_2d<double>(expect_1, 6, 1));
     REQUIRE(td.devices[1].data == array_2d<double>(expect_2, 6, 1));
+    REQUIRE(td.devices[2].data == array_2d<double>(expect_3, 4, 1));
 }